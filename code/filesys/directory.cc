@@ -24,6 +24,9 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "system.h"
+
+SlabCache Directory::cache("Directory", sizeof(Directory));
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -118,30 +121,26 @@ Directory::RecursivelyFind(char *name, char *fullPath)
     }
     else {
         // It contains directory
-        char *path = new char[strlen(name) + 1];
+        char *path = currentThread->scratch.Allocate(strlen(name) + 1);
         strncpy(path, name, p - name);
         path[p - name] = '\0';
         
         // Find path in directory
         if(FindIndex(path) == -1) {
             // Path does not exist, return FALSE
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: No such file or directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return -1;
         }
 
         if(!table[FindIndex(path)].isDirectory) {
             // Path is not a directory
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: Not a directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return -1;
         }
 
@@ -150,7 +149,6 @@ Directory::RecursivelyFind(char *name, char *fullPath)
         OpenFile *directoryFile = new OpenFile(Find(path));
         directory->FetchFrom(directoryFile);
         int result = directory->RecursivelyFind(p + 1, fullPath);
-        delete path;
         delete directory;
         delete directoryFile;
         return result;
@@ -161,12 +159,13 @@ Directory::RecursivelyFind(char *name, char *fullPath)
 int
 Directory::Find(char *name)
 {
-    char *temp = new char[strlen(name) + 1];
+    // the copies of the name and its parts are freed when we return
+    ArenaMark mark(&currentThread->scratch);
+    char *temp = currentThread->scratch.Allocate(strlen(name) + 1);
     strcpy(temp, name);
     if(temp[strlen(temp) - 1] == '/')
         temp[strlen(temp) - 1] = '\0'; // remove suffix '/'
     int result = RecursivelyFind(temp, temp);
-    delete temp;
     return result;
 }
 //----------------------------------------------------------------------
@@ -209,30 +208,26 @@ Directory::RecursivelyAdd(char *name, char *fullPath, int newSector, bool isDire
     }
     else {
         // It contains directory
-        char *path = new char[strlen(name) + 1];
+        char *path = currentThread->scratch.Allocate(strlen(name) + 1);
         strncpy(path, name, p - name);
         path[p - name] = '\0';
 
         // Find path in directory
         if(FindIndex(path) == -1) {
             // Path does not exist, return FALSE
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: No such file or directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return FALSE;
         }
 
         if(!table[FindIndex(path)].isDirectory) {
             // Path is not a directory
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: Not a directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return FALSE;
         }
 
@@ -242,14 +237,12 @@ Directory::RecursivelyAdd(char *name, char *fullPath, int newSector, bool isDire
         directory->FetchFrom(directoryFile);
         if(!directory->RecursivelyAdd(p + 1, fullPath, newSector, isDirectory)) {
             // Add file failed
-            delete path;
             delete directory;
             delete directoryFile;
             return FALSE;
         }
         directory->WriteBack(directoryFile);
 
-        delete path;
         delete directory;
         delete directoryFile;
         return TRUE;
@@ -259,7 +252,8 @@ Directory::RecursivelyAdd(char *name, char *fullPath, int newSector, bool isDire
 bool
 Directory::Add(char *name, int newSector)
 {
-    char *temp = new char[strlen(name) + 1];
+    ArenaMark mark(&currentThread->scratch);
+    char *temp = currentThread->scratch.Allocate(strlen(name) + 1);
     bool isDirectory = FALSE;
     strcpy(temp, name);
     if(temp[strlen(temp) - 1] == '/') {
@@ -267,7 +261,6 @@ Directory::Add(char *name, int newSector)
         temp[strlen(temp) - 1] = '\0'; // remove suffix '/'
     }
     bool result = RecursivelyAdd(temp, temp, newSector, isDirectory);
-    delete temp;
     return result;
 }
 //----------------------------------------------------------------------
@@ -292,30 +285,26 @@ Directory::RecursivelyRemove(char *name, char *fullPath)
     }
     else {
         // It contains directory
-        char *path = new char[strlen(name) + 1];
+        char *path = currentThread->scratch.Allocate(strlen(name) + 1);
         strncpy(path, name, p - name);
         path[p - name] = '\0';
         
         // Find path in directory
         if(FindIndex(path) == -1) {
             // Path does not exist, return FALSE
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: No such file or directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return FALSE;
         }
 
         if(!table[FindIndex(path)].isDirectory) {
             // Path is not a directory
-            char *currentPath = new char[strlen(fullPath) + 1];
+            char *currentPath = currentThread->scratch.Allocate(strlen(fullPath) + 1);
             strcpy(currentPath, fullPath);
             currentPath[strlen(fullPath) - strlen(name)] = '\0';
             printf("%s%s: Not a directory\n", currentPath, path);
-            delete currentPath;
-            delete path;
             return FALSE;
         }
 
@@ -324,13 +313,11 @@ Directory::RecursivelyRemove(char *name, char *fullPath)
         OpenFile *directoryFile = new OpenFile(Find(path));
         directory->FetchFrom(directoryFile);
         if(!directory->RecursivelyRemove(p + 1, fullPath)) {
-            delete path;
             delete directory;
             delete directoryFile;
             return FALSE;
         }
         directory->WriteBack(directoryFile);
-        delete path;
         delete directory;
         delete directoryFile;
         return TRUE;
@@ -341,12 +328,12 @@ Directory::RecursivelyRemove(char *name, char *fullPath)
 bool
 Directory::Remove(char *name)
 { 
-    char *temp = new char[strlen(name) + 1];
+    ArenaMark mark(&currentThread->scratch);
+    char *temp = currentThread->scratch.Allocate(strlen(name) + 1);
     strcpy(temp, name);
     if(temp[strlen(temp) - 1] == '/')
         temp[strlen(temp) - 1] = '\0'; // remove suffix '/'
     bool result = RecursivelyRemove(temp, temp);
-    delete temp;
     return result;	
 }
 
@@ -402,14 +389,13 @@ Directory::RecursivelyPrint(char *currentPath)
             hdr->Print();
             Directory *directory = new Directory(NumDirEntries);
             OpenFile *directoryFile = new OpenFile(table[i].sector);
-            char *path = new char[strlen(currentPath) + FileNameMaxLen + 2];
+            char *path = currentThread->scratch.Allocate(strlen(currentPath) + FileNameMaxLen + 2);
             path[0] = '\0';
             strcat(path, currentPath);
             strcat(path, "/");
             strcat(path, table[i].name);
             directory->FetchFrom(directoryFile);
             directory->RecursivelyPrint(path);
-            delete path;
             delete directory;
             delete directoryFile;
         }
@@ -426,6 +412,7 @@ Directory::RecursivelyPrint(char *currentPath)
 void
 Directory::Print()
 { 
+    ArenaMark mark(&currentThread->scratch);
     char *currentPath = "";
     RecursivelyPrint(currentPath);
 }
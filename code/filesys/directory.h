@@ -18,6 +18,7 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#include "slab.h"
 
 #define FileNameMaxLen 		24	// for simplicity, we assume 
 					// file names are <= 9 characters long
@@ -56,6 +57,10 @@ class Directory {
 					// with space for "size" files
     ~Directory();			// De-allocate the directory
 
+    void *operator new(size_t size) { return cache.Allocate(size); }
+    void operator delete(void *dir) { cache.Free(dir); }
+					// (the table is still on the heap)
+
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
     void WriteBack(OpenFile *file);	// Write modifications to 
 					// directory contents back to disk
@@ -85,6 +90,8 @@ class Directory {
     bool RecursivelyRemove(char *name, char *fullPath);
     void RecursivelyList(int layer);
     void RecursivelyPrint(char *currentPath);
+
+    static SlabCache cache;		// free directories
 };
 
 #endif // DIRECTORY_H
@@ -27,6 +27,8 @@
 #include "system.h"
 #include "filehdr.h"
 
+SlabCache FileHeader::cache("FileHeader", sizeof(FileHeader));
+
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
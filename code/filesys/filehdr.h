@@ -16,6 +16,7 @@
 
 #include "disk.h"
 #include "bitmap.h"
+#include "slab.h"
 #include <time.h>
 
 #define NumDirect 	((SectorSize - 3 * sizeof(int) - 4 * sizeof(time_t)) / sizeof(int))
@@ -38,6 +39,11 @@
 
 class FileHeader {
   public:
+    void *operator new(size_t size) { return cache.Allocate(size); }
+    void operator delete(void *hdr) { cache.Free(hdr); }
+					// file headers come and go with
+					// every Open, Create and Remove
+
     bool Allocate(BitMap *bitMap, int fileSize);// Initialize a file header, 
 						//  including allocating space 
 						//  on disk for the file data
@@ -78,6 +84,8 @@ class FileHeader {
     int nextSectorOfHeader;
     int dataSectors[NumDirect];		// Disk sector numbers for each data 
 					// block in the file
+
+    static SlabCache cache;		// free file headers
 };
 
 #endif // FILEHDR_H
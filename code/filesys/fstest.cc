@@ -244,7 +244,8 @@ void InputThread(int arg) {
                     goto end;
             }
         }
-        currentThread->Yield();
+        currentThread->SleepFor(TimerTicks);	// poll the terminal
+						// once a time slice
     }
 end:
     delete pipe;
@@ -162,6 +162,9 @@ int OpenFile::PipeWrite(char *into, int numBytes) {
 //	   in the data that will be modified, and write back all the full
 //	   or partial sectors that are part of the request.
 //
+//	The sectors are transferred through a buffer in the thread's arena,
+//	freed when we return.
+//
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
 //	"numBytes" -- the number of bytes to transfer
@@ -174,6 +177,7 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
+    ArenaMark mark(&currentThread->scratch);
     char *buf;
 
     if ((numBytes <= 0) || (position >= fileLength))
@@ -188,14 +192,13 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     numSectors = 1 + lastSector - firstSector;
 
     // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
+    buf = currentThread->scratch.Allocate(numSectors * SectorSize);
     for (i = firstSector; i <= lastSector; i++)	
         synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
 					&buf[(i - firstSector) * SectorSize]);
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
     hdr->UpdateAccessTime();
     return numBytes;
 }
@@ -206,6 +209,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     bool firstAligned, lastAligned;
+    ArenaMark mark(&currentThread->scratch);
     char *buf;
 
     if (numBytes <= 0)
@@ -221,7 +225,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
 
-    buf = new char[numSectors * SectorSize];
+    buf = currentThread->scratch.Allocate(numSectors * SectorSize);
 
     firstAligned = (position == (firstSector * SectorSize));
     lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
@@ -240,7 +244,6 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     for (i = firstSector; i <= lastSector; i++)	
         synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
 					&buf[(i - firstSector) * SectorSize]);
-    delete [] buf;
     hdr->UpdateAccessTime();
     hdr->UpdateModifyTime();
     return numBytes;
@@ -0,0 +1,969 @@
+// bintrans.cc
+//	Routines to translate blocks of user instructions into i386 host
+//	code, and to run it.  See bintrans.h.
+//
+//	The host code only uses the registers EAX, ECX and EDX, which a
+//	C routine may change, so it can be called like one.  It addresses
+//	the user registers, the translation cache and the statistics
+//	directly: each translator's code is only run by its own processor.
+//
+//	Every block is laid out as:
+//
+//		a check of the interrupt horizon
+//		the code for each instruction
+//		a call to charge for the block, and the PC update
+//		jumps to the next block (cf. ChainTo)
+//		the exits, one per instruction that can leave early:
+//		    charge for the instructions before it, set the PC
+//		    to it, and return FALSE
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "bintrans.h"
+#include "mipssim.h"
+#include "system.h"
+
+#include <stddef.h>
+
+// The host registers we use
+#define EAX		0
+#define ECX		1
+#define EDX		2
+
+// Host condition codes, for Jcc and SETcc
+#define CondO		0x0		// overflow
+#define CondB		0x2		// below (unsigned less than)
+#define CondE		0x4		// equal
+#define CondNE		0x5		// not equal
+#define CondL		0xc		// less than
+#define CondGE		0xd		// greater or equal
+#define CondLE		0xe		// less or equal
+#define CondG		0xf		// greater than
+
+// What LoadReg holds when an instruction finishes (cf. DelayedLoad)
+#define PendingUnknown	0		// whatever it did when the block
+					// was entered
+#define PendingNone	1		// zero: no load is pending
+#define PendingLoad	2		// "pendingReg", and LoadValueReg
+					// has the value for it
+
+// How the jump to the next block is patched, once that is translated
+#define ChainSamePage	0		// just the jump
+#define ChainOtherPage	1		// the page it is on, as well
+
+// Offsets in the host code ChainTo emits for a jump to another page
+#define GuardHostPage	22		// where the page must be
+#define GuardVersionAddr 34		// where its version is kept
+#define GuardVersion	38		// what the version must be
+#define GuardJump	67		// the jump to the block
+
+// The most host code one instruction (with its exit), and the rest of
+// a block, can take; stores take LinkCode more for each processor
+#define InstrCode	320
+#define LinkCode	18
+#define BlockCode	384
+
+#define ModRM(mod, reg, rm)	(((mod) << 6) | ((reg) << 3) | (rm))
+#define UserReg(r)	((void *) &processor->registers[(int) (r)])
+
+typedef int (*HostCode)();	// a block, called from Run
+
+//----------------------------------------------------------------------
+// IsBranch
+// 	Return TRUE if "instr" is a branch or jump, and so has a delay
+//	slot.
+//----------------------------------------------------------------------
+
+static bool
+IsBranch(Instruction *instr)
+{
+    switch (instr->opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BGEZ: case OP_BGEZAL:
+      case OP_BGTZ: case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL:
+      case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Translatable
+// 	Return TRUE if we generate host code for "instr".  The rest are
+//	rare enough to leave to the interpreter: system calls, LL and SC
+//	(which need the kernel's view of the link), the unaligned loads
+//	and stores, and instructions that raise an exception.
+//----------------------------------------------------------------------
+
+static bool
+Translatable(Instruction *instr)
+{
+    switch (instr->opCode) {
+      case OP_LL: case OP_SC: case OP_LWL: case OP_LWR:
+      case OP_SWL: case OP_SWR: case OP_SYSCALL:
+      case OP_UNIMP: case OP_RES: case OP_RFE:
+	return FALSE;
+      default:
+	return TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::BinaryTranslator
+// 	Initialize a translator, with nothing translated yet.
+//
+//	"m" is the processor whose user program we run
+//	"area" is executable memory, from AllocCodeArray, for the code
+//	"size" is how big "area" is
+//----------------------------------------------------------------------
+
+BinaryTranslator::BinaryTranslator(Machine *m, char *area, int size)
+{
+    processor = m;
+    code = (unsigned char *) area;
+    codeSize = size;
+    for (pageShift = 0; (1 << pageShift) < PageSize; pageShift++)
+	;
+    ASSERT((1 << pageShift) == PageSize);
+    ASSERT((SoftTLBSize & (SoftTLBSize - 1)) == 0);
+    totalTicks = userTicks = tlbHits = NULL;
+    horizon = NULL;
+    codeEntry = NULL;
+    Flush();
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::Run
+// 	Run the user program from its PC, as host code, until an
+//	instruction must be interpreted, or we have to look the next
+//	block up.  Translate the block at the PC, if it hasn't been
+//	already, and chain the block that just returned to it.
+//
+//	The PC must be in the translation cache, and not in a delay
+//	slot; otherwise it is up to the interpreter.
+//
+// Returns:
+//	FALSE if the instruction at the PC must be interpreted, TRUE if
+//	Run should just be called again
+//----------------------------------------------------------------------
+
+bool
+BinaryTranslator::Run()
+{
+    int virtAddr = processor->registers[PCReg];
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    SoftTLBEntry *soft = &processor->softTLB[vpn % SoftTLBSize];
+    TranslatedBlock *block;
+    int physAddr;
+
+    if (processor->registers[NextPCReg] != virtAddr + 4
+		|| soft->virtualPage != vpn || (virtAddr & 0x3) != 0) {
+	patchSite = NULL;
+	return FALSE;
+    }
+    physAddr = (soft->hostPage - processor->mainMemory)
+		+ (unsigned) virtAddr % PageSize;
+    block = blockAt[physAddr / 4];
+    if (block == NULL || block->virtAddr != virtAddr
+		|| block->version != processor->codeVersion[physAddr / PageSize]) {
+	block = TranslateBlock(virtAddr, physAddr);
+	if (block == NULL) {
+	    patchSite = NULL;
+	    return FALSE;
+	}
+    }
+    if (patchSite != NULL)
+	Link(block, soft);
+
+    totalTicks = &stats->totalTicks;
+    userTicks = &stats->userTicks;
+    tlbHits = &stats->numTLBHits;
+    horizon = interrupt->UserHorizon();
+    codeEntry = soft->entry;
+    codeEntry->use = TRUE;		// as fetching the first instruction would
+    return ((HostCode) block->code)() != 0;
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::Flush
+// 	Throw away every block, and start the code cache again with the
+//	routine that charges for instructions run.
+//
+//	The routine is called with how many instructions were run in
+//	EAX.  It charges their ticks (cf. Interrupt::OneUserTick) and,
+//	with a TLB, counts their fetches as TLB hits, the last of them a
+//	tick ago (cf. RunBlocks).
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::Flush()
+{
+    for (int i = 0; i < MemorySize / 4; i++)
+	blockAt[i] = NULL;
+    numBlocks = 0;
+    patchSite = NULL;
+    emit = code;
+
+    charge = emit;
+    RegReg(0x69, EDX, EAX); Word(UserTick);	// imul edx, eax, UserTick
+    Mem(0x8b, ECX, &totalTicks);		// mov ecx, [totalTicks]
+    RegInd(0x01, EDX, ECX);			// add [ecx], edx
+    Mem(0x8b, ECX, &userTicks);
+    RegInd(0x01, EDX, ECX);
+    if (processor->tlb != NULL) {
+	Mem(0x8b, ECX, &tlbHits);
+	RegInd(0x01, EAX, ECX);			// add [ecx], eax
+	Mem(0x8b, ECX, &totalTicks);
+	RegInd(0x8b, EDX, ECX);			// mov edx, [ecx]
+	RegReg(0x81, 5, EDX); Word(UserTick);	// sub edx, UserTick
+	Mem(0x8b, ECX, &codeEntry);
+	RegMem(0x89, EDX, ECX, offsetof(TranslationEntry, lastUseTime));
+    }
+    Byte(0xc3);					// ret
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::Link
+// 	Make the jump at "patchSite", which has just returned to Run
+//	for want of the block at the PC, go straight to it from now on.
+//
+//	"block" is the block at the PC
+//	"soft" is the translation cache entry for the PC's page
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::Link(TranslatedBlock *block, SoftTLBEntry *soft)
+{
+    unsigned char *jump = patchSite;
+
+    if (patchKind == ChainOtherPage) {	// the page must stay the same
+	int page = (soft->hostPage - processor->mainMemory) / PageSize;
+
+	*(char **) (patchSite + GuardHostPage) = soft->hostPage;
+	*(unsigned int **) (patchSite + GuardVersionAddr)
+		= &processor->codeVersion[page];
+	*(unsigned int *) (patchSite + GuardVersion) = block->version;
+	jump = patchSite + GuardJump;
+    }
+    *(int *) (jump + 1) = block->code - (jump + 5);
+    patchSite = NULL;
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::TranslateBlock
+// 	Translate the block of instructions starting at "virtAddr",
+//	flushing the code cache first if it might not fit.
+//
+//	The block runs up to the end of the page, or through the delay
+//	slot of the first branch, or up to an instruction we don't
+//	translate, whichever comes first.  A branch whose delay slot
+//	can't be translated with it ends the block before it.
+//
+//	"virtAddr" is the user address of the first instruction
+//	"physAddr" is its physical address
+//
+// Returns:
+//	the block, or NULL if the first instruction can't be translated
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+BinaryTranslator::TranslateBlock(int virtAddr, int physAddr)
+{
+    Instruction *instr = processor->DecodedInstruction(physAddr);
+    unsigned int version = processor->decodedVersion[physAddr / PageSize];
+    int left = NumPageInstrs - ((unsigned) physAddr % PageSize) / 4;
+    int length = 0, numProcessors = 0, i;
+    int next, target;
+    TranslatedBlock *block;
+    Machine *m;
+    unsigned char *notTaken;
+
+    __sync_synchronize();		// read "instr" after "version", cf.
+					// DecodedInstruction
+    endsInBranch = FALSE;
+    while (length < left && Translatable(&instr[length])) {
+	if (IsBranch(&instr[length])) {
+	    if (length + 1 < left && Translatable(&instr[length + 1])
+			&& !IsBranch(&instr[length + 1])) {
+		length += 2;
+		endsInBranch = TRUE;
+	    }
+	    break;
+	}
+	length++;
+    }
+    if (length == 0)
+	return NULL;
+
+    for (m = processor->firstProcessor; m != NULL; m = m->nextProcessor)
+	numProcessors++;
+    if (numBlocks == MaxBlocks || code + codeSize - emit
+		< BlockCode + length * (InstrCode + LinkCode * numProcessors))
+	Flush();
+
+    block = &blocks[numBlocks++];
+    block->virtAddr = virtAddr;
+    block->version = version;		// what "instr" was decoded from
+    block->code = emit;
+    blockStart = virtAddr;
+    blockLength = length;
+    blockHostPage = &processor->mainMemory[physAddr - physAddr % PageSize];
+    pendingLoad = PendingUnknown;
+    numExits = 0;
+
+    // All of the block must run before the next interrupt can be due;
+    // if not, leave the instruction that takes it to the interpreter
+    Mem(0x8b, EAX, &totalTicks);		// mov eax, [totalTicks]
+    RegInd(0x8b, EAX, EAX);			// mov eax, [eax]
+    RegReg(0x81, 0, EAX); Word(length * UserTick);	// add eax, ...
+    Mem(0x8b, ECX, &horizon);			// mov ecx, [horizon]
+    RegInd(0x3b, EAX, ECX);			// cmp eax, [ecx]
+    ExitIf(CondGE, 0);
+
+    for (i = 0; i < length; i++)
+	TranslateInstruction(&instr[i], i);
+
+    MoveImm(EAX, length);			// charge for the whole block
+    Jump(0xe8, charge);				// call charge
+    next = virtAddr + 4 * length;
+    if (endsInBranch) {
+	Instruction *branch = &instr[length - 2];
+
+	Mem(0x8b, EAX, UserReg(NextPCReg));	// wherever the branch went
+	Mem(0x89, EAX, UserReg(PCReg));
+	RegMem(0x8d, ECX, EAX, 4);		// lea ecx, [eax + 4]
+	Mem(0x89, ECX, UserReg(NextPCReg));
+	StoreImm(UserReg(PrevPCReg), next - 4);
+	switch (branch->opCode) {
+	  case OP_JR:
+	  case OP_JALR:				// Run must look the target up
+	    MoveImm(EAX, TRUE);
+	    Byte(0xc3);				// ret
+	    break;
+	  case OP_J:
+	  case OP_JAL:
+	    ChainTo((next & 0xf0000000) | IndexToAddr(branch->extra));
+	    break;
+	  default:
+	    target = next - 4 + IndexToAddr(branch->extra);
+	    if (target != next) {
+		RegReg(0x81, 7, EAX); Word(target);	// cmp eax, target
+		notTaken = Forward(0x0f80 | CondNE);
+		ChainTo(target);
+		Land(notTaken);
+	    }
+	    ChainTo(next);
+	}
+    } else {
+	StoreImm(UserReg(PCReg), next);
+	StoreImm(UserReg(NextPCReg), next + 4);
+	StoreImm(UserReg(PrevPCReg), next - 4);
+	if (length < left) {			// the interpreter runs the rest
+	    MoveImm(EAX, FALSE);
+	    Byte(0xc3);
+	} else
+	    ChainTo(next);
+    }
+    EmitExits();
+    ASSERT(emit - block->code
+		<= BlockCode + length * (InstrCode + LinkCode * numProcessors));
+    ASSERT(emit <= code + codeSize);
+
+    blockAt[physAddr / 4] = block;
+    return block;
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::TranslateInstruction
+// 	Emit the host code for one instruction, which does just what
+//	its handler in mipsops.h does, quirks and all.  Only the PC
+//	update is left out, since the PC is known as we translate: it is
+//	stored when the block ends, or leaves early.
+//
+//	"instr" is the instruction
+//	"index" is where it is in the block
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::TranslateInstruction(Instruction *instr, int index)
+{
+    int pc = blockStart + 4 * index;
+    int rs = instr->rs, rt = instr->rt, rd = instr->rd;
+    int extra = instr->extra;
+    unsigned char *skip, *done;
+
+    switch (instr->opCode) {
+      case OP_ADD:
+      case OP_SUB:
+	Mem(0x8b, EAX, UserReg(rs));		// mov eax, [rs]
+	Mem(instr->opCode == OP_ADD ? 0x03 : 0x2b, EAX, UserReg(rt));
+	ExitIf(CondO, index);			// the interpreter traps
+	if (rd != 0)
+	    Mem(0x89, EAX, UserReg(rd));	// mov [rd], eax
+	break;
+
+      case OP_ADDU:
+      case OP_SUBU:
+      case OP_AND:
+      case OP_XOR:
+      case OP_NOR:
+	if (rd == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(rs));
+	switch (instr->opCode) {
+	  case OP_ADDU: Mem(0x03, EAX, UserReg(rt)); break;
+	  case OP_SUBU: Mem(0x2b, EAX, UserReg(rt)); break;
+	  case OP_AND:  Mem(0x23, EAX, UserReg(rt)); break;
+	  case OP_XOR:  Mem(0x33, EAX, UserReg(rt)); break;
+	  case OP_NOR:  Mem(0x0b, EAX, UserReg(rt));
+			RegReg(0xf7, 2, EAX);	// not eax
+			break;
+	}
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_OR:				// rs | rs, as in mipsops.h
+	if (rd == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(rs));
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_ADDI:
+	Mem(0x8b, EAX, UserReg(rs));
+	RegReg(0x81, 0, EAX); Word(extra);	// add eax, extra
+	ExitIf(CondO, index);
+	if (rt != 0)
+	    Mem(0x89, EAX, UserReg(rt));
+	break;
+
+      case OP_ADDIU:
+      case OP_ANDI:
+      case OP_ORI:
+      case OP_XORI:
+	if (rt == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(rs));
+	switch (instr->opCode) {
+	  case OP_ADDIU: RegReg(0x81, 0, EAX); Word(extra); break;
+	  case OP_ANDI:  RegReg(0x81, 4, EAX); Word(extra & 0xffff); break;
+	  case OP_ORI:   RegReg(0x81, 1, EAX); Word(extra & 0xffff); break;
+	  case OP_XORI:  RegReg(0x81, 6, EAX); Word(extra & 0xffff); break;
+	}
+	Mem(0x89, EAX, UserReg(rt));
+	break;
+
+      case OP_LUI:
+	if (rt != 0)
+	    StoreImm(UserReg(rt), extra << 16);
+	break;
+
+      case OP_SLT:
+      case OP_SLTU:
+      case OP_SLTI:
+      case OP_SLTIU:
+	if (instr->opCode == OP_SLTI || instr->opCode == OP_SLTIU)
+	    rd = rt;
+	if (rd == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(rs));
+	if (instr->opCode == OP_SLT || instr->opCode == OP_SLTU)
+	    Mem(0x3b, EAX, UserReg(rt));	// cmp eax, [rt]
+	else {
+	    RegReg(0x81, 7, EAX); Word(extra);	// cmp eax, extra
+	}
+	RegReg(0x0f90 | ((instr->opCode == OP_SLT || instr->opCode == OP_SLTI)
+				? CondL : CondB), 0, EAX);	// setcc al
+	RegReg(0x0fb6, EAX, EAX);		// movzx eax, al
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_SLL:
+      case OP_SRA:
+      case OP_SRL:				// arithmetic, as in mipsops.h
+	if (rd == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(rt));
+	if (extra != 0) {
+	    RegReg(0xc1, instr->opCode == OP_SLL ? 4 : 7, EAX);
+	    Byte(extra);			// shl/sar eax, extra
+	}
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_SLLV:
+      case OP_SRAV:
+      case OP_SRLV:
+	if (rd == 0)
+	    break;
+	Mem(0x8b, ECX, UserReg(rs));
+	Mem(0x8b, EAX, UserReg(rt));
+	RegReg(0xd3, instr->opCode == OP_SLLV ? 4 : 7, EAX);	// by cl
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_MFHI:
+      case OP_MFLO:
+	if (rd == 0)
+	    break;
+	Mem(0x8b, EAX, UserReg(instr->opCode == OP_MFHI ? HiReg : LoReg));
+	Mem(0x89, EAX, UserReg(rd));
+	break;
+
+      case OP_MTHI:
+      case OP_MTLO:
+	Mem(0x8b, EAX, UserReg(rs));
+	Mem(0x89, EAX, UserReg(instr->opCode == OP_MTHI ? HiReg : LoReg));
+	break;
+
+      case OP_MULT:
+      case OP_MULTU:
+	Mem(0x8b, EAX, UserReg(rs));
+	Mem(0xf7, instr->opCode == OP_MULT ? 5 : 4, UserReg(rt));
+						// edx:eax = eax * [rt]
+	Mem(0x89, EAX, UserReg(LoReg));
+	Mem(0x89, EDX, UserReg(HiReg));
+	break;
+
+      case OP_DIV:
+      case OP_DIVU:
+	Mem(0x8b, ECX, UserReg(rt));
+	RegReg(0x85, ECX, ECX);			// test ecx, ecx
+	skip = Forward(0x0f80 | CondNE);
+	RegReg(0x33, EAX, EAX);			// by zero: both are 0
+	RegReg(0x33, EDX, EDX);
+	done = Forward(0xe9);
+	Land(skip);
+	Mem(0x8b, EAX, UserReg(rs));
+	if (instr->opCode == OP_DIV) {
+	    Byte(0x99);				// cdq
+	    RegReg(0xf7, 7, ECX);		// idiv ecx
+	} else {
+	    RegReg(0x33, EDX, EDX);
+	    RegReg(0xf7, 6, ECX);		// div ecx
+	}
+	Land(done);
+	Mem(0x89, EAX, UserReg(LoReg));
+	Mem(0x89, EDX, UserReg(HiReg));
+	break;
+
+      case OP_BEQ:
+      case OP_BNE:
+      case OP_BGEZ:
+      case OP_BGEZAL:
+      case OP_BGTZ:
+      case OP_BLEZ:
+      case OP_BLTZ:
+      case OP_BLTZAL:
+	if (instr->opCode == OP_BGEZAL || instr->opCode == OP_BLTZAL)
+	    StoreImm(UserReg(R31), pc + 8);
+	StoreImm(UserReg(NextPCReg), pc + 8);	// unless taken
+	if (instr->opCode == OP_BEQ || instr->opCode == OP_BNE) {
+	    Mem(0x8b, EAX, UserReg(rs));
+	    Mem(0x3b, EAX, UserReg(rt));
+	} else {
+	    Mem(0x83, 7, UserReg(rs)); Byte(0);	// cmp dword [rs], 0
+	}
+	switch (instr->opCode) {		// skip if not taken
+	  case OP_BEQ: skip = Forward(0x0f80 | CondNE); break;
+	  case OP_BNE: skip = Forward(0x0f80 | CondE); break;
+	  case OP_BGEZ:
+	  case OP_BGEZAL: skip = Forward(0x0f80 | CondL); break;
+	  case OP_BGTZ: skip = Forward(0x0f80 | CondLE); break;
+	  case OP_BLEZ: skip = Forward(0x0f80 | CondG); break;
+	  default: skip = Forward(0x0f80 | CondGE); break;
+	}
+	StoreImm(UserReg(NextPCReg), pc + 4 + IndexToAddr(extra));
+	Land(skip);
+	break;
+
+      case OP_JAL:
+	StoreImm(UserReg(R31), pc + 8);
+      case OP_J:
+	StoreImm(UserReg(NextPCReg),
+		((pc + 8) & 0xf0000000) | IndexToAddr(extra));
+	break;
+
+      case OP_JALR:
+	if (rd != 0)
+	    StoreImm(UserReg(rd), pc + 8);
+	else if (rs == 0) {			// the link is the target
+	    StoreImm(UserReg(NextPCReg), pc + 8);
+	    break;
+	}
+      case OP_JR:
+	Mem(0x8b, EAX, UserReg(rs));
+	Mem(0x89, EAX, UserReg(NextPCReg));
+	break;
+
+      case OP_LB:
+      case OP_LBU:
+      case OP_LH:
+      case OP_LHU:
+      case OP_LW:
+      case OP_SB:
+      case OP_SH:
+      case OP_SW:
+	TranslateMemory(instr, index);
+	return;				// which finishes the instruction
+
+      default:
+	ASSERT(FALSE);
+    }
+    FinishInstruction(FALSE, 0);
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::TranslateMemory
+// 	Emit the host code for a load or store, which does what ReadMem
+//	or WriteMem would do through SoftTranslate.  If SoftTranslate
+//	would fail, or the store is into the page we are running, the
+//	block leaves, to let the interpreter do it.
+//
+//	"instr" is the instruction
+//	"index" is where it is in the block
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::TranslateMemory(Instruction *instr, int index)
+{
+    SoftTLBEntry *soft = processor->softTLB;
+    bool writing = FALSE;
+    int size = 4;
+    Machine *m;
+
+    switch (instr->opCode) {
+      case OP_SB: writing = TRUE;
+      case OP_LB: case OP_LBU: size = 1; break;
+      case OP_SH: writing = TRUE;
+      case OP_LH: case OP_LHU: size = 2; break;
+      case OP_SW: writing = TRUE; break;
+    }
+
+    Mem(0x8b, EAX, UserReg(instr->rs));		// the address
+    if (instr->extra != 0) {
+	RegReg(0x81, 0, EAX); Word(instr->extra);
+    }
+    if (size > 1) {				// unaligned?
+	Byte(0xa8); Byte(size - 1);		// test al, size - 1
+	ExitIf(CondNE, index);
+    }
+    RegReg(0x8b, ECX, EAX);			// mov ecx, eax
+    RegReg(0xc1, 5, ECX); Byte(pageShift);	// shr ecx, pageShift
+    RegReg(0x8b, EDX, ECX);
+    RegReg(0x81, 4, EDX); Word(SoftTLBSize - 1);
+    RegReg(0x69, EDX, EDX); Word(sizeof(SoftTLBEntry));
+    RegMem(0x3b, ECX, EDX, (int) &soft->virtualPage);	// in the cache?
+    ExitIf(CondNE, index);
+    RegMem(0x8b, ECX, EDX, (int) &soft->entry);	// ecx = the translation
+    if (writing) {
+	RegMem(0x80, 7, ECX, offsetof(TranslationEntry, readOnly));
+	Byte(0);				// cmp byte [ecx + readOnly], 0
+	ExitIf(CondNE, index);
+    }
+    RegMem(0x8b, EDX, EDX, (int) &soft->hostPage);	// edx = the page
+    if (writing) {
+	RegReg(0x81, 7, EDX); Word((int) blockHostPage);
+	ExitIf(CondE, index);
+    }
+    RegMem(0xc6, 0, ECX, offsetof(TranslationEntry, use)); Byte(1);
+    if (writing) {
+	RegMem(0xc6, 0, ECX, offsetof(TranslationEntry, dirty)); Byte(1);
+    }
+    RegReg(0x81, 4, EAX); Word(PageSize - 1);
+    RegReg(0x03, EDX, EAX);			// edx = the host address
+    if (processor->tlb != NULL) {		// the ticks of this block
+	Mem(0x8b, EAX, &totalTicks);		// haven't been charged yet
+	RegInd(0x8b, EAX, EAX);
+	if (index != 0) {
+	    RegReg(0x81, 0, EAX); Word(index * UserTick);
+	}
+	RegMem(0x89, EAX, ECX, offsetof(TranslationEntry, lastUseTime));
+	Mem(0x8b, EAX, &tlbHits);
+	RegInd(0x83, 0, EAX); Byte(1);		// add dword [eax], 1
+    }
+
+    if (!writing) {
+	switch (instr->opCode) {
+	  case OP_LB:  RegInd(0x0fbe, ECX, EDX); break;	// movsx ecx, byte
+	  case OP_LBU: RegInd(0x0fb6, ECX, EDX); break;	// movzx
+	  case OP_LH:  RegInd(0x0fbf, ECX, EDX); break;
+	  case OP_LHU: RegInd(0x0fb7, ECX, EDX); break;
+	  case OP_LW:  RegInd(0x8b, ECX, EDX); break;
+	}
+	FinishInstruction(TRUE, instr->rt);
+	return;
+    }
+
+    // Break any link to the word and, once it is stored, invalidate
+    // the page's decoded and translated instructions, as WriteMem does
+    RegReg(0x8b, EAX, EDX);
+    RegReg(0x81, 5, EAX); Word((int) processor->mainMemory);
+    RegReg(0x8b, ECX, EAX);			// ecx = the physical page
+    RegReg(0xc1, 5, ECX); Byte(pageShift);
+    RegReg(0x81, 4, EAX); Word(~0x3);
+    for (m = processor->firstProcessor; m != NULL; m = m->nextProcessor) {
+	Mem(0x39, EAX, &m->linkAddr);		// cmp [linkAddr], eax
+	Byte(0x75); Byte(10);			// jne past the next
+	StoreImm(&m->linkAddr, -1);
+    }
+    Mem(0x8b, EAX, UserReg(instr->rt));
+    switch (instr->opCode) {
+      case OP_SB: RegInd(0x88, EAX, EDX); break;
+      case OP_SH: Byte(0x66); RegInd(0x89, EAX, EDX); break;
+      case OP_SW: RegInd(0x89, EAX, EDX); break;
+    }
+    if (parallelCPUs)
+	Byte(0xf0);				// lock, cf. InvalidateDecodedPage
+    IndexMem(0x83, 0, ECX, processor->codeVersion); Byte(1);
+    FinishInstruction(FALSE, 0);
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::FinishInstruction
+// 	Emit the host code for the end of an instruction: do the load
+//	delayed by the one before it, and start its own (cf.
+//	Machine::DelayedLoad).  Within a block we know what load is
+//	pending, so we only emit what changes anything.
+//
+//	"loading" is TRUE if the instruction loaded a value, into ECX
+//	"loadReg" is the register it goes to
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::FinishInstruction(bool loading, int loadReg)
+{
+    if (pendingLoad == PendingUnknown) {
+	Mem(0x8b, EAX, UserReg(LoadReg));
+	Mem(0x8b, EDX, UserReg(LoadValueReg));
+	IndexMem(0x89, EDX, EAX, UserReg(0));	// registers[eax] = edx
+	StoreImm(UserReg(0), 0);
+    } else if (pendingLoad == PendingLoad && pendingReg != 0) {
+	Mem(0x8b, EAX, UserReg(LoadValueReg));
+	Mem(0x89, EAX, UserReg(pendingReg));
+    }
+
+    if (loading) {
+	StoreImm(UserReg(LoadReg), loadReg);
+	Mem(0x89, ECX, UserReg(LoadValueReg));
+	pendingLoad = PendingLoad;
+	pendingReg = loadReg;
+    } else {
+	if (pendingLoad != PendingNone) {
+	    StoreImm(UserReg(LoadReg), 0);
+	    StoreImm(UserReg(LoadValueReg), 0);
+	}
+	pendingLoad = PendingNone;
+    }
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::ChainTo
+// 	Emit the host code to go on to the block at "virtAddr", once the
+//	PC has been set to it.  Until that block has been translated, the
+//	code returns to Run, leaving where to patch in "patchSite".
+//
+//	A block on our page can be jumped to directly, since we only run
+//	while the page is unchanged, and mapped where it was.  For one on
+//	another page, we check first that the translation cache still
+//	maps the page to where it was when we linked, and that it hasn't
+//	been written since; the operands checked are filled in by Link.
+//
+//	"virtAddr" is the user address of the next block
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::ChainTo(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    SoftTLBEntry *soft = &processor->softTLB[vpn % SoftTLBSize];
+    unsigned char *site = emit, *fail[3];
+    int kind;
+
+    if (vpn == (unsigned) blockStart / PageSize) {
+	kind = ChainSamePage;
+	Jump(0xe9, emit + 5);			// jmp to the next instruction,
+						// until linked
+    } else {
+	kind = ChainOtherPage;
+	Mem(0x81, 7, &soft->virtualPage); Word(vpn);	// cmp [...], vpn
+	fail[0] = Forward(0x0f80 | CondNE);
+	Mem(0x81, 7, &soft->hostPage); Word(0);
+	ASSERT(emit - site == GuardHostPage + 4);
+	fail[1] = Forward(0x0f80 | CondNE);
+	Mem(0x81, 7, NULL); Word(0);		// cmp [version], version
+	ASSERT(emit - site == GuardVersion + 4);
+	fail[2] = Forward(0x0f80 | CondNE);
+	Mem(0x8b, EAX, &soft->entry);		// the page being run
+	Mem(0x89, EAX, &codeEntry);
+	RegMem(0xc6, 0, EAX, offsetof(TranslationEntry, use)); Byte(1);
+	ASSERT(emit - site == GuardJump);
+	Jump(0xe9, emit + 5);
+	for (int i = 0; i < 3; i++)
+	    Land(fail[i]);
+    }
+    StoreImm(&patchSite, (int) site);
+    StoreImm(&patchKind, kind);
+    MoveImm(EAX, TRUE);
+    Byte(0xc3);
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator::EmitExits
+// 	Emit the code for each place the block can leave early from,
+//	and point the jumps to it.  Leaving before an instruction,
+//	the instructions before it have been run, so we charge for them
+//	and set the PC as the interpreter would have it.  In the delay
+//	slot, NextPC has already been set by the branch.
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::EmitExits()
+{
+    unsigned char *exit = NULL;
+    int index, i;
+
+    for (i = 0; i < numExits; i++) {
+	index = exitIndex[i];
+	if (i == 0 || index != exitIndex[i - 1]) {
+	    exit = emit;
+	    if (index != 0) {
+		int pc = blockStart + 4 * index;
+
+		MoveImm(EAX, index);
+		Jump(0xe8, charge);
+		StoreImm(UserReg(PCReg), pc);
+		if (!(endsInBranch && index == blockLength - 1))
+		    StoreImm(UserReg(NextPCReg), pc + 4);
+		StoreImm(UserReg(PrevPCReg), pc - 4);
+	    }
+	    MoveImm(EAX, FALSE);
+	    Byte(0xc3);
+	}
+	*(int *) exitJump[i] = exit - (exitJump[i] + 4);
+    }
+}
+
+//----------------------------------------------------------------------
+// BinaryTranslator instruction encoding
+// 	Append host instructions to the code cache, with their operands:
+//
+//	Word -- a 32-bit immediate or displacement
+//	Op -- a one or two byte opcode
+//	Mem -- an absolute memory operand, "addr"
+//	RegMem -- a memory operand at "disp" from register "base"
+//	RegInd -- a memory operand at register "base"
+//	RegReg -- a register operand "rm"
+//	IndexMem -- a memory operand at "addr" plus 4 times "index"
+//	MoveImm -- mov reg, value
+//	StoreImm -- mov dword [addr], value
+//	Jump -- a call, jmp or jcc to "target"
+//	ExitIf -- leave the block before instruction "index" if "cond"
+//	Forward -- a jump whose target is set later, by Land
+//	Land -- make the jump at "jump" go to the next instruction
+//
+//	"reg" is a register operand, or for some opcodes, an extension
+//	of the opcode.
+//----------------------------------------------------------------------
+
+void
+BinaryTranslator::Word(int w)
+{
+    *(int *) emit = w;
+    emit += 4;
+}
+
+void
+BinaryTranslator::Op(int opcode)
+{
+    if (opcode > 0xff)
+	Byte(opcode >> 8);
+    Byte(opcode & 0xff);
+}
+
+void
+BinaryTranslator::Mem(int opcode, int reg, void *addr)
+{
+    Op(opcode);
+    Byte(ModRM(0, reg, 5));
+    Word((int) addr);
+}
+
+void
+BinaryTranslator::RegMem(int opcode, int reg, int base, int disp)
+{
+    Op(opcode);
+    Byte(ModRM(2, reg, base));
+    Word(disp);
+}
+
+void
+BinaryTranslator::RegInd(int opcode, int reg, int base)
+{
+    Op(opcode);
+    Byte(ModRM(0, reg, base));
+}
+
+void
+BinaryTranslator::RegReg(int opcode, int reg, int rm)
+{
+    Op(opcode);
+    Byte(ModRM(3, reg, rm));
+}
+
+void
+BinaryTranslator::IndexMem(int opcode, int reg, int index, void *addr)
+{
+    Op(opcode);
+    Byte(ModRM(0, reg, 4));
+    Byte(ModRM(2, index, 5));		// scale 4, no base
+    Word((int) addr);
+}
+
+void
+BinaryTranslator::MoveImm(int reg, int value)
+{
+    Byte(0xb8 + reg);
+    Word(value);
+}
+
+void
+BinaryTranslator::StoreImm(void *addr, int value)
+{
+    Mem(0xc7, 0, addr);
+    Word(value);
+}
+
+void
+BinaryTranslator::Jump(int opcode, unsigned char *target)
+{
+    Op(opcode);
+    Word(target - (emit + 4));
+}
+
+void
+BinaryTranslator::ExitIf(int cond, int index)
+{
+    ASSERT(numExits < MaxExits);
+    exitJump[numExits] = Forward(0x0f80 | cond);
+    exitIndex[numExits++] = index;
+}
+
+unsigned char *
+BinaryTranslator::Forward(int opcode)
+{
+    Op(opcode);
+    Word(0);
+    return emit - 4;
+}
+
+void
+BinaryTranslator::Land(unsigned char *jump)
+{
+    *(int *) jump = emit - (jump + 4);
+}
@@ -0,0 +1,159 @@
+// bintrans.h
+//	Data structures for the binary translator: the part of the MIPS
+//	simulator that turns basic blocks of user instructions into i386
+//	host code, and runs that instead of interpreting them (-bt).
+//
+//	A block starts at any instruction, and runs to the end of its
+//	physical page, or up to an instruction we don't translate (a
+//	system call, LL and SC, the unaligned loads and stores, reserved
+//	instructions), or through the delay slot of the first branch or
+//	jump.  Its host code keeps the MIPS registers in
+//	Machine::registers, and does exactly what ExecuteInstruction
+//	would, delayed loads included.
+//
+//	The code never calls into the simulator.  Whatever it can't do
+//	inline -- an instruction that would raise an exception (overflow,
+//	an unaligned address, a page not in the translation cache), or a
+//	store into the page being run -- it leaves to the interpreter: it
+//	stops just before that instruction, with the registers as the
+//	interpreter would have them, and RunTranslated interprets the
+//	one instruction, taking whatever trap it raises.
+//
+//	Simulated time is charged a block at a time.  On entry, a block
+//	checks that all of its instructions can run before the interrupt
+//	horizon (cf. Interrupt::OneUserTick); if not, the interpreter runs
+//	the next instruction, with its tick, and takes the interrupt.  So
+//	the sequence of instructions, ticks, interrupts and context
+//	switches is exactly the same as with the interpreter.  The TLB's
+//	use bits, last use times and hit count are also kept exact.
+//
+//	When a block ends, it jumps straight to the next block, once
+//	that has been translated ("chaining"): directly if it is on the
+//	same page; if it is on another page, after checking that the
+//	page is in the translation cache, still at the same place in
+//	memory, and unchanged.  Jumps through a register (JR, JALR) go
+//	back to RunTranslated, which looks the next block up.
+//
+//	Translated code is only good for the contents of its page that it
+//	was translated from: writing to a page changes the page's version
+//	(Machine::codeVersion), and code for old versions is no longer
+//	entered.  When the code cache fills up, everything is thrown
+//	away and translated again as it is needed.
+//
+//	Each processor has its own translator, since the code is
+//	specialized to its registers and translation cache.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BINTRANS_H
+#define BINTRANS_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "machine.h"
+
+#define CodeCacheSize	(512 * 1024)	// bytes of host code kept at once
+#define MaxBlocks	4096		// blocks kept at once
+#define MaxExits	(4 * NumPageInstrs + 1)	// places one block can
+					// leave early from: up to 4 for
+					// each store, and its entry
+
+// The following class defines a block of user instructions that has
+// been translated into host code.
+
+class TranslatedBlock {
+  public:
+    int virtAddr;		// the user address it was translated at
+    unsigned int version;	// the version of its page it was
+				// translated from (cf. Machine::codeVersion)
+    unsigned char *code;	// where its host code starts
+};
+
+// The following class defines the translator of one processor, and
+// its code cache.
+
+class BinaryTranslator {
+  public:
+    BinaryTranslator(Machine *m, char *area, int size);
+				// Initialize a translator for "m", with
+				// "size" bytes of executable memory, from
+				// AllocCodeArray, for the code cache
+
+    bool Run();			// Run host code from the user PC on, for
+				// as many blocks as it can; FALSE if the
+				// instruction at the PC must be interpreted
+
+  private:
+    Machine *processor;		// whose registers and memory we use
+    unsigned char *code;	// the code cache
+    int codeSize;		// how big it is
+    unsigned char *emit;	// where the next host code goes
+    unsigned char *charge;	// host code to charge for instructions
+				// run, shared by every block
+    int pageShift;		// log2(PageSize)
+    TranslatedBlock blocks[MaxBlocks];	// the blocks in the code cache
+    int numBlocks;		// how many of them are in use
+    TranslatedBlock *blockAt[MemorySize / 4];	// the block starting
+				// at each word of memory, or NULL
+
+// Read or written by the host code; set by Run for the CPU we run on
+    int *totalTicks;		// its stats->totalTicks
+    int *userTicks;		// its stats->userTicks
+    int *tlbHits;		// its stats->numTLBHits
+    volatile int *horizon;	// its interrupt horizon
+    TranslationEntry *codeEntry;	// the translation of the page
+				// being run
+    unsigned char *patchSite;	// where the last block jumped back to
+				// Run from, for want of the next block
+    int patchKind;		// how the jump there must be patched
+
+    TranslatedBlock *TranslateBlock(int virtAddr, int physAddr);
+				// Translate the instructions at "physAddr"
+				// (and "virtAddr"), or return NULL if the
+				// first one can't be
+    void Flush();		// Throw away every translation
+    void Link(TranslatedBlock *block, SoftTLBEntry *soft);
+				// Chain the jump at "patchSite" to "block"
+
+// Parts of TranslateBlock
+    void TranslateInstruction(Instruction *instr, int index);
+    void TranslateMemory(Instruction *instr, int index);
+    void FinishInstruction(bool loading, int loadReg);
+    void ChainTo(int virtAddr);
+    void EmitExits();
+
+// Instruction encoding
+    void Byte(int b) { *emit++ = (unsigned char) b; }
+    void Word(int w);
+    void Op(int opcode);
+    void Mem(int opcode, int reg, void *addr);
+    void RegMem(int opcode, int reg, int base, int disp);
+    void RegInd(int opcode, int reg, int base);
+    void RegReg(int opcode, int reg, int rm);
+    void IndexMem(int opcode, int reg, int index, void *addr);
+    void MoveImm(int reg, int value);
+    void StoreImm(void *addr, int value);
+    void Jump(int opcode, unsigned char *target);
+    void ExitIf(int cond, int index);
+    unsigned char *Forward(int opcode);
+    void Land(unsigned char *jump);
+
+// The state of the block being translated
+    int blockStart;		// the user address of its first instruction
+    int blockLength;		// how many instructions it has
+    char *blockHostPage;	// where its page is in mainMemory
+    bool endsInBranch;		// TRUE if it ends with a delay slot
+    int pendingLoad;		// what the last instruction left in
+				// LoadReg: PendingUnknown, PendingNone or
+				// PendingLoad (see bintrans.cc)
+    int pendingReg;		// and to which register, if PendingLoad
+    unsigned char *exitJump[MaxExits];	// where the block leaves
+    int exitIndex[MaxExits];	// early from, and before which
+    int numExits;		// instruction
+};
+
+#endif // BINTRANS_H
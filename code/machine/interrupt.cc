@@ -28,7 +28,13 @@
 
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
-			"console read", "network send", "network recv"};
+			"console read", "network send", "network recv",
+			"cpu switch"};
+
+// Interrupts that happen periodically, whether or not any device is busy
+#define IsPeriodic(type)	((type) == TimerInt || (type) == CPUSwitchInt)
+
+SlabCache PendingInterrupt::cache("PendingInterrupt", sizeof(PendingInterrupt));
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -50,6 +56,169 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     type = kind;
 }
 
+//----------------------------------------------------------------------
+// PendingQueue::PendingQueue
+// 	Initialize an empty queue of pending interrupts.  The heap array
+//	grows as needed.
+//----------------------------------------------------------------------
+
+PendingQueue::PendingQueue()
+{
+    capacity = 16;
+    heap = new PendingInterrupt*[capacity];
+    size = 0;
+    nextSeq = 0;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::~PendingQueue
+// 	De-allocate the queue, and any interrupts that never happened.
+//----------------------------------------------------------------------
+
+PendingQueue::~PendingQueue()
+{
+    for (int i = 0; i < size; i++)
+	delete heap[i];
+    delete [] heap;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Insert
+// 	Add an interrupt to the queue.  Among interrupts that are due at
+//	the same time, it goes after the ones already queued.
+//
+//	"toOccur" -- the interrupt
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Insert(PendingInterrupt *toOccur)
+{
+    if (size == capacity) {		// out of room, double the array
+	PendingInterrupt **bigger = new PendingInterrupt*[2 * capacity];
+
+	for (int i = 0; i < size; i++)
+	    bigger[i] = heap[i];
+	delete [] heap;
+	heap = bigger;
+	capacity *= 2;
+    }
+    toOccur->seq = nextSeq++;
+    heap[size] = toOccur;
+    SiftUp(size++);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::RemoveFirst
+// 	Take the interrupt that is due first off the queue.
+//
+// Returns:
+//	The interrupt, or NULL if the queue is empty.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::RemoveFirst()
+{
+    PendingInterrupt *first;
+
+    if (size == 0)
+	return NULL;
+    first = heap[0];
+    heap[0] = heap[--size];
+    if (size > 0)
+	SiftDown(0);
+    return first;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Remove
+// 	Take a particular interrupt off the queue, before it is due.
+//	Finding it takes O(n) time, but there are never many.
+//
+// Returns:
+//	The interrupt, or NULL if there is none with that handler and
+//	argument.
+//
+//	"func", "arg" -- the handler and argument it was scheduled with
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+PendingQueue::Remove(VoidFunctionPtr func, int arg)
+{
+    PendingInterrupt *found;
+
+    for (int i = 0; i < size; i++)
+	if (heap[i]->handler == func && heap[i]->arg == arg) {
+	    found = heap[i];
+	    heap[i] = heap[--size];
+	    if (i < size) {		// the last one takes its place
+		SiftUp(i);
+		SiftDown(i);
+	    }
+	    return found;
+	}
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::Mapcar
+// 	Apply a function to every interrupt on the queue, e.g. to print
+//	them.  They are visited in heap order, not the order in which
+//	they will occur.
+//
+//	"func" -- the function; its argument is the PendingInterrupt
+//----------------------------------------------------------------------
+
+void
+PendingQueue::Mapcar(VoidFunctionPtr func)
+{
+    for (int i = 0; i < size; i++)
+	(*func)((int) heap[i]);
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::SiftUp
+// 	Move heap[i] towards the root until its parent is due before it.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::SiftUp(int i)
+{
+    PendingInterrupt *item = heap[i];
+    int parent;
+
+    while (i > 0) {
+	parent = (i - 1) / 2;
+	if (!Before(item, heap[parent]))
+	    break;
+	heap[i] = heap[parent];
+	i = parent;
+    }
+    heap[i] = item;
+}
+
+//----------------------------------------------------------------------
+// PendingQueue::SiftDown
+// 	Move heap[i] away from the root until both its children are due
+//	after it.
+//----------------------------------------------------------------------
+
+void
+PendingQueue::SiftDown(int i)
+{
+    PendingInterrupt *item = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < size) {
+	if (child + 1 < size && Before(heap[child + 1], heap[child]))
+	    child++;			// the earlier of the two children
+	if (!Before(heap[child], item))
+	    break;
+	heap[i] = heap[child];
+	i = child;
+    }
+    heap[i] = item;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Interrupt
 // 	Initialize the simulation of hardware device interrupts.
@@ -60,10 +229,15 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    pending = new PendingQueue();
     inHandler = FALSE;
     yieldOnReturn = FALSE;
+    switchOnReturn = FALSE;
+    numDevicePending = 0;
+    timerWanted = FALSE;
     status = SystemMode;
+    horizon = NoInterruptPending;
+    traceTicks = DebugIsEnabled('i');
 }
 
 //----------------------------------------------------------------------
@@ -73,8 +247,6 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
     delete pending;
 }
 
@@ -146,11 +318,16 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+// Returns:
+//	TRUE if any interrupt handler was invoked (and so the current
+//	thread may have been switched out and back in again)
 //----------------------------------------------------------------------
-void
+bool
 Interrupt::OneTick()
 {
     MachineStatus old = status;
+    bool fired = FALSE;
 
 // advance simulated time
     if (status == SystemMode) {
@@ -167,7 +344,8 @@ Interrupt::OneTick()
 					// (interrupt handlers run with
 					// interrupts disabled)
     while (CheckIfDue(FALSE))		// check for pending interrupts
-	;
+	fired = TRUE;
+    UpdateHorizon();
     ChangeLevel(IntOff, IntOn);		// re-enable interrupts
     if (yieldOnReturn) {		// if the timer device handler asked 
 					// for a context switch, ok to do it now
@@ -176,6 +354,63 @@ Interrupt::OneTick()
 	currentThread->Yield();
 	status = old;
     }
+    if (switchOnReturn) {		// likewise, if it is another CPU's
+	switchOnReturn = FALSE;		// turn to run
+	status = SystemMode;
+	SwitchToNextCPU();
+	status = old;
+    }
+    return fired;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::OneUserTick
+// 	Advance simulated time after a user instruction has executed.
+//	Equivalent to OneTick, but cheap in the common case.
+//
+//	Rather than scanning the pending interrupts after every
+//	instruction, we remember a horizon before which none of them
+//	can be due.  Until simulated time reaches it, all OneTick would 
+//	do is add UserTick to the clock, so we do just that.  
+//
+//	The horizon only has to be no later than the first pending 
+//	interrupt: Schedule moves it earlier when needed, and OneTick 
+//	recomputes it after interrupts have been taken off the list.
+//	Other CPUs may also Poke it, to stop us.
+//
+//	OneTick is kernel code, so with host threads (see cpu.h), it
+//	needs the kernel lock.
+//
+// Returns:
+//	TRUE if any interrupt handler was invoked (cf. OneTick)
+//----------------------------------------------------------------------
+
+bool
+Interrupt::OneUserTick()
+{
+    bool fired;
+
+    if (stats->totalTicks + UserTick < horizon && !traceTicks) {
+	stats->totalTicks += UserTick;
+	stats->userTicks += UserTick;
+	return FALSE;
+    }
+    EnterKernel();
+    fired = OneTick();
+    LeaveKernel();
+    return fired;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UpdateHorizon
+// 	Recompute the time before which no pending interrupt is due,
+//	from the first interrupt on the pending queue.
+//----------------------------------------------------------------------
+
+void
+Interrupt::UpdateHorizon()
+{
+    horizon = NextDue();
 }
 
 //----------------------------------------------------------------------
@@ -196,6 +431,19 @@ Interrupt::YieldOnReturn()
     yieldOnReturn = TRUE; 
 }
 
+//----------------------------------------------------------------------
+// Interrupt::SwitchOnReturn
+// 	Called from within the multiprocessor's CPU switch interrupt
+//	handler, to let another CPU run once the handler returns.  As with
+//	YieldOnReturn, we can't switch CPUs inside the handler.
+//----------------------------------------------------------------------
+void
+Interrupt::SwitchOnReturn()
+{ 
+    ASSERT(inHandler == TRUE);  
+    switchOnReturn = TRUE; 
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Idle
 // 	Routine called when there is nothing in the ready queue.
@@ -233,6 +481,54 @@ Interrupt::Idle()
     Halt();
 }
 
+//----------------------------------------------------------------------
+// Interrupt::IdleUntil
+// 	On a multiprocessor, an idle CPU can't simply roll time forward
+//	to its next interrupt, since the other CPUs may make work for it
+//	in the meantime.  Instead, it idles until the time the other CPUs
+//	have reached, or until its next interrupt, whichever is earlier.
+//
+//	Like Idle, this is called with interrupts disabled.
+//
+// Returns:
+//	TRUE if any interrupt handler was run.
+//
+//	"when" is the time to idle until
+//----------------------------------------------------------------------
+bool
+Interrupt::IdleUntil(int when)
+{
+    bool fired = FALSE;
+
+    status = IdleMode;
+    if (NextDue() <= when && CheckIfDue(TRUE)) {
+	fired = TRUE;
+	while (CheckIfDue(FALSE))	// anything else due at the same time
+	    ;
+    } else if (when > stats->totalTicks) {
+	stats->idleTicks += when - stats->totalTicks;
+	stats->totalTicks = when;
+    }
+    UpdateHorizon();
+    yieldOnReturn = FALSE;		// as in Idle, we will look at the
+    switchOnReturn = FALSE;		// ready list anyway
+    status = SystemMode;
+    return fired;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextDue
+// 	Return when the next pending interrupt is due to occur, or
+//	NoInterruptPending if there are none.
+//----------------------------------------------------------------------
+int
+Interrupt::NextDue()
+{
+    PendingInterrupt *first = pending->First();
+
+    return (first == NULL) ? NoInterruptPending : first->when;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
@@ -241,7 +537,16 @@ void
 Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
+    if (currentCPU != NULL)
+	PrintCPUStatistics();
     stats->Print();
+    SlabCache::PrintAll();
+    if (Thread::psFormat != PsNone)
+	Thread::PrintAccounts();
+#ifdef USE_TLB
+    if (tlbPolicy != NULL)
+	tlbPolicy->Print();
+#endif
     Cleanup();     // Never returns.
 }
 
@@ -250,7 +555,7 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it on the pending queue (a heap).
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -271,7 +576,40 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    pending->Insert(toOccur);
+    if (!IsPeriodic(type))
+	numDevicePending++;
+    if (when < horizon)
+	horizon = when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Cancel
+// 	Unschedule an interrupt that has not occurred yet, e.g. to
+//	reprogram a timer.  Like Schedule, only called by the hardware
+//	device simulators.
+//
+//	The horizon may now be earlier than it need be, which is safe.
+//
+// Returns:
+//	TRUE if the interrupt was still pending.
+//
+//	"handler", "arg" -- as passed to Schedule
+//----------------------------------------------------------------------
+
+bool
+Interrupt::Cancel(VoidFunctionPtr handler, int arg)
+{
+    PendingInterrupt *toCancel = pending->Remove(handler, arg);
+
+    if (toCancel == NULL)
+	return FALSE;
+    DEBUG('i', "Cancelling interrupt handler the %s at time = %d\n", 
+				intTypeNames[toCancel->type], toCancel->when);
+    if (!IsPeriodic(toCancel->type))
+	numDevicePending--;
+    delete toCancel;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -297,26 +635,28 @@ Interrupt::CheckIfDue(bool advanceClock)
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
+    PendingInterrupt *toOccur = pending->First();
 
     if (toOccur == NULL)		// no pending interrupts
 	return FALSE;			
 
+    when = toOccur->when;
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks) {	// not time yet, leave it
 	return FALSE;
     }
 
-// Check if there is nothing more to do, and if so, quit
+// Check if there is nothing more to do, and if so, quit (a tickless 
+// kernel only arms the timer when it has something to do)
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+			&& pending->NumPending() == 1 && !timerWanted) {
 	 return FALSE;
     }
+    (void) pending->RemoveFirst();
+    if (!IsPeriodic(toOccur->type))
+	numDevicePending--;
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -361,7 +701,7 @@ Interrupt::DumpState()
 {
     printf("Time: %d, interrupts %s\n", stats->totalTicks, 
 					intLevelNames[level]);
-    printf("Pending interrupts:\n");
+    printf("Pending interrupts (in no particular order):\n");
     fflush(stdout);
     pending->Mapcar(PrintPending);
     printf("End of pending interrupts\n");
@@ -37,6 +37,7 @@
 
 #include "copyright.h"
 #include "list.h"
+#include "slab.h"
 
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus { IntOff, IntOn };
@@ -48,9 +49,13 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
-// display and keyboard, and a network.
+// display and keyboard, and a network.  On a multiprocessor, each
+// CPU also gets a periodic interrupt to let the other CPUs run.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				NetworkSendInt, NetworkRecvInt};
+				NetworkSendInt, NetworkRecvInt, CPUSwitchInt};
+
+// The time of the next interrupt, when there are none pending
+#define NoInterruptPending	0x7fffffff
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -62,11 +67,57 @@ class PendingInterrupt {
 				// initialize an interrupt that will
 				// occur in the future
 
+    void *operator new(size_t size) { return cache.Allocate(size); }
+    void operator delete(void *p) { cache.Free(p); }
+				// one is allocated for every event
+
     VoidFunctionPtr handler;    // The function (in the hardware device
 				// emulator) to call when the interrupt occurs
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    int seq;			// Order of scheduling, so that interrupts
+				// due at the same time fire in that order
+
+  private:
+    static SlabCache cache;	// free pending interrupts
+};
+
+// The following class defines the queue of interrupts scheduled to 
+// occur in the future: a binary min-heap, ordered by "when" and then
+// by "seq".  Insert and RemoveFirst take O(log n) time; looking at the 
+// first interrupt takes O(1).
+
+class PendingQueue {
+  public:
+    PendingQueue();			// initialize an empty queue
+    ~PendingQueue();			// de-allocate the queue, and any
+					// interrupts still on it
+
+    void Insert(PendingInterrupt *toOccur);	// Put an interrupt on 
+					// the queue
+    PendingInterrupt *First()		// The interrupt that is due first,
+	{ return (size > 0) ? heap[0] : NULL; }	// or NULL
+    PendingInterrupt *RemoveFirst();	// Take it off the queue
+    PendingInterrupt *Remove(VoidFunctionPtr func, int arg);	// Take
+					// an interrupt off the queue, 
+					// NULL if there is none
+    int NumPending() { return size; }	// How many interrupts are queued
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every interrupt
+					// (in no particular order)
+
+  private:
+    PendingInterrupt **heap;		// heap[i] is due no later than
+					// heap[2i+1] and heap[2i+2]
+    int size;				// number of interrupts in the heap
+    int capacity;			// size of the "heap" array
+    int nextSeq;			// "seq" of the next interrupt queued
+
+    bool Before(PendingInterrupt *a, PendingInterrupt *b)
+	{ return (a->when < b->when) || 
+		 (a->when == b->when && a->seq < b->seq); }
+    void SiftUp(int i);			// restore the heap order after
+    void SiftDown(int i);		// heap[i] was changed
 };
 
 // The following class defines the data structures for the simulation
@@ -94,6 +145,26 @@ class Interrupt {
     
     void YieldOnReturn();		// cause a context switch on return 
 					// from an interrupt handler
+    void SwitchOnReturn();		// let another CPU run on return 
+					// from an interrupt handler
+
+    bool IdleUntil(int when);		// Roll simulated time forward to 
+					// "when", or until an interrupt 
+					// occurs; TRUE if one did
+    int NextDue();			// When the next interrupt is due
+    bool DevicePending() 		// Will any device (not just the
+	{ return numDevicePending > 0 || timerWanted; }	// timer) 
+					// interrupt, or does the kernel 
+					// need the timer?
+    void WantTimer(bool wanted) { timerWanted = wanted; }	// The
+					// kernel has timers of its own
+					// pending (cf. callout.h), so an
+					// idle CPU must keep taking timer
+					// interrupts
+    void Poke() { horizon = 0; }	// Make the user program running on
+					// this CPU call OneTick after its
+					// next instruction (called by other
+					// CPUs, cf. StopOtherCPUs)
 
     MachineStatus getStatus() { return status; } // idle, kernel, user
     void setStatus(MachineStatus st) { status = st; }
@@ -109,22 +180,44 @@ class Interrupt {
     void Schedule(VoidFunctionPtr handler,// Schedule an interrupt to occur
 	int arg, int when, IntType type);// at time ``when''.  This is called
     					// by the hardware device simulators.
+    bool Cancel(VoidFunctionPtr handler, int arg);	// Unschedule it,
+					// if it hasn't happened yet
     
-    void OneTick();       		// Advance simulated time
+    bool OneTick();       		// Advance simulated time; TRUE if
+					// any interrupt handler was run
+    bool OneUserTick();			// OneTick, after a user instruction
+    volatile int *UserHorizon()		// Where the horizon is kept, for
+	{ return traceTicks ? NULL : &horizon; }	// translated code,
+					// which checks it once per block
+					// of user instructions rather than
+					// calling OneUserTick (cf. 
+					// bintrans.h); NULL if every tick
+					// must go through OneTick
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingQueue *pending;	// the interrupts scheduled to occur
+				// in the future
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
+    bool switchOnReturn;	// TRUE if we are to switch CPUs on 
+				// return from the interrupt handler
+    int numDevicePending;	// pending interrupts other than the 
+				// timer and CPU switches
+    bool timerWanted;		// TRUE if timer interrupts are needed
+				// even when idle
     MachineStatus status;	// idle, kernel mode, user mode
+    volatile int horizon;	// no pending interrupt is due before
+				// this time (cf. OneUserTick)
+    bool traceTicks;		// debugging interrupts, so every tick
+				// must go through OneTick
 
     // these functions are internal to the interrupt simulation code
 
     bool CheckIfDue(bool advanceClock); // Check if an interrupt is supposed
 					// to occur now
+    void UpdateHorizon();		// Recompute "horizon"
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
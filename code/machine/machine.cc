@@ -9,6 +9,7 @@
 
 #include "copyright.h"
 #include "machine.h"
+#include "bintrans.h"
 #include "system.h"
 
 // Textual names of the exceptions that can be generated by user program
@@ -50,29 +51,56 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"runEngine" -- the engine Run uses to execute user instructions
+//	"tlbEntries" -- the number of entries in the TLB (if there is one)
+//	"tlbAssoc" -- the number of entries in each set of the TLB
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, RunEngine runEngine, int tlbEntries, int tlbAssoc)
 {
     int i;
 
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
+    userThread = NULL;
+    linkAddr = -1;
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
           mainMemory[i] = 0;
     memUseage = new BitMap(NumPhysPages);
+    dispatchTable = NULL;
+    decodeCache = new Instruction[NumPhysPages * NumPageInstrs];
+    decodedVersion = new unsigned int[NumPhysPages];
+    codeVersion = new unsigned int[NumPhysPages];
+    decoding = new int[NumPhysPages];
+    for (i = 0; i < NumPhysPages; i++) {
+	decodedVersion[i] = (unsigned) -1;	// not decoded yet
+	codeVersion[i] = 0;
+	decoding[i] = 0;
+    }
+    translator = NULL;
+    softTLB = new SoftTLBEntry[SoftTLBSize];
+    softTLBEnabled = !DebugIsEnabled('a');	// keep the 'a' trace complete
+    FlushSoftTLB();
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    nextVictim = 0;
+    ASSERT(tlbEntries > 0 && tlbAssoc > 0 && tlbEntries % tlbAssoc == 0);
+    tlbSize = tlbEntries;
+    tlbWays = tlbAssoc;
+    tlbSets = tlbSize / tlbWays;
+    tlb = new TranslationEntry[tlbSize];
     totalMiss = 0;
-    for (i = 0; i < TLBSize; i++)
+    for (i = 0; i < tlbSize; i++)
 	tlb[i].valid = FALSE;
     pageTable = NULL;
 #else	// use linear page table
     tlb = NULL;
+    tlbSize = tlbWays = tlbSets = 0;
     pageTable = NULL;
 #endif
+    pageTableSize = 0;
+    asidUseage = new BitMap(NumASIDs);
+    asidPageTable = new TranslationEntry*[NumASIDs];
+    currentASID = 0;
 
 #ifdef USE_INVERTED_TABLE
     hashTable = new TranslationEntry*[NumPhysPages];
@@ -88,9 +116,73 @@ Machine::Machine(bool debug)
     swapAreaSize = 0;
 #endif
     singleStep = debug;
+    engine = runEngine;
+    firstProcessor = this;
+    nextProcessor = NULL;
     CheckEndian();
 }
 
+//----------------------------------------------------------------------
+// Machine::Machine
+// 	Initialize another processor of a multiprocessor.  It shares
+//	main memory, and everything that describes it (physical page
+//	usage, page tables, ASIDs and decoded instructions), with the
+//	first processor.  It gets its own registers, TLB and translation 
+//	cache, and otherwise runs the same way.
+//
+//	"first" -- the processor made by the constructor above
+//----------------------------------------------------------------------
+
+Machine::Machine(Machine *first)
+{
+    Machine *last;
+    int i;
+
+    for (i = 0; i < NumTotalRegs; i++)
+        registers[i] = 0;
+    userThread = NULL;
+    linkAddr = -1;
+    mainMemory = first->mainMemory;
+    memUseage = first->memUseage;
+    dispatchTable = NULL;
+    decodeCache = first->decodeCache;
+    decodedVersion = first->decodedVersion;
+    codeVersion = first->codeVersion;
+    decoding = first->decoding;
+    translator = NULL;
+    softTLB = new SoftTLBEntry[SoftTLBSize];
+    softTLBEnabled = first->softTLBEnabled;
+    FlushSoftTLB();
+    tlbSize = first->tlbSize;
+    tlbWays = first->tlbWays;
+    tlbSets = first->tlbSets;
+    if (first->tlb != NULL) {
+	tlb = new TranslationEntry[tlbSize];
+	for (i = 0; i < tlbSize; i++)
+	    tlb[i].valid = FALSE;
+    } else
+	tlb = NULL;
+    totalMiss = 0;
+    pageTable = NULL;
+    pageTableSize = 0;
+    asidUseage = first->asidUseage;
+    asidPageTable = first->asidPageTable;
+    currentASID = 0;
+#ifdef USE_INVERTED_TABLE
+    hashTable = first->hashTable;
+    invertedPageTable = first->invertedPageTable;
+#endif
+    singleStep = first->singleStep;
+    engine = first->engine;
+
+    firstProcessor = first;
+    nextProcessor = NULL;
+    for (last = first; last->nextProcessor != NULL; 
+				last = last->nextProcessor)
+	;
+    last->nextProcessor = this;
+}
+
 //----------------------------------------------------------------------
 // Machine::~Machine
 // 	De-allocate the data structures used to simulate user program execution.
@@ -98,10 +190,21 @@ Machine::Machine(bool debug)
 
 Machine::~Machine()
 {
-    delete [] mainMemory;
-    delete memUseage;
+    delete [] softTLB;
     if (tlb != NULL)
         delete [] tlb;
+    if (translator != NULL)
+	delete translator;
+    if (firstProcessor != this)		// the rest is shared
+	return;
+    delete [] mainMemory;
+    delete memUseage;
+    delete [] decodeCache;
+    delete asidUseage;
+    delete [] asidPageTable;
+    delete [] decodedVersion;
+    delete [] codeVersion;
+    delete [] decoding;
 #ifdef USE_INVERTED_TABLE
     delete invertedPageTable;
     delete hashTable;
@@ -131,9 +234,12 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
 //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
+    ClearLink();			// as the return from a trap does
+    EnterKernel();			// on a multiprocessor, cf. cpu.h
     interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
     interrupt->setStatus(UserMode);
+    LeaveKernel();
 }
 
 //----------------------------------------------------------------------
@@ -238,8 +344,114 @@ void Machine::WriteRegister(int num, int value)
 	registers[num] = value;
     }
 
-    
+
+//----------------------------------------------------------------------
+// Machine::AllocateASID
+// 	Assign an address space identifier to a new address space, so
+//	that its TLB entries can stay in the TLB while other address
+//	spaces run.
+//
+// Returns:
+//	The identifier; stored in the "asid" field of its TLB entries.
+//
+//	"table" -- the page table of the address space, so that TLB
+//		entries can be written back to it while it isn't running
+//----------------------------------------------------------------------
+
+int
+Machine::AllocateASID(TranslationEntry *table)
+{
+    int asid = asidUseage->Find();
+
+    ASSERT(asid != -1);			// too many address spaces
+    asidPageTable[asid] = table;
+    return asid;
+}
+
+//----------------------------------------------------------------------
+// Machine::FreeASID
+// 	An address space is being deleted.  Its TLB entries must not 
+//	be used (or written back) again, and its identifier can be
+//	reused.
+//----------------------------------------------------------------------
+
+void
+Machine::FreeASID(int asid)
+{
+    InvalidateTLB(asid);
+    asidPageTable[asid] = NULL;
+    asidUseage->Clear(asid);
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTLB
+// 	Remove every TLB entry tagged with "asid", without writing it
+//	back.  Used when the address space (or thread) goes away.  
+//	On a multiprocessor, any CPU's TLB may hold such entries.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateTLB(int asid)
+{
+    if (tlb == NULL)
+	return;
+    StopOtherCPUs();
+    for (Machine *m = firstProcessor; m != NULL; m = m->nextProcessor) {
+	for (int i = 0; i < m->tlbSize; i++)
+	    if (m->tlb[i].valid && m->tlb[i].asid == asid)
+		m->tlb[i].valid = FALSE;
+	m->FlushSoftTLB();
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidatePhysPage
+// 	A physical page is about to hold a different virtual page.
+//	Write back (it may be dirty) and drop the TLB entry that maps
+//	it, on every processor.  TLB entries are tagged, so it may 
+//	belong to any thread.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidatePhysPage(int physPage)
+{
+    if (tlb == NULL)
+	return;
+    StopOtherCPUs();
+    for (Machine *m = firstProcessor; m != NULL; m = m->nextProcessor)
+	for (int i = 0; i < m->tlbSize; i++)
+	    if (m->tlb[i].valid && m->tlb[i].physicalPage == physPage) {
+		m->WriteBackTLBEntry(&m->tlb[i]);
+		m->tlb[i].valid = FALSE;
+		m->FlushSoftTLB();
+		break;
+	    }
+}
+
+//----------------------------------------------------------------------
+// Machine::WriteBackTLBEntry
+// 	Copy a TLB entry that is about to be replaced back to the page 
+//	table it came from, so that its use and dirty bits aren't lost.  
+//	The entry need not belong to the running address space.
+//----------------------------------------------------------------------
+
+void
+Machine::WriteBackTLBEntry(TranslationEntry *entry)
+{
+#ifdef USE_INVERTED_TABLE
+    TranslationEntry *next = invertedPageTable[entry->physicalPage].next;
+    invertedPageTable[entry->physicalPage] = *entry;
+    invertedPageTable[entry->physicalPage].next = next;
+#else
+    ASSERT(asidPageTable[entry->asid] != NULL);
+    asidPageTable[entry->asid][entry->virtualPage] = *entry;
+#endif
+}
+
 #ifdef USE_INVERTED_TABLE    
+SwapAreaEntry *Machine::swapArea = NULL;	// shared by every processor
+int Machine::swapAreaSize = 0;
+
 void Machine::RecycleMemory(int threadID) {
     // Clear swap area
     SwapAreaEntry *temp = swapArea;
@@ -262,6 +474,7 @@ void Machine::RecycleMemory(int threadID) {
             temp = temp->next;
     }
     // CLear main memory
+    FlushSoftTLB();
     for(int i = 0; i < NumPhysPages; i++) {
         if(invertedPageTable[i].threadID == threadID) {
             invertedPageTable[i].valid = FALSE;
@@ -27,6 +27,9 @@
 #include "disk.h"
 #include "bitmap.h"
 
+class Thread;
+class BinaryTranslator;
+
 // Definitions related to the size, and format of user memory
 
 #define PageSize 	SectorSize 	// set the page size equal to
@@ -35,7 +38,13 @@
 
 #define NumPhysPages    32
 #define MemorySize 	(NumPhysPages * PageSize)
-#define TLBSize		4		// if there is a TLB, make it small
+#define DefaultTLBSize	4		// if there is a TLB, make it small
+#define DefaultTLBWays	4		// ... and fully associative
+#define NumPageInstrs	(PageSize / 4)	// instructions in one page of memory
+#define NumASIDs	256		// address space identifiers, used
+					// to tag TLB entries
+#define SoftTLBSize	64		// entries in the translation cache
+					// used by ReadMem and WriteMem
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -53,6 +62,20 @@ enum ExceptionType { NoException,           // Everything ok!
 		     NumExceptionTypes
 };
 
+// The engines that can execute user programs (selected when the
+// Machine is created, cf. Machine::Run)
+
+enum RunEngine { InterpreterEngine,	// fetch, decode and execute one
+					// instruction at a time
+		 BlockEngine,		// translate basic blocks into host
+					// code (cf. bintrans.h), or where
+					// that can't be done, run them from
+					// predecoded instructions
+		 ThreadedEngine		// as BlockEngine, but dispatch 
+					// through threaded code rather
+					// than a switch
+};
+
 // User program CPU state.  The full set of MIPS registers, plus a few
 // more because we need to be able to start/stop a user program between
 // any two instructions (thus we need to keep track of things like load
@@ -90,8 +113,25 @@ class Instruction {
     char rs, rt, rd; // Three registers from instruction.
     int extra;       // Immediate or target or shamt field or offset.
                      // Immediates are sign-extended.
+    void *handler;   // Where the threaded code that executes this 
+		     // instruction lives (cf. Machine::RunThreaded)
+};
+
+// The following class defines an entry in the simulator's own cache of
+// recent translations (see Machine::SoftTranslate).  It maps a virtual
+// page directly to where that page lives in the host's memory, and
+// remembers the TLB or page table entry the mapping came from, so that
+// the use and dirty bits can still be maintained.
+
+class SoftTLBEntry {
+  public:
+    unsigned int virtualPage;	// the page cached here; SoftTLBEmpty if none
+    char *hostPage;		// the start of the page in "mainMemory"
+    TranslationEntry *entry;	// the translation this was filled from
 };
 
+#define SoftTLBEmpty	((unsigned int) -1)
+
 class SwapAreaEntry {
 public:
     TranslationEntry entry;
@@ -114,8 +154,12 @@ public:
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
+    Machine(bool debug, RunEngine runEngine = InterpreterEngine,
+	    int tlbEntries = DefaultTLBSize, int tlbAssoc = DefaultTLBWays);
+				// Initialize the simulation of the hardware
 				// for running user programs
+    Machine(Machine *first);	// Another processor of a multiprocessor,
+				// sharing "first"'s memory
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -129,8 +173,32 @@ class Machine {
 
 // Routines internal to the machine simulation -- DO NOT call these 
 
-    void OneInstruction(Instruction *instr); 	
-    				// Run one instruction of a user program.
+    void RunBlocks();		// Run a user program with the basic-block
+				// engine; never returns
+    void RunThreaded();		// Run a user program with the threaded-code
+				// engine; never returns
+    void RunTranslated();	// Run a user program as host code made by
+				// the binary translator; returns only if
+				// there can't be any
+
+    void OneInstruction(); 	// Run one instruction of a user program.
+    bool ExecuteInstruction(Instruction *instr);
+				// Execute an already decoded instruction;
+				// FALSE if it raised an exception
+    Instruction *DecodedInstruction(int physAddr);
+				// Return the predecoded instruction at
+				// "physAddr", decoding its page if needed
+    bool PageDecoded(int physPage)
+	{ return decodedVersion[physPage] == codeVersion[physPage]; }
+				// TRUE if the entries of a physical page
+				// in decodeCache match its contents
+    void InvalidateDecodedPage(int physPage) 
+	{ __sync_fetch_and_add(&codeVersion[physPage], 1); }
+				// The contents of a physical page changed;
+				// its instructions must be decoded (and
+				// translated) again.  Called after the
+				// write (or before the page is mapped),
+				// cf. DecodedInstruction
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
     
@@ -139,13 +207,50 @@ class Machine {
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+    bool LoadLinked(int addr, int *value);
+    bool StoreConditional(int addr, int *value);
+				// LL and SC: read a word and remember
+				// where it was, then write it only if
+				// nothing else has since; *value is set
+				// to 1 if it was written, 0 if not.
+				// Return FALSE on an exception.
+    void ClearLink() { linkAddr = -1; }
+				// Make the next SC fail
+    void BreakLinks(int physAddr, int size);
+				// Memory is being written: make every
+				// processor's SC to it fail
     
-    ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
+    char *SoftTranslate(int virtAddr, int size, bool writing);
+				// Return the host address of "virtAddr",
+				// if its page is in the translation cache
+				// and the access is allowed; else NULL
+    void FlushSoftTLB();	// Empty the translation cache
+    void InvalidateSoftTLB(unsigned int vpn);
+				// Drop "vpn" from the translation cache
+
+    char *UserToHost(int virtAddr, bool writing);
+				// Translate a user address for the kernel,
+				// faulting the page in if necessary
+
+    ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing,
+			    TranslationEntry **entryPtr = NULL);
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
 				// the translation entry appropriately,
     				// and return an exception code if the 
 				// translation couldn't be completed.
+				// If "entryPtr" is given, it is set to 
+				// the entry that was used.
+
+    bool CopyFromUser(int virtAddr, char *buffer, int size);
+    bool CopyToUser(int virtAddr, char *buffer, int size);
+				// Copy "size" bytes between user virtual
+				// memory and a kernel buffer, a page at
+				// a time.  Return FALSE on a bad address.
+    int CopyStringFromUser(int virtAddr, char *buffer, int size);
+				// Copy a null-terminated string of at most
+				// "size" bytes (including the null) out of
+				// user memory.  Return its length, or -1.
 
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
@@ -165,6 +270,32 @@ class Machine {
     char *mainMemory;		// physical memory to store user program,
 				// code and data, while executing
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
+    Thread *userThread;		// the thread whose user registers were
+				// left in "registers" when it stopped
+				// running, or NULL (cf. Scheduler::Run)
+    int linkAddr;		// physical address of the word read by
+				// the last LL, -1 if SC must fail
+    int linkValue;		// what the LL read there
+
+    void **dispatchTable;	// opcode -> threaded code handler, once
+				// RunThreaded has been entered
+    Instruction *decodeCache;	// decoded copy of every instruction in
+				// mainMemory, indexed by physAddr / 4
+    unsigned int *decodedVersion;	// the version of each physical page
+				// its entries in decodeCache were
+				// decoded from
+    unsigned int *codeVersion;	// how many times each physical page has
+				// been written; decoded instructions, and
+				// host code translated from them, are
+				// only good for one version
+    int *decoding;		// 1 while a processor decodes the page
+    BinaryTranslator *translator;	// host code for this processor, once
+				// RunTranslated has been entered
+    SoftTLBEntry *softTLB;	// direct-mapped cache of recent
+				// translations, indexed by vpn; must be
+				// flushed whenever "tlb", "pageTable" or
+				// "invertedPageTable" is changed
+    bool softTLBEnabled;	// FALSE when tracing translations
 
 
 // NOTE: the hardware translation of virtual addresses in the user program
@@ -187,8 +318,29 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
-	int nextVictim;
+    int tlbSize;			// number of entries in the TLB
+    int tlbWays;			// entries in each set of the TLB
+    int tlbSets;			// tlbSize / tlbWays
+    TranslationEntry *TLBSet(unsigned int vpn, int asid)
+	{ return &tlb[((vpn ^ (unsigned) asid) % tlbSets) * tlbWays]; }
+					// The set of TLB entries where
+					// "vpn" of "asid" can be cached
 	int totalMiss;
+    int currentASID;			// TLB entries with this tag belong to
+					// the running address space
+
+    int AllocateASID(TranslationEntry *table);
+					// Get a tag for the address space
+					// with page table "table"
+    void FreeASID(int asid);		// The address space is gone
+    void InvalidateTLB(int asid);	// Drop all TLB entries of "asid"
+    void InvalidatePhysPage(int physPage);
+					// Write back and drop all TLB
+					// entries mapping "physPage"
+    void WriteBackTLBEntry(TranslationEntry *entry);
+					// Copy the use and dirty bits of a
+					// TLB entry back to the page table
+					// of the address space it belongs to
 
     TranslationEntry *pageTable;
 	unsigned int pageTableSize;
@@ -198,11 +350,21 @@ class Machine {
 #ifdef USE_INVERTED_TABLE
 	TranslationEntry *invertedPageTable;
 	TranslationEntry **hashTable;
-	SwapAreaEntry *swapArea;
-	int swapAreaSize;
+	static SwapAreaEntry *swapArea;
+	static int swapAreaSize;
 	void RecycleMemory(int threadID);
 #endif
+// On a multiprocessor, each CPU has its own Machine (registers, TLB
+// and translation cache); the rest, starting with "mainMemory", is 
+// shared.  The TLB routines above act on every processor's TLB.
+
+    Machine *firstProcessor;	// the processor that owns the memory
+    Machine *nextProcessor;	// the next one sharing it, or NULL
+
   private:
+    RunEngine engine;		// how Run executes user instructions
+    BitMap *asidUseage;		// which ASIDs are in use
+    TranslationEntry **asidPageTable;	// the page table of each ASID
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
@@ -0,0 +1,479 @@
+// mipsops.h 
+//	The bodies of the MIPS instructions, shared by the two ways
+//	mipssim.cc can dispatch on an opcode:
+//
+//	    Machine::ExecuteInstruction -- a switch statement, used by the 
+//		interpreter and the basic-block engine
+//	    Machine::RunThreaded -- threaded code, where every handler
+//		jumps straight to the handler of the next instruction
+//
+//	This file is deliberately included twice, and so has no include
+//	guard.  Before including it, define:
+//
+//	    OPCODE(op)	-- the entry point of the handler for "op"
+//	    NEXT	-- the instruction completed; go on to the next one
+//	    FAULT	-- the instruction raised an exception, which the 
+//			   kernel has already handled
+//
+//	The handlers use these variables of the enclosing routine:
+//	"instr" (the decoded instruction), "pcAfter", "nextLoadReg", 
+//	"nextLoadValue", and the scratch variables "sum", "diff", "tmp",
+//	"value", "rs", "rt" and "imm".
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+// Execute the instruction (cf. Kane's book)
+
+      OPCODE(OP_ADD)
+	sum = registers[instr->rs] + registers[instr->rt];
+	if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
+	    ((registers[instr->rs] ^ sum) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    FAULT;
+	}
+	registers[instr->rd] = sum;
+	NEXT;
+	
+      OPCODE(OP_ADDI)
+	sum = registers[instr->rs] + instr->extra;
+	if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
+	    ((instr->extra ^ sum) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    FAULT;
+	}
+	registers[instr->rt] = sum;
+	NEXT;
+	
+      OPCODE(OP_ADDIU)
+	registers[instr->rt] = registers[instr->rs] + instr->extra;
+	NEXT;
+	
+      OPCODE(OP_ADDU)
+	registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
+	NEXT;
+	
+      OPCODE(OP_AND)
+	registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
+	NEXT;
+	
+      OPCODE(OP_ANDI)
+	registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
+	NEXT;
+	
+      OPCODE(OP_BEQ)
+	if (registers[instr->rs] == registers[instr->rt])
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_BGEZAL)
+	registers[R31] = registers[NextPCReg] + 4;
+      OPCODE(OP_BGEZ)
+	if (!(registers[instr->rs] & SIGN_BIT))
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_BGTZ)
+	if (registers[instr->rs] > 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_BLEZ)
+	if (registers[instr->rs] <= 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_BLTZAL)
+	registers[R31] = registers[NextPCReg] + 4;
+      OPCODE(OP_BLTZ)
+	if (registers[instr->rs] & SIGN_BIT)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_BNE)
+	if (registers[instr->rs] != registers[instr->rt])
+	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_DIV)
+	if (registers[instr->rt] == 0) {
+	    registers[LoReg] = 0;
+	    registers[HiReg] = 0;
+	} else {
+	    registers[LoReg] =  registers[instr->rs] / registers[instr->rt];
+	    registers[HiReg] = registers[instr->rs] % registers[instr->rt];
+	}
+	NEXT;
+	
+      OPCODE(OP_DIVU)
+	  rs = (unsigned int) registers[instr->rs];
+	  rt = (unsigned int) registers[instr->rt];
+	  if (rt == 0) {
+	      registers[LoReg] = 0;
+	      registers[HiReg] = 0;
+	  } else {
+	      tmp = rs / rt;
+	      registers[LoReg] = (int) tmp;
+	      tmp = rs % rt;
+	      registers[HiReg] = (int) tmp;
+	  }
+	  NEXT;
+	
+      OPCODE(OP_JAL)
+	registers[R31] = registers[NextPCReg] + 4;
+      OPCODE(OP_J)
+	pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
+	NEXT;
+	
+      OPCODE(OP_JALR)
+	registers[instr->rd] = registers[NextPCReg] + 4;
+      OPCODE(OP_JR)
+	pcAfter = registers[instr->rs];
+	NEXT;
+	
+      OPCODE(OP_LB)
+      OPCODE(OP_LBU)
+	tmp = registers[instr->rs] + instr->extra;
+	if (!machine->ReadMem(tmp, 1, &value))
+	    FAULT;
+
+	if ((value & 0x80) && (instr->opCode == OP_LB))
+	    value |= 0xffffff00;
+	else
+	    value &= 0xff;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT;
+	
+      OPCODE(OP_LH)
+      OPCODE(OP_LHU)
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x1) {
+	    RaiseException(AddressErrorException, tmp);
+	    FAULT;
+	}
+	if (!machine->ReadMem(tmp, 2, &value))
+	    FAULT;
+
+	if ((value & 0x8000) && (instr->opCode == OP_LH))
+	    value |= 0xffff0000;
+	else
+	    value &= 0xffff;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT;
+      	
+      OPCODE(OP_LL)
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    FAULT;
+	}
+	if (!machine->LoadLinked(tmp, &value))
+	    FAULT;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT;
+	
+      OPCODE(OP_LUI)
+	DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
+	registers[instr->rt] = instr->extra << 16;
+	NEXT;
+	
+      OPCODE(OP_LW)
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    FAULT;
+	}
+	if (!machine->ReadMem(tmp, 4, &value))
+	    FAULT;
+	nextLoadReg = instr->rt;
+	nextLoadValue = value;
+	NEXT;
+    	
+      OPCODE(OP_LWL)
+	tmp = registers[instr->rs] + instr->extra;
+
+	// ReadMem assumes all 4 byte requests are aligned on an even 
+	// word boundary.  Also, the little endian/big endian swap code would
+        // fail (I think) if the other cases are ever exercised.
+	ASSERT((tmp & 0x3) == 0);  
+
+	if (!machine->ReadMem(tmp, 4, &value))
+	    FAULT;
+	if (registers[LoadReg] == instr->rt)
+	    nextLoadValue = registers[LoadValueReg];
+	else
+	    nextLoadValue = registers[instr->rt];
+	switch (tmp & 0x3) {
+	  case 0:
+	    nextLoadValue = value;
+	    break;
+	  case 1:
+	    nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
+	    break;
+	  case 2:
+	    nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
+	    break;
+	  case 3:
+	    nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
+	    break;
+	}
+	nextLoadReg = instr->rt;
+	NEXT;
+      	
+      OPCODE(OP_LWR)
+	tmp = registers[instr->rs] + instr->extra;
+
+	// ReadMem assumes all 4 byte requests are aligned on an even 
+	// word boundary.  Also, the little endian/big endian swap code would
+        // fail (I think) if the other cases are ever exercised.
+	ASSERT((tmp & 0x3) == 0);  
+
+	if (!machine->ReadMem(tmp, 4, &value))
+	    FAULT;
+	if (registers[LoadReg] == instr->rt)
+	    nextLoadValue = registers[LoadValueReg];
+	else
+	    nextLoadValue = registers[instr->rt];
+	switch (tmp & 0x3) {
+	  case 0:
+	    nextLoadValue = (nextLoadValue & 0xffffff00) |
+		((value >> 24) & 0xff);
+	    break;
+	  case 1:
+	    nextLoadValue = (nextLoadValue & 0xffff0000) |
+		((value >> 16) & 0xffff);
+	    break;
+	  case 2:
+	    nextLoadValue = (nextLoadValue & 0xff000000)
+		| ((value >> 8) & 0xffffff);
+	    break;
+	  case 3:
+	    nextLoadValue = value;
+	    break;
+	}
+	nextLoadReg = instr->rt;
+	NEXT;
+    	
+      OPCODE(OP_MFHI)
+	registers[instr->rd] = registers[HiReg];
+	NEXT;
+	
+      OPCODE(OP_MFLO)
+	registers[instr->rd] = registers[LoReg];
+	NEXT;
+	
+      OPCODE(OP_MTHI)
+	registers[HiReg] = registers[instr->rs];
+	NEXT;
+	
+      OPCODE(OP_MTLO)
+	registers[LoReg] = registers[instr->rs];
+	NEXT;
+	
+      OPCODE(OP_MULT)
+	Mult(registers[instr->rs], registers[instr->rt], TRUE,
+	     &registers[HiReg], &registers[LoReg]);
+	NEXT;
+	
+      OPCODE(OP_MULTU)
+	Mult(registers[instr->rs], registers[instr->rt], FALSE,
+	     &registers[HiReg], &registers[LoReg]);
+	NEXT;
+	
+      OPCODE(OP_NOR)
+	registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
+	NEXT;
+	
+      OPCODE(OP_OR)
+	registers[instr->rd] = registers[instr->rs] | registers[instr->rs];
+	NEXT;
+	
+      OPCODE(OP_ORI)
+	registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
+	NEXT;
+	
+      OPCODE(OP_SB)
+	if (!machine->WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
+	    FAULT;
+	NEXT;
+	
+      OPCODE(OP_SC)
+	tmp = registers[instr->rs] + instr->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    FAULT;
+	}
+	value = registers[instr->rt];
+	if (!machine->StoreConditional(tmp, &value))
+	    FAULT;
+	registers[instr->rt] = value;	// 1 if stored, 0 if not
+	NEXT;
+	
+      OPCODE(OP_SH)
+	if (!machine->WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
+	    FAULT;
+	NEXT;
+	
+      OPCODE(OP_SLL)
+	registers[instr->rd] = registers[instr->rt] << instr->extra;
+	NEXT;
+	
+      OPCODE(OP_SLLV)
+	registers[instr->rd] = registers[instr->rt] <<
+	    (registers[instr->rs] & 0x1f);
+	NEXT;
+	
+      OPCODE(OP_SLT)
+	if (registers[instr->rs] < registers[instr->rt])
+	    registers[instr->rd] = 1;
+	else
+	    registers[instr->rd] = 0;
+	NEXT;
+	
+      OPCODE(OP_SLTI)
+	if (registers[instr->rs] < instr->extra)
+	    registers[instr->rt] = 1;
+	else
+	    registers[instr->rt] = 0;
+	NEXT;
+	
+      OPCODE(OP_SLTIU)
+	rs = registers[instr->rs];
+	imm = instr->extra;
+	if (rs < imm)
+	    registers[instr->rt] = 1;
+	else
+	    registers[instr->rt] = 0;
+	NEXT;
+      	
+      OPCODE(OP_SLTU)
+	rs = registers[instr->rs];
+	rt = registers[instr->rt];
+	if (rs < rt)
+	    registers[instr->rd] = 1;
+	else
+	    registers[instr->rd] = 0;
+	NEXT;
+      	
+      OPCODE(OP_SRA)
+	registers[instr->rd] = registers[instr->rt] >> instr->extra;
+	NEXT;
+	
+      OPCODE(OP_SRAV)
+	registers[instr->rd] = registers[instr->rt] >>
+	    (registers[instr->rs] & 0x1f);
+	NEXT;
+	
+      OPCODE(OP_SRL)
+	tmp = registers[instr->rt];
+	tmp >>= instr->extra;
+	registers[instr->rd] = tmp;
+	NEXT;
+	
+      OPCODE(OP_SRLV)
+	tmp = registers[instr->rt];
+	tmp >>= (registers[instr->rs] & 0x1f);
+	registers[instr->rd] = tmp;
+	NEXT;
+	
+      OPCODE(OP_SUB)
+	diff = registers[instr->rs] - registers[instr->rt];
+	if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
+	    ((registers[instr->rs] ^ diff) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    FAULT;
+	}
+	registers[instr->rd] = diff;
+	NEXT;
+      	
+      OPCODE(OP_SUBU)
+	registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
+	NEXT;
+	
+      OPCODE(OP_SW)
+	if (!machine->WriteMem((unsigned) 
+		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
+	    FAULT;
+	NEXT;
+	
+      OPCODE(OP_SWL)
+	tmp = registers[instr->rs] + instr->extra;
+
+	// The little endian/big endian swap code would
+        // fail (I think) if the other cases are ever exercised.
+	ASSERT((tmp & 0x3) == 0);  
+
+	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
+	    FAULT;
+	switch (tmp & 0x3) {
+	  case 0:
+	    value = registers[instr->rt];
+	    break;
+	  case 1:
+	    value = (value & 0xff000000) | ((registers[instr->rt] >> 8) &
+					    0xffffff);
+	    break;
+	  case 2:
+	    value = (value & 0xffff0000) | ((registers[instr->rt] >> 16) &
+					    0xffff);
+	    break;
+	  case 3:
+	    value = (value & 0xffffff00) | ((registers[instr->rt] >> 24) &
+					    0xff);
+	    break;
+	}
+	if (!machine->WriteMem((tmp & ~0x3), 4, value))
+	    FAULT;
+	NEXT;
+    	
+      OPCODE(OP_SWR)
+	tmp = registers[instr->rs] + instr->extra;
+
+	// The little endian/big endian swap code would
+        // fail (I think) if the other cases are ever exercised.
+	ASSERT((tmp & 0x3) == 0);  
+
+	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
+	    FAULT;
+	switch (tmp & 0x3) {
+	  case 0:
+	    value = (value & 0xffffff) | (registers[instr->rt] << 24);
+	    break;
+	  case 1:
+	    value = (value & 0xffff) | (registers[instr->rt] << 16);
+	    break;
+	  case 2:
+	    value = (value & 0xff) | (registers[instr->rt] << 8);
+	    break;
+	  case 3:
+	    value = registers[instr->rt];
+	    break;
+	}
+	if (!machine->WriteMem((tmp & ~0x3), 4, value))
+	    FAULT;
+	NEXT;
+    	
+      OPCODE(OP_SYSCALL)
+	RaiseException(SyscallException, 0);
+	FAULT; 
+	
+      OPCODE(OP_XOR)
+	registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
+	NEXT;
+	
+      OPCODE(OP_XORI)
+	registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
+	NEXT;
+	
+      OPCODE(OP_RES)
+      OPCODE(OP_UNIMP)
+	RaiseException(IllegalInstrException, 0);
+	FAULT;
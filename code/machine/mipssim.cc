@@ -15,6 +15,117 @@
 #include "machine.h"
 #include "mipssim.h"
 #include "system.h"
+#include "bintrans.h"
+
+/*
+ * The table below is used to translate bits 31:26 of the instruction
+ * into a value suitable for the "opCode" field of a MemWord structure,
+ * or into a special value for further decoding.
+ */
+
+static OpInfo opTable[] = {
+    {SPECIAL, RFMT}, {BCOND, IFMT}, {OP_J, JFMT}, {OP_JAL, JFMT},
+    {OP_BEQ, IFMT}, {OP_BNE, IFMT}, {OP_BLEZ, IFMT}, {OP_BGTZ, IFMT},
+    {OP_ADDI, IFMT}, {OP_ADDIU, IFMT}, {OP_SLTI, IFMT}, {OP_SLTIU, IFMT},
+    {OP_ANDI, IFMT}, {OP_ORI, IFMT}, {OP_XORI, IFMT}, {OP_LUI, IFMT},
+    {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT},
+    {OP_LB, IFMT}, {OP_LH, IFMT}, {OP_LWL, IFMT}, {OP_LW, IFMT},
+    {OP_LBU, IFMT}, {OP_LHU, IFMT}, {OP_LWR, IFMT}, {OP_RES, IFMT},
+    {OP_SB, IFMT}, {OP_SH, IFMT}, {OP_SWL, IFMT}, {OP_SW, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_SWR, IFMT}, {OP_RES, IFMT},
+    {OP_LL, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT},
+    {OP_SC, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT}, {OP_UNIMP, IFMT},
+    {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}, {OP_RES, IFMT}
+};
+
+/*
+ * The table below is used to convert the "funct" field of SPECIAL
+ * instructions into the "opCode" field of a MemWord.
+ */
+
+static int specialTable[] = {
+    OP_SLL, OP_RES, OP_SRL, OP_SRA, OP_SLLV, OP_RES, OP_SRLV, OP_SRAV,
+    OP_JR, OP_JALR, OP_RES, OP_RES, OP_SYSCALL, OP_UNIMP, OP_RES, OP_RES,
+    OP_MFHI, OP_MTHI, OP_MFLO, OP_MTLO, OP_RES, OP_RES, OP_RES, OP_RES,
+    OP_MULT, OP_MULTU, OP_DIV, OP_DIVU, OP_RES, OP_RES, OP_RES, OP_RES,
+    OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_AND, OP_OR, OP_XOR, OP_NOR,
+    OP_RES, OP_RES, OP_SLT, OP_SLTU, OP_RES, OP_RES, OP_RES, OP_RES,
+    OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES,
+    OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES, OP_RES
+};
+
+// Printed versions of each instruction, for debugging
+
+static struct OpString opStrings[] = {
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"ADD r%d,r%d,r%d", {RD, RS, RT}},
+	{"ADDI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"ADDIU r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"ADDU r%d,r%d,r%d", {RD, RS, RT}},
+	{"AND r%d,r%d,r%d", {RD, RS, RT}},
+	{"ANDI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"BEQ r%d,r%d,%d", {RS, RT, EXTRA}},
+	{"BGEZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BGEZAL r%d,%d", {RS, EXTRA, NONE}},
+	{"BGTZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLEZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLTZ r%d,%d", {RS, EXTRA, NONE}},
+	{"BLTZAL r%d,%d", {RS, EXTRA, NONE}},
+	{"BNE r%d,r%d,%d", {RS, RT, EXTRA}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"DIV r%d,r%d", {RS, RT, NONE}},
+	{"DIVU r%d,r%d", {RS, RT, NONE}},
+	{"J %d", {EXTRA, NONE, NONE}},
+	{"JAL %d", {EXTRA, NONE, NONE}},
+	{"JALR r%d,r%d", {RD, RS, NONE}},
+	{"JR r%d,r%d", {RD, RS, NONE}},
+	{"LB r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LBU r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LH r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LHU r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LUI r%d,%d", {RT, EXTRA, NONE}},
+	{"LW r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LWL r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"LWR r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"MFHI r%d", {RD, NONE, NONE}},
+	{"MFLO r%d", {RD, NONE, NONE}},
+	{"Shouldn't happen", {NONE, NONE, NONE}},
+	{"MTHI r%d", {RS, NONE, NONE}},
+	{"MTLO r%d", {RS, NONE, NONE}},
+	{"MULT r%d,r%d", {RS, RT, NONE}},
+	{"MULTU r%d,r%d", {RS, RT, NONE}},
+	{"NOR r%d,r%d,r%d", {RD, RS, RT}},
+	{"OR r%d,r%d,r%d", {RD, RS, RT}},
+	{"ORI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"RFE", {NONE, NONE, NONE}},
+	{"SB r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SH r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SLL r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SLLV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SLT r%d,r%d,r%d", {RD, RS, RT}},
+	{"SLTI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SLTIU r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SLTU r%d,r%d,r%d", {RD, RS, RT}},
+	{"SRA r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SRAV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SRL r%d,r%d,%d", {RD, RT, EXTRA}},
+	{"SRLV r%d,r%d,r%d", {RD, RT, RS}},
+	{"SUB r%d,r%d,r%d", {RD, RS, RT}},
+	{"SUBU r%d,r%d,r%d", {RD, RS, RT}},
+	{"SW r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SWL r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"SWR r%d,%d(r%d)", {RT, EXTRA, RS}},
+	{"XOR r%d,r%d,r%d", {RD, RS, RT}},
+	{"XORI r%d,r%d,%d", {RT, RS, EXTRA}},
+	{"SYSCALL", {NONE, NONE, NONE}},
+	{"Unimplemented", {NONE, NONE, NONE}},
+	{"Reserved", {NONE, NONE, NONE}}
+      };
 
 static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
@@ -30,20 +141,264 @@ static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 void
 Machine::Run()
 {
-    Instruction *instr = new Instruction;  // storage for decoded instruction
-
     if(DebugIsEnabled('m'))
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
     interrupt->setStatus(UserMode);
+    if (engine == ThreadedEngine && !singleStep && !DebugIsEnabled('m'))
+	RunThreaded();		// never returns
+#ifdef HOST_i386
+    if (engine == BlockEngine && !singleStep && !DebugIsEnabled('m')
+		&& softTLBEnabled)
+	RunTranslated();	// returns only if it can't get code memory,
+				// or interrupts are being traced
+#endif
+    if (engine != InterpreterEngine && !singleStep)
+	RunBlocks();		// never returns; also used for tracing 
+				// the threaded engine, which can't
+    LeaveKernel();		// on a multiprocessor, cf. cpu.h
     for (;;) {
-        OneInstruction(instr);
-	interrupt->OneTick();
+        OneInstruction();
+	interrupt->OneUserTick();
 	if (singleStep && (runUntilTime <= stats->totalTicks))
 	  Debugger();
     }
 }
 
+//----------------------------------------------------------------------
+// Machine::RunBlocks
+// 	Simulate the execution of a user-level program a basic block
+//	at a time.  The PC is translated once at the start of each block;
+//	after that we walk the predecoded instructions of the physical
+//	page directly, for as long as execution stays sequential.
+//
+//	A block ends when:
+//		an instruction raises an exception (the kernel may have
+//		    changed the page table, TLB or registers)
+//		an interrupt handler runs (we may have been switched out)
+//		control transfers (the PC is not the next word)
+//		we run off the end of the page
+//		the page being executed is written (its decoded form
+//		    has been thrown away)
+//
+//	Time still advances one tick per instruction, so the sequence
+//	of instructions, interrupts and context switches is exactly
+//	the same as with the interpreter.  Only the instruction fetch
+//	(and the translation debugging output for it) is skipped.
+//
+//	Used by the block engine where its blocks can't be translated
+//	into host code (cf. RunTranslated), and when tracing.
+//----------------------------------------------------------------------
+
+void
+Machine::RunBlocks()
+{
+    ExceptionType exception;
+    TranslationEntry *entry;
+    int physAddr, virtAddr, physPage;
+    Instruction *instr;
+    bool done;
+
+    LeaveKernel();		// on a multiprocessor, cf. cpu.h
+    for (;;) {
+	virtAddr = registers[PCReg];
+	exception = Translate(virtAddr, &physAddr, 4, FALSE, &entry);
+	if (exception != NoException) {
+	    RaiseException(exception, virtAddr);
+	    interrupt->OneUserTick();
+	    continue;
+	}
+	physPage = physAddr / PageSize;
+	instr = DecodedInstruction(physAddr);
+	
+	do {
+	    if (tlb != NULL) {		// each fetch is a TLB hit; keep
+					// LRU replacement exact
+		entry->lastUseTime = stats->totalTicks;
+		stats->numTLBHits++;
+	    }
+	    done = !ExecuteInstruction(instr);
+	    done = interrupt->OneUserTick() || done;
+	    virtAddr += 4;
+	    instr++;
+	} while (!done && registers[PCReg] == virtAddr 
+		 && (virtAddr % PageSize) != 0 && PageDecoded(physPage));
+    }
+}
+
+
+//----------------------------------------------------------------------
+// Machine::RunTranslated
+// 	Simulate the execution of a user-level program by running host
+//	code translated from its basic blocks (see bintrans.h), which
+//	jump straight from one block to the next.  Whenever the
+//	translated code can't go on -- an instruction that isn't
+//	translated, or that would raise an exception, or an interrupt
+//	that is due -- we interpret one instruction, and try again.
+//
+//	As with the other engines, the instruction, tick and interrupt
+//	sequence is the same as with the interpreter.
+//
+//	Returns, before running anything, if we can't translate: if
+//	every tick must go through OneTick, or the host won't give us
+//	memory to run code from.
+//----------------------------------------------------------------------
+
+void
+Machine::RunTranslated()
+{
+    if (interrupt->UserHorizon() == NULL)
+	return;
+    if (translator == NULL) {
+	char *area = AllocCodeArray(CodeCacheSize);
+
+	if (area == NULL)
+	    return;
+	translator = new BinaryTranslator(this, area, CodeCacheSize);
+    }
+
+    LeaveKernel();		// on a multiprocessor, cf. cpu.h
+    for (;;) {
+	if (translator->Run())
+	    continue;
+	OneInstruction();
+	interrupt->OneUserTick();
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Simulate the execution of a user-level program using threaded
+//	code.  Like RunBlocks, we translate the PC once per basic block,
+//	and end a block under the same conditions.  But rather than 
+//	returning to a switch statement after each instruction, every 
+//	instruction's handler finishes by jumping directly to the handler
+//	of the next one.  Each instruction gets its handler bound when
+//	its page is decoded (see DecodedInstruction), so the dispatch is
+//	a single indirect jump, which the host can predict separately
+//	for every handler.
+//
+//	The handlers themselves are the same code as in 
+//	ExecuteInstruction (see mipsops.h), and the instruction, tick and
+//	interrupt sequence is the same as with the other engines.
+//----------------------------------------------------------------------
+
+// Start executing the instruction "instr" (which is at "virtAddr")
+#define DISPATCH							\
+    {									\
+	if (tlb != NULL) {		/* each fetch is a TLB hit */	\
+	    entry->lastUseTime = stats->totalTicks;			\
+	    stats->numTLBHits++;					\
+	}								\
+	pcAfter = registers[NextPCReg] + 4;				\
+	nextLoadReg = 0;						\
+	nextLoadValue = 0;						\
+	goto *instr->handler;						\
+    }
+
+// Finish the instruction just executed, then go on to the next one,
+// unless the block has ended
+#define DISPATCH_NEXT							\
+    {									\
+	DelayedLoad(nextLoadReg, nextLoadValue);			\
+	registers[PrevPCReg] = registers[PCReg];			\
+	registers[PCReg] = registers[NextPCReg];			\
+	registers[NextPCReg] = pcAfter;					\
+	if (interrupt->OneUserTick())					\
+	    continue;							\
+	virtAddr += 4;							\
+	instr++;							\
+	if (registers[PCReg] != virtAddr || (virtAddr % PageSize) == 0	\
+		|| !PageDecoded(physPage))				\
+	    continue;							\
+	DISPATCH;							\
+    }
+
+void
+Machine::RunThreaded()
+{
+    static void *handlers[MaxOpcode + 1];
+    ExceptionType exception;
+    TranslationEntry *entry;
+    int physAddr, virtAddr, physPage;
+    Instruction *instr;
+    int pcAfter, nextLoadReg, nextLoadValue;
+    int sum, diff, tmp, value;
+    unsigned int rs, rt, imm;
+    int i;
+
+    if (dispatchTable == NULL) {
+	if (handlers[OP_ADD] == NULL) {	// the first processor here
+	    for (i = 0; i <= MaxOpcode; i++)
+		handlers[i] = &&Undefined;
+	    handlers[OP_ADD] = &&Do_OP_ADD;		handlers[OP_ADDI] = &&Do_OP_ADDI;
+	    handlers[OP_ADDIU] = &&Do_OP_ADDIU;	handlers[OP_ADDU] = &&Do_OP_ADDU;
+	    handlers[OP_AND] = &&Do_OP_AND;		handlers[OP_ANDI] = &&Do_OP_ANDI;
+	    handlers[OP_BEQ] = &&Do_OP_BEQ;		handlers[OP_BGEZ] = &&Do_OP_BGEZ;
+	    handlers[OP_BGEZAL] = &&Do_OP_BGEZAL;	handlers[OP_BGTZ] = &&Do_OP_BGTZ;
+	    handlers[OP_BLEZ] = &&Do_OP_BLEZ;	handlers[OP_BLTZ] = &&Do_OP_BLTZ;
+	    handlers[OP_BLTZAL] = &&Do_OP_BLTZAL;	handlers[OP_BNE] = &&Do_OP_BNE;
+	    handlers[OP_DIV] = &&Do_OP_DIV;		handlers[OP_DIVU] = &&Do_OP_DIVU;
+	    handlers[OP_J] = &&Do_OP_J;		handlers[OP_JAL] = &&Do_OP_JAL;
+	    handlers[OP_JALR] = &&Do_OP_JALR;	handlers[OP_JR] = &&Do_OP_JR;
+	    handlers[OP_LB] = &&Do_OP_LB;		handlers[OP_LBU] = &&Do_OP_LBU;
+	    handlers[OP_LH] = &&Do_OP_LH;		handlers[OP_LHU] = &&Do_OP_LHU;
+	    handlers[OP_LL] = &&Do_OP_LL;		handlers[OP_SC] = &&Do_OP_SC;
+	    handlers[OP_LUI] = &&Do_OP_LUI;		handlers[OP_LW] = &&Do_OP_LW;
+	    handlers[OP_LWL] = &&Do_OP_LWL;		handlers[OP_LWR] = &&Do_OP_LWR;
+	    handlers[OP_MFHI] = &&Do_OP_MFHI;	handlers[OP_MFLO] = &&Do_OP_MFLO;
+	    handlers[OP_MTHI] = &&Do_OP_MTHI;	handlers[OP_MTLO] = &&Do_OP_MTLO;
+	    handlers[OP_MULT] = &&Do_OP_MULT;	handlers[OP_MULTU] = &&Do_OP_MULTU;
+	    handlers[OP_NOR] = &&Do_OP_NOR;		handlers[OP_OR] = &&Do_OP_OR;
+	    handlers[OP_ORI] = &&Do_OP_ORI;		handlers[OP_SB] = &&Do_OP_SB;
+	    handlers[OP_SH] = &&Do_OP_SH;		handlers[OP_SLL] = &&Do_OP_SLL;
+	    handlers[OP_SLLV] = &&Do_OP_SLLV;	handlers[OP_SLT] = &&Do_OP_SLT;
+	    handlers[OP_SLTI] = &&Do_OP_SLTI;	handlers[OP_SLTIU] = &&Do_OP_SLTIU;
+	    handlers[OP_SLTU] = &&Do_OP_SLTU;	handlers[OP_SRA] = &&Do_OP_SRA;
+	    handlers[OP_SRAV] = &&Do_OP_SRAV;	handlers[OP_SRL] = &&Do_OP_SRL;
+	    handlers[OP_SRLV] = &&Do_OP_SRLV;	handlers[OP_SUB] = &&Do_OP_SUB;
+	    handlers[OP_SUBU] = &&Do_OP_SUBU;	handlers[OP_SW] = &&Do_OP_SW;
+	    handlers[OP_SWL] = &&Do_OP_SWL;		handlers[OP_SWR] = &&Do_OP_SWR;
+	    handlers[OP_SYSCALL] = &&Do_OP_SYSCALL;	handlers[OP_XOR] = &&Do_OP_XOR;
+	    handlers[OP_XORI] = &&Do_OP_XORI;	handlers[OP_RES] = &&Do_OP_RES;
+	    handlers[OP_UNIMP] = &&Do_OP_UNIMP;
+	    for (i = 0; i < NumPhysPages; i++)	// decoded without handlers
+		decodedVersion[i] = codeVersion[i] - 1;
+	}
+	dispatchTable = handlers;
+    }
+
+    LeaveKernel();		// on a multiprocessor, cf. cpu.h
+    for (;;) {
+	virtAddr = registers[PCReg];
+	exception = Translate(virtAddr, &physAddr, 4, FALSE, &entry);
+	if (exception != NoException) {
+	    RaiseException(exception, virtAddr);
+	    interrupt->OneUserTick();
+	    continue;
+	}
+	physPage = physAddr / PageSize;
+	instr = DecodedInstruction(physAddr);
+	DISPATCH;
+
+#define OPCODE(op)	Do_##op:
+#define NEXT		DISPATCH_NEXT
+#define FAULT		goto Fault
+#include "mipsops.h"
+#undef OPCODE
+#undef NEXT
+#undef FAULT
+
+      Undefined:
+	ASSERT(FALSE);
+
+      Fault:
+	interrupt->OneUserTick();
+    }
+}
+
+#undef DISPATCH
+#undef DISPATCH_NEXT
 
 //----------------------------------------------------------------------
 // TypeToReg
@@ -88,21 +443,50 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	The one exception is the decoded form of each instruction, which
+//	is kept per physical page in "decodeCache".  It is a pure function
+//	of the contents of memory, and is thrown away whenever a page 
+//	is written (see InvalidateDecodedPage).
 //----------------------------------------------------------------------
 
 void
-Machine::OneInstruction(Instruction *instr)
+Machine::OneInstruction()
 {
-    int raw;
-    int nextLoadReg = 0; 	
-    int nextLoadValue = 0; 	// record delayed load operation, to apply
-				// in the future
+    ExceptionType exception;
+    int physAddr;
 
     // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    }
+    (void) ExecuteInstruction(DecodedInstruction(physAddr));
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Execute an instruction that has already been fetched and decoded,
+//	and advance the program counters past it.
+//
+//	Shared by the interpreter (OneInstruction) and the basic-block
+//	engine (RunBlocks), so that both have exactly the same semantics
+//	for exceptions and delayed loads.
+//
+// Returns:
+//	TRUE if the instruction completed, FALSE if it raised an exception
+//	(in which case the kernel has already handled it).
+//
+//	"instr" -- the decoded instruction at registers[PCReg]
+//----------------------------------------------------------------------
+
+bool
+Machine::ExecuteInstruction(Instruction *instr)
+{
+    int nextLoadReg = 0; 	
+    int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
 
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[instr->opCode];
@@ -119,435 +503,17 @@ Machine::OneInstruction(Instruction *instr)
     int sum, diff, tmp, value;
     unsigned int rs, rt, imm;
 
-    // Execute the instruction (cf. Kane's book)
+    // Execute the instruction
     switch (instr->opCode) {
-	
-      case OP_ADD:
-	sum = registers[instr->rs] + registers[instr->rt];
-	if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
-	    ((registers[instr->rs] ^ sum) & SIGN_BIT)) {
-	    RaiseException(OverflowException, 0);
-	    return;
-	}
-	registers[instr->rd] = sum;
-	break;
-	
-      case OP_ADDI:
-	sum = registers[instr->rs] + instr->extra;
-	if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
-	    ((instr->extra ^ sum) & SIGN_BIT)) {
-	    RaiseException(OverflowException, 0);
-	    return;
-	}
-	registers[instr->rt] = sum;
-	break;
-	
-      case OP_ADDIU:
-	registers[instr->rt] = registers[instr->rs] + instr->extra;
-	break;
-	
-      case OP_ADDU:
-	registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
-	break;
-	
-      case OP_AND:
-	registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
-	break;
-	
-      case OP_ANDI:
-	registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
-	break;
-	
-      case OP_BEQ:
-	if (registers[instr->rs] == registers[instr->rt])
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_BGEZAL:
-	registers[R31] = registers[NextPCReg] + 4;
-      case OP_BGEZ:
-	if (!(registers[instr->rs] & SIGN_BIT))
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_BGTZ:
-	if (registers[instr->rs] > 0)
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_BLEZ:
-	if (registers[instr->rs] <= 0)
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_BLTZAL:
-	registers[R31] = registers[NextPCReg] + 4;
-      case OP_BLTZ:
-	if (registers[instr->rs] & SIGN_BIT)
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_BNE:
-	if (registers[instr->rs] != registers[instr->rt])
-	    pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-	break;
-	
-      case OP_DIV:
-	if (registers[instr->rt] == 0) {
-	    registers[LoReg] = 0;
-	    registers[HiReg] = 0;
-	} else {
-	    registers[LoReg] =  registers[instr->rs] / registers[instr->rt];
-	    registers[HiReg] = registers[instr->rs] % registers[instr->rt];
-	}
-	break;
-	
-      case OP_DIVU:	  
-	  rs = (unsigned int) registers[instr->rs];
-	  rt = (unsigned int) registers[instr->rt];
-	  if (rt == 0) {
-	      registers[LoReg] = 0;
-	      registers[HiReg] = 0;
-	  } else {
-	      tmp = rs / rt;
-	      registers[LoReg] = (int) tmp;
-	      tmp = rs % rt;
-	      registers[HiReg] = (int) tmp;
-	  }
-	  break;
-	
-      case OP_JAL:
-	registers[R31] = registers[NextPCReg] + 4;
-      case OP_J:
-	pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
-	break;
-	
-      case OP_JALR:
-	registers[instr->rd] = registers[NextPCReg] + 4;
-      case OP_JR:
-	pcAfter = registers[instr->rs];
-	break;
-	
-      case OP_LB:
-      case OP_LBU:
-	tmp = registers[instr->rs] + instr->extra;
-	if (!machine->ReadMem(tmp, 1, &value))
-	    return;
 
-	if ((value & 0x80) && (instr->opCode == OP_LB))
-	    value |= 0xffffff00;
-	else
-	    value &= 0xff;
-	nextLoadReg = instr->rt;
-	nextLoadValue = value;
-	break;
-	
-      case OP_LH:
-      case OP_LHU:	  
-	tmp = registers[instr->rs] + instr->extra;
-	if (tmp & 0x1) {
-	    RaiseException(AddressErrorException, tmp);
-	    return;
-	}
-	if (!machine->ReadMem(tmp, 2, &value))
-	    return;
+#define OPCODE(op)	case op:
+#define NEXT		break
+#define FAULT		return FALSE
+#include "mipsops.h"
+#undef OPCODE
+#undef NEXT
+#undef FAULT
 
-	if ((value & 0x8000) && (instr->opCode == OP_LH))
-	    value |= 0xffff0000;
-	else
-	    value &= 0xffff;
-	nextLoadReg = instr->rt;
-	nextLoadValue = value;
-	break;
-      	
-      case OP_LUI:
-	DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
-	registers[instr->rt] = instr->extra << 16;
-	break;
-	
-      case OP_LW:
-	tmp = registers[instr->rs] + instr->extra;
-	if (tmp & 0x3) {
-	    RaiseException(AddressErrorException, tmp);
-	    return;
-	}
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
-	nextLoadReg = instr->rt;
-	nextLoadValue = value;
-	break;
-    	
-      case OP_LWL:	  
-	tmp = registers[instr->rs] + instr->extra;
-
-	// ReadMem assumes all 4 byte requests are aligned on an even 
-	// word boundary.  Also, the little endian/big endian swap code would
-        // fail (I think) if the other cases are ever exercised.
-	ASSERT((tmp & 0x3) == 0);  
-
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
-	if (registers[LoadReg] == instr->rt)
-	    nextLoadValue = registers[LoadValueReg];
-	else
-	    nextLoadValue = registers[instr->rt];
-	switch (tmp & 0x3) {
-	  case 0:
-	    nextLoadValue = value;
-	    break;
-	  case 1:
-	    nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
-	    break;
-	  case 2:
-	    nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
-	    break;
-	  case 3:
-	    nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
-	    break;
-	}
-	nextLoadReg = instr->rt;
-	break;
-      	
-      case OP_LWR:
-	tmp = registers[instr->rs] + instr->extra;
-
-	// ReadMem assumes all 4 byte requests are aligned on an even 
-	// word boundary.  Also, the little endian/big endian swap code would
-        // fail (I think) if the other cases are ever exercised.
-	ASSERT((tmp & 0x3) == 0);  
-
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
-	if (registers[LoadReg] == instr->rt)
-	    nextLoadValue = registers[LoadValueReg];
-	else
-	    nextLoadValue = registers[instr->rt];
-	switch (tmp & 0x3) {
-	  case 0:
-	    nextLoadValue = (nextLoadValue & 0xffffff00) |
-		((value >> 24) & 0xff);
-	    break;
-	  case 1:
-	    nextLoadValue = (nextLoadValue & 0xffff0000) |
-		((value >> 16) & 0xffff);
-	    break;
-	  case 2:
-	    nextLoadValue = (nextLoadValue & 0xff000000)
-		| ((value >> 8) & 0xffffff);
-	    break;
-	  case 3:
-	    nextLoadValue = value;
-	    break;
-	}
-	nextLoadReg = instr->rt;
-	break;
-    	
-      case OP_MFHI:
-	registers[instr->rd] = registers[HiReg];
-	break;
-	
-      case OP_MFLO:
-	registers[instr->rd] = registers[LoReg];
-	break;
-	
-      case OP_MTHI:
-	registers[HiReg] = registers[instr->rs];
-	break;
-	
-      case OP_MTLO:
-	registers[LoReg] = registers[instr->rs];
-	break;
-	
-      case OP_MULT:
-	Mult(registers[instr->rs], registers[instr->rt], TRUE,
-	     &registers[HiReg], &registers[LoReg]);
-	break;
-	
-      case OP_MULTU:
-	Mult(registers[instr->rs], registers[instr->rt], FALSE,
-	     &registers[HiReg], &registers[LoReg]);
-	break;
-	
-      case OP_NOR:
-	registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
-	break;
-	
-      case OP_OR:
-	registers[instr->rd] = registers[instr->rs] | registers[instr->rs];
-	break;
-	
-      case OP_ORI:
-	registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
-	break;
-	
-      case OP_SB:
-	if (!machine->WriteMem((unsigned) 
-		(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-	    return;
-	break;
-	
-      case OP_SH:
-	if (!machine->WriteMem((unsigned) 
-		(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-	    return;
-	break;
-	
-      case OP_SLL:
-	registers[instr->rd] = registers[instr->rt] << instr->extra;
-	break;
-	
-      case OP_SLLV:
-	registers[instr->rd] = registers[instr->rt] <<
-	    (registers[instr->rs] & 0x1f);
-	break;
-	
-      case OP_SLT:
-	if (registers[instr->rs] < registers[instr->rt])
-	    registers[instr->rd] = 1;
-	else
-	    registers[instr->rd] = 0;
-	break;
-	
-      case OP_SLTI:
-	if (registers[instr->rs] < instr->extra)
-	    registers[instr->rt] = 1;
-	else
-	    registers[instr->rt] = 0;
-	break;
-	
-      case OP_SLTIU:	  
-	rs = registers[instr->rs];
-	imm = instr->extra;
-	if (rs < imm)
-	    registers[instr->rt] = 1;
-	else
-	    registers[instr->rt] = 0;
-	break;
-      	
-      case OP_SLTU:	  
-	rs = registers[instr->rs];
-	rt = registers[instr->rt];
-	if (rs < rt)
-	    registers[instr->rd] = 1;
-	else
-	    registers[instr->rd] = 0;
-	break;
-      	
-      case OP_SRA:
-	registers[instr->rd] = registers[instr->rt] >> instr->extra;
-	break;
-	
-      case OP_SRAV:
-	registers[instr->rd] = registers[instr->rt] >>
-	    (registers[instr->rs] & 0x1f);
-	break;
-	
-      case OP_SRL:
-	tmp = registers[instr->rt];
-	tmp >>= instr->extra;
-	registers[instr->rd] = tmp;
-	break;
-	
-      case OP_SRLV:
-	tmp = registers[instr->rt];
-	tmp >>= (registers[instr->rs] & 0x1f);
-	registers[instr->rd] = tmp;
-	break;
-	
-      case OP_SUB:	  
-	diff = registers[instr->rs] - registers[instr->rt];
-	if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
-	    ((registers[instr->rs] ^ diff) & SIGN_BIT)) {
-	    RaiseException(OverflowException, 0);
-	    return;
-	}
-	registers[instr->rd] = diff;
-	break;
-      	
-      case OP_SUBU:
-	registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
-	break;
-	
-      case OP_SW:
-	if (!machine->WriteMem((unsigned) 
-		(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-	    return;
-	break;
-	
-      case OP_SWL:	  
-	tmp = registers[instr->rs] + instr->extra;
-
-	// The little endian/big endian swap code would
-        // fail (I think) if the other cases are ever exercised.
-	ASSERT((tmp & 0x3) == 0);  
-
-	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
-	switch (tmp & 0x3) {
-	  case 0:
-	    value = registers[instr->rt];
-	    break;
-	  case 1:
-	    value = (value & 0xff000000) | ((registers[instr->rt] >> 8) &
-					    0xffffff);
-	    break;
-	  case 2:
-	    value = (value & 0xffff0000) | ((registers[instr->rt] >> 16) &
-					    0xffff);
-	    break;
-	  case 3:
-	    value = (value & 0xffffff00) | ((registers[instr->rt] >> 24) &
-					    0xff);
-	    break;
-	}
-	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
-	break;
-    	
-      case OP_SWR:	  
-	tmp = registers[instr->rs] + instr->extra;
-
-	// The little endian/big endian swap code would
-        // fail (I think) if the other cases are ever exercised.
-	ASSERT((tmp & 0x3) == 0);  
-
-	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
-	switch (tmp & 0x3) {
-	  case 0:
-	    value = (value & 0xffffff) | (registers[instr->rt] << 24);
-	    break;
-	  case 1:
-	    value = (value & 0xffff) | (registers[instr->rt] << 16);
-	    break;
-	  case 2:
-	    value = (value & 0xff) | (registers[instr->rt] << 8);
-	    break;
-	  case 3:
-	    value = registers[instr->rt];
-	    break;
-	}
-	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
-	break;
-    	
-      case OP_SYSCALL:
-	RaiseException(SyscallException, 0);
-	return; 
-	
-      case OP_XOR:
-	registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
-	break;
-	
-      case OP_XORI:
-	registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
-	break;
-	
-      case OP_RES:
-      case OP_UNIMP:
-	RaiseException(IllegalInstrException, 0);
-	return;
-	
       default:
 	ASSERT(FALSE);
     }
@@ -562,6 +528,7 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
     registers[PCReg] = registers[NextPCReg];
     registers[NextPCReg] = pcAfter;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -581,6 +548,54 @@ Machine::DelayedLoad(int nextReg, int nextValue)
     registers[0] = 0; 	// and always make sure R0 stays zero.
 }
 
+//----------------------------------------------------------------------
+// Machine::DecodedInstruction
+// 	Return the decoded form of the instruction stored at "physAddr".
+//	The first time an instruction on a physical page is needed, the
+//	whole page is decoded at once; after that, until the page is
+//	written or reloaded, fetching from it costs no decoding at all.
+//
+//	With -par, other processors may write the page, or decode it,
+//	while we do, without the kernel lock.  So only one processor
+//	decodes a page at a time, and the entries are marked with the
+//	version of the page read before decoding it.  Writers bump the
+//	version after the write (InvalidateDecodedPage), so if the page
+//	changes under us, the entries are already out of date when we
+//	finish, and the page is decoded again when next needed.  (A
+//	processor still running instructions from the page may see
+//	some of them change under it, as with real cross-modifying code.)
+//
+//	"physAddr" -- the (word aligned) physical address of the instruction
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::DecodedInstruction(int physAddr)
+{
+    int page = physAddr / PageSize;
+    unsigned int version;
+
+    while (!PageDecoded(page)) {
+	if (__sync_lock_test_and_set(&decoding[page], 1))
+	    continue;			// another processor is decoding it
+	Instruction *instr = &decodeCache[page * NumPageInstrs];
+	unsigned int *word = (unsigned int *) &mainMemory[page * PageSize];
+
+	version = codeVersion[page];
+	__sync_synchronize();		// read the page after the version
+	DEBUG('m', "Decoding physical page %d\n", page);
+	for (int i = 0; i < NumPageInstrs; i++) {
+	    instr[i].value = WordToHost(word[i]);
+	    instr[i].Decode();
+	    if (dispatchTable != NULL)		// bind the threaded code
+		instr[i].handler = dispatchTable[instr[i].opCode];
+	}
+	__sync_synchronize();		// and finish before marking it
+	decodedVersion[page] = version;
+	__sync_lock_release(&decoding[page]);
+    }
+    return &decodeCache[physAddr / 4];
+}
+
 //----------------------------------------------------------------------
 // Instruction::Decode
 // 	Decode a MIPS instruction 
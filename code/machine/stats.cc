@@ -22,6 +22,87 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numTLBHits = numTLBMisses = 0;
+    numTimerInterrupts = 0;
+    numUserStateCopies = numSpaceLoads = 0;
+    numFutexWaits = numFutexWakes = 0;
+    numWakeups = wakeupTicks = maxWakeupTicks = numShares = 0;
+    shareSum = shareSumSquares = 0;
+    hostStartTime = HostTime();
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordWakeup
+// 	Note how long a thread had to wait on the ready list after
+//	it woke up, before it was run.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordWakeup(int latency)
+{
+    if (latency < 0)		// woken on a CPU whose clock was ahead
+	latency = 0;
+    numWakeups++;
+    wakeupTicks += latency;
+    if (latency > maxWakeupTicks)
+	maxWakeupTicks = latency;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordShare
+// 	Note the weighted CPU time of a thread that finished, for Jain's
+//	fairness index: (sum x)^2 / (n * sum x^2), which is 1 when
+//	every thread got the same weighted share, and 1/n when one 
+//	thread got it all.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordShare(double share)
+{
+    numShares++;
+    shareSum += share;
+    shareSumSquares += share * share;
+}
+
+//----------------------------------------------------------------------
+// Statistics::Add
+// 	Add the statistics of another CPU of a multiprocessor to these,
+//	at halt.  The CPUs' clocks ran side by side, so the total time 
+//	is the later of the two; everything else (including idle time)
+//	is summed.
+//----------------------------------------------------------------------
+
+void
+Statistics::Add(Statistics *other)
+{
+    if (other->totalTicks > totalTicks)
+	totalTicks = other->totalTicks;
+    idleTicks += other->idleTicks;
+    systemTicks += other->systemTicks;
+    userTicks += other->userTicks;
+    numDiskReads += other->numDiskReads;
+    numDiskWrites += other->numDiskWrites;
+    numConsoleCharsRead += other->numConsoleCharsRead;
+    numConsoleCharsWritten += other->numConsoleCharsWritten;
+    numPageFaults += other->numPageFaults;
+    numTLBHits += other->numTLBHits;
+    numTLBMisses += other->numTLBMisses;
+    numPacketsSent += other->numPacketsSent;
+    numPacketsRecvd += other->numPacketsRecvd;
+    numTimerInterrupts += other->numTimerInterrupts;
+    numUserStateCopies += other->numUserStateCopies;
+    numSpaceLoads += other->numSpaceLoads;
+    numFutexWaits += other->numFutexWaits;
+    numFutexWakes += other->numFutexWakes;
+    numWakeups += other->numWakeups;
+    wakeupTicks += other->wakeupTicks;
+    if (other->maxWakeupTicks > maxWakeupTicks)
+	maxWakeupTicks = other->maxWakeupTicks;
+    numShares += other->numShares;
+    shareSum += other->shareSum;
+    shareSumSquares += other->shareSumSquares;
+    if (other->hostStartTime < hostStartTime)
+	hostStartTime = other->hostStartTime;
 }
 
 //----------------------------------------------------------------------
@@ -33,12 +114,32 @@ Statistics::Statistics()
 void
 Statistics::Print()
 {
+    double hostSeconds = HostTime() - hostStartTime;
+
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
+    if (numTLBHits + numTLBMisses > 0)
+	printf("TLB: hits %d, misses %d, miss rate %.2f%%\n", numTLBHits,
+	    numTLBMisses, 100.0 * numTLBMisses / (numTLBHits + numTLBMisses));
+    printf("Timer: interrupts %d\n", numTimerInterrupts);
+    if (numUserStateCopies + numSpaceLoads > 0)
+	printf("Context: user register copies %d, address space loads %d\n",
+	    numUserStateCopies, numSpaceLoads);
+    if (numFutexWaits + numFutexWakes > 0)
+	printf("Futex: waits %d, wakes %d\n", numFutexWaits, numFutexWakes);
+    if (numWakeups > 0)
+	printf("Scheduling: wakeups %d, latency average %.1f, max %d ticks\n",
+	    numWakeups, (double) wakeupTicks / numWakeups, maxWakeupTicks);
+    if (numShares > 0 && shareSumSquares > 0)
+	printf("Fairness: %d threads, Jain index %.3f\n", numShares,
+	    shareSum * shareSum / (numShares * shareSumSquares));
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    if (userTicks > 0 && hostSeconds > 0)
+	printf("Host: %.3f seconds, %.0f user instructions per second\n",
+	    hostSeconds, (userTicks / UserTick) / hostSeconds);
 }
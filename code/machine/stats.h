@@ -33,11 +33,40 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numTLBHits;		// number of translations found in the TLB
+    int numTLBMisses;		// number of translations not in the TLB
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
+    int numTimerInterrupts;	// number of timer interrupts taken
+    int numUserStateCopies;	// number of times a thread's user registers
+				// were copied out of or into the processor
+    int numSpaceLoads;		// number of times an address space was
+				// loaded into the processor
+    int numFutexWaits;		// number of times a user thread slept
+				// on a futex
+    int numFutexWakes;		// number of FutexWake system calls
+
+    int numWakeups;		// number of times a thread was made ready
+				// after blocking (or being created)
+    int wakeupTicks;		// total time from then until it ran
+    int maxWakeupTicks;		// longest such wait
+    int numShares;		// number of threads that finished
+    double shareSum;		// sum, and sum of squares, of the CPU 
+    double shareSumSquares;	// time they used, divided by their weight
+
+    double hostStartTime;	// host time (in seconds) at startup, to
+				// measure simulated instructions per
+				// host second
+
     Statistics(); 		// initialize everything to zero
 
+    void RecordWakeup(int latency);	// a thread waited "latency"
+				// ticks from waking to running
+    void RecordShare(double share);	// a thread finished, having had
+				// "share" weighted ticks of CPU time
+    void Add(Statistics *other);	// add in another CPU's statistics
+
     void Print();		// print collected statistics
 };
 
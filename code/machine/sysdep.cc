@@ -416,6 +416,22 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the wall clock time of the UNIX host, in seconds.  Only
+//	used to measure how fast the simulation itself runs; simulated
+//	time is kept in "stats".
+//----------------------------------------------------------------------
+
+double
+HostTime()
+{
+    struct timeval now;
+
+    (void) gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -470,23 +486,131 @@ Random()
 //
 //	Note: Just return the useful part!
 //
-//	"size" -- amount of useful space needed (in bytes)
+//	The array is mapped directly from the host (rather than with
+//	"new"), so that the boundary pages are page-aligned and can
+//	really be protected.  This takes several system calls, so callers
+//	that allocate often (like thread stacks) should recycle arrays.
+//
+//	"size" -- amount of useful space needed (in bytes), rounded up
+//		to a multiple of the page size
 //----------------------------------------------------------------------
 
 char * 
 AllocBoundedArray(int size)
 {
     int pgSize = getpagesize();
-    char *ptr = new char[pgSize * 2 + size];
+    int length = pgSize * 2 + divRoundUp(size, pgSize) * pgSize;
+    char *ptr = (char *) mmap(NULL, length, PROT_READ | PROT_WRITE, 
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    //mprotect(ptr, pgSize, 0);
-    //mprotect(ptr + pgSize + size, pgSize, 0);
+    ASSERT(ptr != (char *) MAP_FAILED);
+    mprotect(ptr, pgSize, PROT_NONE);
+    mprotect(ptr + length - pgSize, pgSize, PROT_NONE);
     return ptr + pgSize;
 }
 
+//----------------------------------------------------------------------
+// AllocBoundedArrays
+// 	Return many arrays at once, carved out of one mapping from the
+//	host, with a page between each array and the next, and before
+//	the first and after the last, unmapped as in AllocBoundedArray.
+//	The arrays share their guard pages, so "count" arrays take
+//	"count" + 1 guard pages and one call to mmap, where separate
+//	arrays would take 2 * "count" guard pages and "count" mappings.
+//
+//	The host limits how many pieces a process's address space can
+//	be cut into (on Linux, vm.max_map_count, usually 65530), and
+//	each guard page cuts a mapping in two more.  So that mappings
+//	can still be made once there are a great many arrays, only
+//	MaxGuardPages guard pages are ever protected, or fewer if the
+//	host refuses; after that, the arrays are still carved out the
+//	same way, but nothing is left to catch references off their ends.
+//
+//	Returns FALSE if the host has no memory left to map.
+//
+//	"size" -- amount of useful space needed in each array (in bytes),
+//		rounded up to a multiple of the page size
+//	"count" -- how many arrays are needed
+//	"arrays" -- where to put the address of each of them
+//----------------------------------------------------------------------
+
+#define MaxGuardPages	16384		// uses half of Linux's usual limit
+
+static int guardPages = 0;		// how many are protected so far
+
+bool
+AllocBoundedArrays(int size, int count, char **arrays)
+{
+    int pgSize = getpagesize();
+    int stride = pgSize + divRoundUp(size, pgSize) * pgSize;
+    int length = stride * count + pgSize;
+    char *ptr = (char *) mmap(NULL, length, PROT_READ | PROT_WRITE, 
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == (char *) MAP_FAILED)
+	return FALSE;
+    for (int i = 0; i <= count; i++) {
+	if (guardPages < MaxGuardPages) {
+	    if (mprotect(ptr + i * stride, pgSize, PROT_NONE) == 0)
+		guardPages++;
+	    else
+		guardPages = MaxGuardPages;	// the host will take no more
+	}
+	if (i < count)
+	    arrays[i] = ptr + i * stride + pgSize;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DiscardArray
+// 	Give the memory behind an array back to the host, but keep it
+//	mapped.  The array reads as zeroes after this, and memory is
+//	only taken again where it is written.
+//
+//	"ptr" -- the array, which must start on a page, like those of
+//		AllocBoundedArrays
+//	"size" -- how big it is (in bytes); a partial page at the end
+//		is kept
+//----------------------------------------------------------------------
+
+void
+DiscardArray(char *ptr, int size)
+{
+    int pgSize = getpagesize();
+
+    madvise(ptr, divRoundDown(size, pgSize) * pgSize, MADV_DONTNEED);
+}
+
+//----------------------------------------------------------------------
+// AllocCodeArray
+// 	Return an array that can be written, and then executed as host
+//	code: for the binary translator, which generates code for blocks
+//	of user instructions (see bintrans.h).  It stays allocated until
+//	Nachos exits.
+//
+//	Returns NULL if the host does not let us map executable memory
+//	this way (some hosts forbid memory that is both writable and
+//	executable).
+//
+//	"size" -- how many bytes are needed
+//----------------------------------------------------------------------
+
+char *
+AllocCodeArray(int size)
+{
+    char *ptr = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == (char *) MAP_FAILED)
+	return NULL;
+    return ptr;
+}
+
 //----------------------------------------------------------------------
 // DeallocBoundedArray
-// 	Deallocate an array of integers, unprotecting its two boundary pages.
+// 	Deallocate an array allocated by AllocBoundedArray, along with
+//	its two boundary pages.
 //
 //	"ptr" -- the array to be deallocated
 //	"size" -- amount of useful space in the array (in bytes)
@@ -497,7 +621,5 @@ DeallocBoundedArray(char *ptr, int size)
 {
     int pgSize = getpagesize();
 
-    mprotect(ptr - pgSize, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    mprotect(ptr + size, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
-    delete [] (ptr - pgSize);
+    munmap(ptr - pgSize, pgSize * 2 + divRoundUp(size, pgSize) * pgSize);
 }
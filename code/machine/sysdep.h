@@ -43,6 +43,9 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// Wall clock time of the host, for measuring the simulator itself
+extern double HostTime();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
@@ -55,6 +58,14 @@ extern int Random();
 extern char *AllocBoundedArray(int size);
 extern void DeallocBoundedArray(char *p, int size);
 
+// Allocate many such arrays at once, sharing their guard pages, and
+// give the memory of an array back to the host without unmapping it
+extern bool AllocBoundedArrays(int size, int count, char **arrays);
+extern void DiscardArray(char *p, int size);
+
+// Allocate memory that code can be generated into, and run from
+extern char *AllocCodeArray(int size);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
@@ -64,6 +75,8 @@ int abs(int i);
 
 #include <stdio.h>		// for printf, fprintf
 #include <string.h>		// for DEBUG, etc.
+void qsort(void *base, size_t n, size_t size, 
+	   int (*compare)(const void *, const void *));
 }
 
 #endif // SYSDEP_H
@@ -39,31 +39,52 @@ static void TimerHandler(int arg)
 //      "callArg" is the parameter to be passed to the interrupt handler.
 //      "doRandom" -- if true, arrange for the interrupts to occur
 //		at random, instead of fixed, intervals.
+//	"oneShot" -- if true, only interrupt when armed (see Arm)
 //----------------------------------------------------------------------
 
-Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
+Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+		bool oneShot)
 {
     randomize = doRandom;
+    periodic = !oneShot;
     handler = timerHandler;
     arg = callArg; 
+    nextAt = -1;
 
     // schedule the first interrupt from the timer device
-    interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
-		TimerInt); 
+    if (periodic)
+	Arm(TimeOfNextInterrupt());
+}
+
+//----------------------------------------------------------------------
+// Timer::Arm
+//      Program the timer to interrupt "fromNow" ticks from now, 
+//	replacing the interrupt it was going to generate, if any.
+//----------------------------------------------------------------------
+
+void
+Timer::Arm(int fromNow)
+{
+    if (nextAt >= 0)
+	(void) interrupt->Cancel(TimerHandler, (int) this);
+    interrupt->Schedule(TimerHandler, (int) this, fromNow, TimerInt); 
+    nextAt = stats->totalTicks + fromNow;
 }
 
 //----------------------------------------------------------------------
 // Timer::TimerExpired
 //      Routine to simulate the interrupt generated by the hardware 
-//	timer device.  Schedule the next interrupt, and invoke the
-//	interrupt handler.
+//	timer device.  Schedule the next interrupt (unless the timer is
+//	one-shot), and invoke the interrupt handler.
 //----------------------------------------------------------------------
 void 
 Timer::TimerExpired() 
 {
     // schedule the next timer device interrupt
-    interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
-		TimerInt);
+    nextAt = -1;
+    if (periodic)
+	Arm(TimeOfNextInterrupt());
+    stats->numTimerInterrupts++;
 
     // invoke the Nachos interrupt handler for this device
     (*handler)(arg);
@@ -11,6 +11,10 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	A "one-shot" timer instead interrupts only when armed, once, like
+//	the timers tickless kernels program: the kernel decides each time
+//	whether, and when, it needs the next interrupt.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -26,11 +30,18 @@
 // The following class defines a hardware timer. 
 class Timer {
   public:
-    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom);
+    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+		bool oneShot = FALSE);
 				// Initialize the timer, to call the interrupt
-				// handler "timerHandler" every time slice.
+				// handler "timerHandler" every time slice
+				// (or, if "oneShot", when armed).
     ~Timer() {}
 
+    void Arm(int fromNow);	// Interrupt once, "fromNow" ticks from now,
+				// instead of any earlier setting (one-shot)
+    int ArmedAt() { return nextAt; }	// When it will next interrupt,
+				// -1 if it is not armed
+
 // Internal routines to the timer emulation -- DO NOT call these
 
     void TimerExpired();	// called internally when the hardware
@@ -41,6 +52,8 @@ class Timer {
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
+    bool periodic;		// set unless it interrupts only when armed
+    int nextAt;			// when the pending interrupt is due, or -1
     VoidFunctionPtr handler;	// timer interrupt handler 
     int arg;			// argument to pass to interrupt handler
 
@@ -90,27 +90,32 @@ Machine::ReadMem(int addr, int size, int *value)
     int data;
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
     
     DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
     
-    exception = Translate(addr, &physicalAddress, size, FALSE);
-    if (exception != NoException) {
-	machine->RaiseException(exception, addr);
-	return FALSE;
+    hostAddr = SoftTranslate(addr, size, FALSE);
+    if (hostAddr == NULL) {
+	exception = Translate(addr, &physicalAddress, size, FALSE);
+	if (exception != NoException) {
+	    machine->RaiseException(exception, addr);
+	    return FALSE;
+	}
+	hostAddr = &mainMemory[physicalAddress];
     }
     switch (size) {
       case 1:
-	data = machine->mainMemory[physicalAddress];
+	data = *hostAddr;
 	*value = data;
 	break;
 	
       case 2:
-	data = *(unsigned short *) &machine->mainMemory[physicalAddress];
+	data = *(unsigned short *) hostAddr;
 	*value = ShortToHost(data);
 	break;
 	
       case 4:
-	data = *(unsigned int *) &machine->mainMemory[physicalAddress];
+	data = *(unsigned int *) hostAddr;
 	*value = WordToHost(data);
 	break;
 
@@ -139,35 +144,366 @@ Machine::WriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
+    char *hostAddr;
      
     DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
-	machine->RaiseException(exception, addr);
-	return FALSE;
+    hostAddr = SoftTranslate(addr, size, TRUE);
+    if (hostAddr == NULL) {
+	exception = Translate(addr, &physicalAddress, size, TRUE);
+	if (exception != NoException) {
+	    machine->RaiseException(exception, addr);
+	    return FALSE;
+	}
+	hostAddr = &mainMemory[physicalAddress];
     }
+    BreakLinks(hostAddr - mainMemory, size);
     switch (size) {
       case 1:
-	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
+	*hostAddr = (unsigned char) (value & 0xff);
 	break;
 
       case 2:
-	*(unsigned short *) &machine->mainMemory[physicalAddress]
+	*(unsigned short *) hostAddr
 		= ShortToMachine((unsigned short) (value & 0xffff));
 	break;
       
       case 4:
-	*(unsigned int *) &machine->mainMemory[physicalAddress]
+	*(unsigned int *) hostAddr
 		= WordToMachine((unsigned int) value);
 	break;
 	
       default: ASSERT(FALSE);
     }
+    InvalidateDecodedPage((hostAddr - mainMemory) / PageSize);  // if code
     
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::LoadLinked
+// 	Read a word of virtual memory, like ReadMem, for the LL
+//	instruction, and remember its physical address and contents.
+//	A following SC to the same word succeeds only if, in between,
+//	no processor (nor the kernel) wrote to it, and this processor
+//	took no trap and did not switch threads.
+//
+// Returns:
+//	FALSE if the translation failed (the exception has been raised).
+//
+//	"addr" -- the virtual address of the word
+//	"value" -- the place to write the result
+//----------------------------------------------------------------------
+
+bool
+Machine::LoadLinked(int addr, int *value)
+{
+    ExceptionType exception;
+    int physicalAddress;
+
+    DEBUG('a', "Load linked VA 0x%x\n", addr);
+
+    exception = Translate(addr, &physicalAddress, 4, FALSE);
+    if (exception != NoException) {
+	machine->RaiseException(exception, addr);
+	return FALSE;
+    }
+    *value = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+    linkAddr = physicalAddress;
+    linkValue = *value;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::StoreConditional
+// 	Write a word of virtual memory for the SC instruction, if the
+//	link set by the last LL to it is still there.  Either way, the
+//	link is gone afterwards.
+//
+//	With -par, another CPU may write the word between our check of
+//	the link and our store, so the store itself is a host compare and
+//	swap against what the LL read: SC can't overwrite a new value that
+//	the link missed.
+//
+// Returns:
+//	FALSE if the translation failed (the exception has been raised).
+//
+//	"addr" -- the virtual address of the word
+//	"value" -- the word to write; on return, 1 if it was written, 
+//		0 if not
+//----------------------------------------------------------------------
+
+bool
+Machine::StoreConditional(int addr, int *value)
+{
+    ExceptionType exception;
+    int physicalAddress;
+    unsigned int *word;
+    bool stored;
+
+    DEBUG('a', "Store conditional VA 0x%x, value 0x%x\n", addr, *value);
+
+    exception = Translate(addr, &physicalAddress, 4, TRUE);
+    if (exception != NoException) {
+	machine->RaiseException(exception, addr);
+	return FALSE;
+    }
+    word = (unsigned int *) &mainMemory[physicalAddress];
+    stored = (linkAddr == physicalAddress)
+	&& __sync_bool_compare_and_swap(word, WordToMachine(linkValue),
+					WordToMachine((unsigned int) *value));
+    linkAddr = -1;
+    if (stored) {
+	InvalidateDecodedPage(physicalAddress / PageSize);
+	BreakLinks(physicalAddress, 4);		// the other processors'
+    }
+    *value = stored ? 1 : 0;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::BreakLinks
+// 	Some bytes of main memory are about to be written: make any SC
+//	to a word among them fail, on every processor.
+//
+//	"physAddr" -- where the bytes start in main memory
+//	"size" -- how many there are
+//----------------------------------------------------------------------
+
+void
+Machine::BreakLinks(int physAddr, int size)
+{
+    int first = physAddr & ~0x3;
+
+    for (Machine *m = firstProcessor; m != NULL; m = m->nextProcessor)
+	if (m->linkAddr >= first && m->linkAddr < physAddr + size)
+	    m->linkAddr = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::UserToHost
+// 	Translate a user virtual address on behalf of the kernel, for
+//	example to get at a system call argument.  If there is no valid
+//	translation, the page is faulted in once through the exception
+//	handler, just as if the user program had touched it, and the
+//	translation is retried.  An address past the end of the address
+//	space (cf. pageTableSize) is never faulted in: the handlers
+//	expect the fault to be on one of its pages.
+//
+//	Unlike RaiseException, this leaves the machine in system mode,
+//	since we are in the middle of a system call.
+//
+// Returns:
+//	The address of the byte in "mainMemory", or NULL if the user
+//	address is bad.
+//
+//	"virtAddr" -- the user virtual address
+// 	"writing" -- if TRUE, the kernel will store into the page, and
+//		then call InvalidateDecodedPage
+//----------------------------------------------------------------------
+
+char *
+Machine::UserToHost(int virtAddr, bool writing)
+{
+    ExceptionType exception;
+    int physAddr;
+
+    exception = Translate(virtAddr, &physAddr, 1, writing);
+    if (exception == PageFaultException
+		&& (unsigned) virtAddr / PageSize >= pageTableSize)
+	exception = AddressErrorException;
+    if (exception == PageFaultException) {
+	registers[BadVAddrReg] = virtAddr;
+	ExceptionHandler(PageFaultException);
+	exception = Translate(virtAddr, &physAddr, 1, writing);
+    }
+    if (exception != NoException) {
+	DEBUG('a', "Bad user address 0x%x, exception %d\n", virtAddr, exception);
+	return NULL;
+    }
+    if (writing)
+	BreakLinks(physAddr - physAddr % PageSize, PageSize);
+    return &mainMemory[physAddr];
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyFromUser
+// 	Copy a buffer out of user virtual memory into the kernel.  We
+//	translate each page of the buffer once, then copy all of the
+//	bytes in that page.
+//
+// Returns:
+//	TRUE if the whole buffer was copied, FALSE if part of it was
+//	not a valid user address.
+//
+//	"virtAddr" -- where the buffer starts in user virtual memory
+//	"buffer" -- where to copy it in the kernel
+//	"size" -- the number of bytes to copy
+//----------------------------------------------------------------------
+
+bool
+Machine::CopyFromUser(int virtAddr, char *buffer, int size)
+{
+    char *hostAddr;
+    int chunk;
+
+    while (size > 0) {
+	hostAddr = UserToHost(virtAddr, FALSE);
+	if (hostAddr == NULL)
+	    return FALSE;
+	chunk = PageSize - (unsigned) virtAddr % PageSize;
+	if (chunk > size)
+	    chunk = size;
+	bcopy(hostAddr, buffer, chunk);
+	virtAddr += chunk;
+	buffer += chunk;
+	size -= chunk;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyToUser
+// 	Copy a kernel buffer into user virtual memory, a page at a time.
+//
+// Returns:
+//	TRUE if the whole buffer was copied, FALSE if part of the 
+//	destination was not a valid (writable) user address.
+//
+//	"virtAddr" -- where the buffer goes in user virtual memory
+//	"buffer" -- the data in the kernel
+//	"size" -- the number of bytes to copy
+//----------------------------------------------------------------------
+
+bool
+Machine::CopyToUser(int virtAddr, char *buffer, int size)
+{
+    char *hostAddr;
+    int chunk;
+
+    while (size > 0) {
+	hostAddr = UserToHost(virtAddr, TRUE);
+	if (hostAddr == NULL)
+	    return FALSE;
+	chunk = PageSize - (unsigned) virtAddr % PageSize;
+	if (chunk > size)
+	    chunk = size;
+	bcopy(buffer, hostAddr, chunk);
+	InvalidateDecodedPage((hostAddr - mainMemory) / PageSize);
+						// in case it's code
+	virtAddr += chunk;
+	buffer += chunk;
+	size -= chunk;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyStringFromUser
+// 	Copy a null-terminated string (such as a file name) out of user 
+//	virtual memory, a page at a time.
+//
+// Returns:
+//	The length of the string (not counting the null), or -1 if
+//	part of it was not a valid user address, or it doesn't fit.
+//
+//	"virtAddr" -- where the string starts in user virtual memory
+//	"buffer" -- where to copy it in the kernel
+//	"size" -- the size of "buffer"
+//----------------------------------------------------------------------
+
+int
+Machine::CopyStringFromUser(int virtAddr, char *buffer, int size)
+{
+    char *hostAddr, *end;
+    int length = 0, chunk;
+
+    while (length < size) {
+	hostAddr = UserToHost(virtAddr + length, FALSE);
+	if (hostAddr == NULL)
+	    return -1;
+	chunk = PageSize - (unsigned) (virtAddr + length) % PageSize;
+	if (chunk > size - length)
+	    chunk = size - length;
+	end = (char *) memchr(hostAddr, '\0', chunk);
+	if (end != NULL) {			// found the end of the string
+	    bcopy(hostAddr, buffer + length, end - hostAddr + 1);
+	    return length + (end - hostAddr);
+	}
+	bcopy(hostAddr, buffer + length, chunk);
+	length += chunk;
+    }
+    DEBUG('a', "User string at 0x%x is longer than %d\n", virtAddr, size);
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::SoftTranslate
+// 	The fast path of ReadMem and WriteMem.  If the page containing
+//	"virtAddr" is in the translation cache (filled in by Translate),
+//	return where the data lives in host memory, without searching the
+//	TLB or page table.  The use and dirty bits (and, for the TLB, the 
+//	last use time) are set just as Translate would.
+//
+//	Otherwise, or if the access is unaligned or writes a read-only 
+//	page, return NULL; the caller must then use Translate, which will 
+//	raise the appropriate exception.
+//
+//	"virtAddr" -- the virtual address to translate
+//	"size" -- the amount of memory being read or written
+// 	"writing" -- if TRUE, the page must be writable
+//----------------------------------------------------------------------
+
+char *
+Machine::SoftTranslate(int virtAddr, int size, bool writing)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    SoftTLBEntry *soft = &softTLB[vpn % SoftTLBSize];
+    TranslationEntry *entry = soft->entry;
+
+    if (soft->virtualPage != vpn || (virtAddr & (size - 1)) != 0
+		|| (writing && entry->readOnly))
+	return NULL;
+    entry->use = TRUE;
+    if (writing)
+	entry->dirty = TRUE;
+    if (tlb != NULL) {
+	entry->lastUseTime = stats->totalTicks;
+	stats->numTLBHits++;
+    }
+    return soft->hostPage + (unsigned) virtAddr % PageSize;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushSoftTLB
+// 	Empty the translation cache.  Must be called whenever the TLB 
+//	or page table is switched or entries in it are taken away.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushSoftTLB()
+{
+    for (int i = 0; i < SoftTLBSize; i++)
+	softTLB[i].virtualPage = SoftTLBEmpty;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateSoftTLB
+// 	Remove one virtual page from the translation cache, because the
+//	TLB entry it was filled from is about to be replaced.
+//
+//	"vpn" -- the virtual page
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateSoftTLB(unsigned int vpn)
+{
+    SoftTLBEntry *soft = &softTLB[vpn % SoftTLBSize];
+
+    if (soft->virtualPage == vpn)
+	soft->virtualPage = SoftTLBEmpty;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using 
@@ -181,10 +517,12 @@ Machine::WriteMem(int addr, int size, int value)
 //	"physAddr" -- the place to store the physical address
 //	"size" -- the amount of memory being read or written
 // 	"writing" -- if TRUE, check the "read-only" bit in the TLB
+//	"entryPtr" -- if not NULL, where to store the translation entry used
 //----------------------------------------------------------------------
 
 ExceptionType
-Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
+Machine::Translate(int virtAddr, int* physAddr, int size, bool writing,
+		   TranslationEntry **entryPtr)
 {
     int i;
     unsigned int vpn, offset;
@@ -220,13 +558,18 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 	entry = &pageTable[vpn];
     } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
-		entry = &tlb[i];			// FOUND!
+	TranslationEntry *set = TLBSet(vpn, currentASID);
+
+        for (entry = NULL, i = 0; i < tlbWays; i++)
+    	    if (set[i].valid && (set[i].virtualPage == vpn)
+				&& (set[i].asid == currentASID)) {
+		entry = &set[i];			// FOUND!
 		entry->lastUseTime = stats->totalTicks;
+		stats->numTLBHits++;
 		break;
 	    }
 	if (entry == NULL) {				// not found
+	    stats->numTLBMisses++;
     	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
@@ -250,6 +593,15 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     if (writing)
 	entry->dirty = TRUE;
     *physAddr = pageFrame * PageSize + offset;
+    if (entryPtr != NULL)
+	*entryPtr = entry;
+    if (softTLBEnabled) {		// remember it for SoftTranslate
+	SoftTLBEntry *soft = &softTLB[vpn % SoftTLBSize];
+
+	soft->virtualPage = vpn;
+	soft->hostPage = &mainMemory[pageFrame * PageSize];
+	soft->entry = entry;
+    }
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG('a', "phys addr = 0x%x\n", *physAddr);
     return NoException;
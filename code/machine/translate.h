@@ -45,6 +45,9 @@ public:
     bool dirty;         // This bit is set by the hardware every time the
       // page is modified.
     int lastUseTime;
+    int asid;		// In the TLB, the address space the entry belongs
+			// to (with an inverted page table, the thread).
+			// Entries of other address spaces are ignored.
   };
 
 #endif
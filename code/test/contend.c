@@ -0,0 +1,64 @@
+/* contend.c
+ *	Lock contention benchmark for the user-level mutexes and
+ *	condition variables (usync.c).  NumWorkers threads each add one
+ *	to a shared counter Rounds times, holding a mutex.  Every
+ *	YieldEvery rounds a worker yields while holding it, so that the
+ *	others find it locked and have to wait.  They also add one to
+ *	a second counter, holding a spinlock.  Main waits on a
+ *	condition variable for the workers to finish, and exits with 0
+ *	if both counts are right.
+ *
+ *	Compare the "Futex:" line of the statistics, the lock operations
+ *	that needed the kernel, with the NumWorkers * Rounds locks taken:
+ *
+ *		nachos -x ../test/contend
+ */
+
+#include "usync.h"
+
+#define NumWorkers	3
+#define Rounds		1000
+#define YieldEvery	10
+#define StackSize	256
+
+char stacks[NumWorkers][StackSize];
+Mutex lock;
+Spinlock spin;
+CondVar allDone;
+int counter, spinCounter, finished;
+
+void
+Worker()
+{
+    int i;
+
+    for (i = 0; i < Rounds; i++) {
+	MutexLock(&lock);
+	counter++;
+	if (i % YieldEvery == 0)
+	    Yield();
+	MutexUnlock(&lock);
+	SpinLock(&spin);
+	spinCounter++;
+	SpinUnlock(&spin);
+    }
+    MutexLock(&lock);
+    finished++;
+    CondSignal(&allDone);
+    MutexUnlock(&lock);
+}
+
+int
+main()
+{
+    int i;
+
+    for (i = 0; i < NumWorkers; i++)
+	ThreadFork(Worker, stacks[i], StackSize);
+    MutexLock(&lock);
+    while (finished < NumWorkers)
+	CondWait(&allDone, &lock);
+    MutexUnlock(&lock);
+    Exit(counter == NumWorkers * Rounds
+	    && spinCounter == NumWorkers * Rounds ? 0 : 1);
+}
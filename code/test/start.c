@@ -29,6 +29,64 @@ __start:
 	jal	Exit	 /* if we return from main, exit(0) */
 	.end __start
 
+/* -------------------------------------------------------------
+ * CompareAndSwap
+ *	Atomically: if *addr (r4) is old (r5), store replacement (r6)
+ *	there.  Return the value *addr had.
+ *
+ *	The SC fails, and we try again, if anything else wrote to
+ *	*addr since the LL, or we took a trap or lost the CPU.  As on
+ *	the R2000, a loaded register can't be used by the very next
+ *	instruction.
+ * -------------------------------------------------------------
+ */
+
+	.globl CompareAndSwap
+	.ent	CompareAndSwap
+	.set	noreorder
+CompareAndSwap:
+	ll	$2,0($4)
+	nop
+	bne	$2,$5,1f
+	move	$8,$6
+	sc	$8,0($4)
+	beq	$8,$0,CompareAndSwap
+	nop
+1:	j	$31
+	nop
+	.set	reorder
+	.end CompareAndSwap
+
+/* -------------------------------------------------------------
+ * ThreadRoot
+ *	Where threads made by ThreadFork (see usync.c) start.  Fork
+ *	starts them with the forking thread's stack pointer, so first
+ *	switch to the stack ThreadFork set aside in threadStack, then
+ *	call threadFunc, and exit(0) if it returns.  Clearing threadFunc
+ *	tells ThreadFork we have started.
+ * -------------------------------------------------------------
+ */
+
+	.data
+	.globl threadStack
+	.globl threadFunc
+threadStack:
+	.word	0
+threadFunc:
+	.word	0
+	.text
+
+	.globl ThreadRoot
+	.ent	ThreadRoot
+ThreadRoot:
+	lw	$29,threadStack
+	lw	$8,threadFunc
+	sw	$0,threadFunc
+	jalr	$8
+	move	$4,$0
+	jal	Exit
+	.end ThreadRoot
+
 /* -------------------------------------------------------------
  * System call stubs:
  *	Assembly language assist to make system calls to the Nachos kernel.
@@ -130,6 +188,22 @@ Yield:
 	j	$31
 	.end Yield
 
+	.globl FutexWait
+	.ent	FutexWait
+FutexWait:
+	addiu $2,$0,SC_FutexWait
+	syscall
+	j	$31
+	.end FutexWait
+
+	.globl FutexWake
+	.ent	FutexWake
+FutexWake:
+	addiu $2,$0,SC_FutexWake
+	syscall
+	j	$31
+	.end FutexWake
+
 /* dummy function to keep gcc happy */
         .globl  __main
         .ent    __main
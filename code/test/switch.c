@@ -0,0 +1,49 @@
+/* switch.c
+ *	Context switch microbenchmark.  Two threads forked into the same
+ *	address space, and main, yield to each other SwitchRounds times
+ *	each, then main halts.  Compare the host time, and the "Context:"
+ *	line of the statistics, with and without -eager:
+ *
+ *		nachos -x ../test/switch
+ *		nachos -eager -x ../test/switch
+ *
+ *	Forked threads start with main's stack pointer, so the threads
+ *	keep their state in globals rather than on the stack.
+ */
+
+#include "syscall.h"
+
+#define SwitchRounds	10000
+
+int roundsA, roundsB, roundsMain, finished;
+
+void
+PingA()
+{
+    for (roundsA = 0; roundsA < SwitchRounds; roundsA++)
+	Yield();
+    finished++;
+    Exit(0);
+}
+
+void
+PingB()
+{
+    for (roundsB = 0; roundsB < SwitchRounds; roundsB++)
+	Yield();
+    finished++;
+    Exit(0);
+}
+
+int
+main()
+{
+    Fork(PingA);
+    Fork(PingB);
+    for (roundsMain = 0; roundsMain < SwitchRounds; roundsMain++)
+	Yield();
+    while (finished < 2)
+	Yield();
+    Halt();
+    /* not reached */
+}
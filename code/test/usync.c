@@ -0,0 +1,139 @@
+/* usync.c
+ *	User-level threads, spinlocks, mutexes and condition variables,
+ *	built on CompareAndSwap, FutexWait and FutexWake.  See usync.h.
+ *
+ *	The mutex is the second one in Drepper's "Futexes Are Tricky":
+ *	its word is 0 when unlocked, 1 when locked, and 2 when locked with
+ *	(possibly) threads waiting in the kernel.  Only a thread that
+ *	finds it locked sets it to 2 and waits, and only an unlock that
+ *	finds 2 calls FutexWake.
+ */
+
+#include "usync.h"
+
+#define SpinLimit	100	/* tries before SpinLock yields */
+
+extern int threadStack;		/* where ThreadRoot (start.s) finds */
+extern void (*threadFunc)();	/* the new thread's stack and code */
+extern void ThreadRoot();
+
+/* ThreadFork
+ *	Fork a thread that starts in ThreadRoot, and wait for it to
+ *	pick up its stack and function, so that the next ThreadFork
+ *	can't overwrite them.
+ */
+void
+ThreadFork(void (*func)(), char *stack, int size)
+{
+    while (threadFunc != 0)	/* another ThreadFork is starting one */
+	Yield();
+    threadStack = (int) (stack + size - 16);
+    threadFunc = func;
+    Fork(ThreadRoot);
+    while (threadFunc != 0)
+	Yield();
+}
+
+int
+AtomicAdd(int *addr, int delta)
+{
+    int old;
+
+    do {
+	old = *addr;
+    } while (CompareAndSwap(addr, old, old + delta) != old);
+    return old + delta;
+}
+
+/* SpinLock
+ *	Only try the CompareAndSwap when the lock looks free.  After
+ *	SpinLimit tries, yield: the holder may be waiting for our CPU.
+ */
+void
+SpinLock(Spinlock *lock)
+{
+    int tries = 0;
+
+    while (lock->held != 0 || CompareAndSwap(&lock->held, 0, 1) != 0)
+	if (++tries == SpinLimit) {
+	    tries = 0;
+	    Yield();
+	}
+}
+
+void
+SpinUnlock(Spinlock *lock)
+{
+    lock->held = 0;
+}
+
+void
+MutexInit(Mutex *mutex)
+{
+    mutex->state = 0;
+}
+
+void
+MutexLock(Mutex *mutex)
+{
+    int state = CompareAndSwap(&mutex->state, 0, 1);
+
+    while (state != 0) {
+	/* mark it contended, unless it already is, and wait */
+	if (state == 2 || CompareAndSwap(&mutex->state, 1, 2) != 0)
+	    FutexWait(&mutex->state, 2);
+	/* we can't tell whether anyone else is waiting, so take it as
+	 * contended */
+	state = CompareAndSwap(&mutex->state, 0, 2);
+    }
+}
+
+void
+MutexUnlock(Mutex *mutex)
+{
+    if (CompareAndSwap(&mutex->state, 1, 0) != 1) {
+	mutex->state = 0;		/* it was 2: there may be waiters */
+	FutexWake(&mutex->state, 1);
+    }
+}
+
+void
+CondInit(CondVar *cond)
+{
+    cond->sequence = 0;
+    cond->waiters = 0;
+}
+
+/* CondWait
+ *	Note the sequence number before releasing the mutex: if a
+ *	signal comes in between, it changes, and FutexWait returns at
+ *	once instead of missing it.
+ */
+void
+CondWait(CondVar *cond, Mutex *mutex)
+{
+    int sequence;
+
+    AtomicAdd(&cond->waiters, 1);
+    sequence = cond->sequence;
+    MutexUnlock(mutex);
+    FutexWait(&cond->sequence, sequence);
+    AtomicAdd(&cond->waiters, -1);
+    MutexLock(mutex);
+}
+
+void
+CondSignal(CondVar *cond)
+{
+    AtomicAdd(&cond->sequence, 1);
+    if (cond->waiters > 0)
+	FutexWake(&cond->sequence, 1);
+}
+
+void
+CondBroadcast(CondVar *cond)
+{
+    AtomicAdd(&cond->sequence, 1);
+    if (cond->waiters > 0)
+	FutexWake(&cond->sequence, cond->waiters);
+}
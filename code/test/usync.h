@@ -0,0 +1,64 @@
+/* usync.h
+ *	User-level threads and synchronization for Nachos user programs:
+ *	threads with their own stacks, spinlocks, mutexes and condition
+ *	variables.
+ *
+ *	Mutexes and condition variables keep their state in a word of
+ *	user memory, and change it with CompareAndSwap.  A thread only
+ *	enters the kernel when it has to wait (FutexWait), or there may
+ *	be a thread to wake up (FutexWake); an uncontended MutexLock and
+ *	MutexUnlock are a few user instructions each.
+ *
+ *	All of these may be used by the threads of one address space.
+ *	A mutex or condition variable whose words are zero is ready to
+ *	use, so globals need no initialization.
+ */
+
+#ifndef USYNC_H
+#define USYNC_H
+
+#include "syscall.h"
+
+typedef struct {
+    int held;		/* 0 free, 1 held */
+} Spinlock;
+
+typedef struct {
+    int state;		/* 0 unlocked, 1 locked, 2 locked and
+			 * someone may be waiting */
+} Mutex;
+
+typedef struct {
+    int sequence;	/* changed by every signal and broadcast */
+    int waiters;	/* threads in CondWait */
+} CondVar;
+
+/* Fork a thread to run "func" on its own stack, "size" bytes at 
+ * "stack".  The thread exits when "func" returns.
+ */
+void ThreadFork(void (*func)(), char *stack, int size);
+
+/* Atomically add "delta" to *addr, and return the new value. */
+int AtomicAdd(int *addr, int delta);
+
+/* A spinlock never enters the kernel to wait, so it suits short
+ * critical sections, with other CPUs running our threads (-smp).
+ */
+void SpinLock(Spinlock *lock);
+void SpinUnlock(Spinlock *lock);
+
+void MutexInit(Mutex *mutex);
+void MutexLock(Mutex *mutex);
+void MutexUnlock(Mutex *mutex);
+
+/* As with Mesa-style monitors, CondWait releases the mutex, waits for
+ * a signal, and re-acquires it; the caller must check again whatever
+ * it is waiting for.  Signal and Broadcast may be called with or without
+ * the mutex held.
+ */
+void CondInit(CondVar *cond);
+void CondWait(CondVar *cond, Mutex *mutex);
+void CondSignal(CondVar *cond);
+void CondBroadcast(CondVar *cond);
+
+#endif /* USYNC_H */
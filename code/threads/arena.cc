@@ -0,0 +1,162 @@
+// arena.cc
+//	Routines to allocate temporary buffers from a thread's arena.
+//	See arena.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "arena.h"
+
+#define ArenaAlign	8		// every buffer is aligned this much
+
+//----------------------------------------------------------------------
+// ArenaChunk::ArenaChunk
+// 	Get a chunk of memory from the heap, with nothing handed out.
+//
+//	"chunkSize" is how many bytes
+//----------------------------------------------------------------------
+
+ArenaChunk::ArenaChunk(int chunkSize)
+{
+    data = new char[chunkSize];
+    size = chunkSize;
+    used = 0;
+    prev = NULL;
+}
+
+//----------------------------------------------------------------------
+// ArenaChunk::~ArenaChunk
+// 	Give the chunk's memory back to the heap.
+//----------------------------------------------------------------------
+
+ArenaChunk::~ArenaChunk()
+{
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// Arena::Arena
+// 	Initialize an empty arena.  Chunks are only got once it is used,
+//	so threads that never make system calls cost nothing.
+//----------------------------------------------------------------------
+
+Arena::Arena()
+{
+    current = NULL;
+    spare = NULL;
+}
+
+//----------------------------------------------------------------------
+// Arena::~Arena
+// 	De-allocate an arena, and every chunk it got.
+//----------------------------------------------------------------------
+
+Arena::~Arena()
+{
+    ArenaChunk *chunk;
+
+    Reset();
+    while ((chunk = spare) != NULL) {
+	spare = chunk->prev;
+	delete chunk;
+    }
+}
+
+//----------------------------------------------------------------------
+// Arena::Allocate
+// 	Return a buffer from the current chunk, moving on to a spare
+//	chunk (or a new one, from the heap) if it does not fit.  The
+//	space left at the end of the old chunk is wasted until it is
+//	released.
+//
+//	"size" is how many bytes are needed
+//----------------------------------------------------------------------
+
+char *
+Arena::Allocate(int size)
+{
+    ArenaChunk *chunk;
+    char *buffer;
+
+    ASSERT(size >= 0);
+    size = (size + ArenaAlign - 1) & ~(ArenaAlign - 1);
+    if (current == NULL || current->used + size > current->size) {
+	if (spare != NULL && size <= ArenaChunkBytes) {
+	    chunk = spare;
+	    spare = chunk->prev;
+	} else
+	    chunk = new ArenaChunk(max(size, ArenaChunkBytes));
+	chunk->prev = current;
+	current = chunk;
+    }
+    buffer = current->data + current->used;
+    current->used += size;
+    return buffer;
+}
+
+//----------------------------------------------------------------------
+// Arena::Release
+// 	Free every buffer allocated since the arena was at a position:
+//	take the chunks filled since off, keeping those of the usual
+//	size as spares, and go back to where we were in the chunk.
+//
+//	"chunk", "used" -- the position; a NULL "chunk" is the beginning
+//----------------------------------------------------------------------
+
+void
+Arena::Release(ArenaChunk *chunk, int used)
+{
+    ArenaChunk *top;
+
+    while (current != chunk) {
+	ASSERT(current != NULL);	// "chunk" must still be in use
+	top = current;
+	current = top->prev;
+	top->used = 0;
+	if (top->size == ArenaChunkBytes) {
+	    top->prev = spare;
+	    spare = top;
+	} else
+	    delete top;
+    }
+    if (current != NULL)
+	current->used = used;
+}
+
+//----------------------------------------------------------------------
+// Arena::Reset
+// 	Free every buffer in the arena, keeping its chunks for reuse.
+//----------------------------------------------------------------------
+
+void
+Arena::Reset()
+{
+    Release(NULL, 0);
+}
+
+//----------------------------------------------------------------------
+// ArenaMark::ArenaMark
+// 	Remember how much of an arena is in use.
+//
+//	"markedArena" is the arena, usually currentThread->scratch
+//----------------------------------------------------------------------
+
+ArenaMark::ArenaMark(Arena *markedArena)
+{
+    arena = markedArena;
+    chunk = arena->current;
+    used = (chunk != NULL) ? chunk->used : 0;
+}
+
+//----------------------------------------------------------------------
+// ArenaMark::~ArenaMark
+// 	Free whatever was allocated from the arena since the mark was
+//	made.
+//----------------------------------------------------------------------
+
+ArenaMark::~ArenaMark()
+{
+    arena->Release(chunk, used);
+}
@@ -0,0 +1,96 @@
+// arena.h
+//	Data structures for a "bump" arena: memory for the temporary
+//	buffers of a system call or a file operation -- the data being
+//	read or written, the sectors being transferred, copies of file
+//	names -- which is all freed at once when the operation is done.
+//
+//	Allocating just moves a pointer along a chunk of memory, and
+//	nothing is freed one buffer at a time.  Instead, an operation
+//	remembers how much of the arena was in use when it started, with
+//	an ArenaMark, and gives back everything it got since when the
+//	mark goes away:
+//
+//	    {
+//		ArenaMark mark(&currentThread->scratch);
+//		char *buf = currentThread->scratch.Allocate(n);
+//		...
+//	    }				// buf is freed here
+//
+//	Operations can nest (WriteAt calls ReadAt, a system call reads
+//	a file) as long as they release in the opposite order they got
+//	their marks, which ArenaMark's scope ensures.  The system call
+//	handler also resets the arena when each system call returns.
+//
+//	An arena gets memory from the heap a chunk (ArenaChunkBytes) at
+//	a time, and keeps the chunks it is done with for next time, so
+//	once a thread has done its largest operation, it does not go to
+//	the heap again.  A request bigger than a chunk gets a chunk of
+//	its own, which goes back to the heap when it is released.
+//
+//	Every thread has its own arena (Thread::scratch), since a thread
+//	can sleep in the middle of an operation, while others do theirs.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "copyright.h"
+#include "utility.h"
+
+#define ArenaChunkBytes	1024		// memory got from the heap at once
+
+// The following class defines a piece of memory an arena allocates
+// from.  Internal to Arena.
+
+class ArenaChunk {
+  public:
+    ArenaChunk(int chunkSize);		// get "chunkSize" bytes from the heap
+    ~ArenaChunk();
+
+    char *data;				// the memory
+    int size;				// how big it is
+    int used;				// how much of it is handed out
+    ArenaChunk *prev;			// the chunk in use before this one,
+					// or the next spare chunk
+};
+
+// The following class defines a thread's arena.
+
+class Arena {
+  public:
+    Arena();				// initialize an empty arena; no
+					// memory is got until it is used
+    ~Arena();				// give every chunk back to the heap
+
+    char *Allocate(int size);		// Get "size" bytes, aligned, until
+					// the enclosing mark is released
+    void Reset();			// Free everything
+
+  private:
+    ArenaChunk *current;		// the chunk being allocated from,
+					// linked to those filled before it
+    ArenaChunk *spare;			// chunks released, for reuse
+
+    void Release(ArenaChunk *chunk, int used);	// Free everything got
+					// since "chunk" had "used" bytes in use
+    friend class ArenaMark;
+};
+
+// The following class defines how much of an arena was in use when it
+// was created; everything allocated since is freed when it goes away.
+
+class ArenaMark {
+  public:
+    ArenaMark(Arena *markedArena);	// remember the arena's position
+    ~ArenaMark();			// and go back to it
+
+  private:
+    Arena *arena;
+    ArenaChunk *chunk;			// "arena"'s current chunk, and how
+    int used;				// much of it was in use
+};
+
+#endif // ARENA_H
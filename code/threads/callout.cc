@@ -0,0 +1,284 @@
+// callout.cc
+//	Routines to manage kernel timers (callouts) on a hierarchical
+//	timing wheel.
+//
+//	All of these routines run with interrupts disabled: Tick is
+//	called from the timer interrupt handler, and the others turn
+//	interrupts off themselves.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "callout.h"
+#include "system.h"
+
+#define SlotMask	(CalloutSlots - 1)
+#define MaxDelay	((1 << (CalloutBits * CalloutLevels)) - 1)
+
+//----------------------------------------------------------------------
+// Callout::Callout
+// 	Initialize a callout, which is not yet set.
+//
+//	"calloutFunc" is the function to call, with interrupts disabled,
+//		when the callout fires
+//	"calloutArg" is the argument to pass to it
+//----------------------------------------------------------------------
+
+Callout::Callout(VoidFunctionPtr calloutFunc, int calloutArg)
+{
+    func = calloutFunc;
+    arg = calloutArg;
+    expires = 0;
+    next = NULL;
+    link = NULL;
+    wheel = NULL;
+}
+
+//----------------------------------------------------------------------
+// Callout::~Callout
+// 	De-allocate a callout.  If it has not fired yet, it never will.
+//----------------------------------------------------------------------
+
+Callout::~Callout()
+{
+    (void) Cancel();
+}
+
+//----------------------------------------------------------------------
+// Callout::Set
+// 	Arrange for the callout to fire "ticks" from now, on the wheel
+//	of the CPU being simulated.  If it was already set, the earlier
+//	setting is forgotten.
+//
+//	"ticks" is how long to wait, in simulated time
+//----------------------------------------------------------------------
+
+void
+Callout::Set(int ticks)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(ticks >= 0);
+    if (wheel != NULL)
+	wheel->Remove(this);
+    expires = (stats->totalTicks + ticks + CalloutTick - 1) / CalloutTick;
+    callouts->Add(this);
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Callout::Cancel
+// 	Stop the callout from firing, if it has not already.
+//
+// Returns:
+//	TRUE if it was still pending.
+//----------------------------------------------------------------------
+
+bool
+Callout::Cancel()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    bool pending = (wheel != NULL);
+
+    if (pending)
+	wheel->Remove(this);
+
+    (void) interrupt->SetLevel(oldLevel);
+    return pending;
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::CalloutWheel
+// 	Initialize an empty timing wheel for the CPU being simulated,
+//	starting from the current time.
+//----------------------------------------------------------------------
+
+CalloutWheel::CalloutWheel()
+{
+    for (int level = 0; level < CalloutLevels; level++)
+	for (int i = 0; i < CalloutSlots; i++)
+	    slots[level][i] = NULL;
+    interrupts = interrupt;
+    clock = stats;
+    current = clock->totalTicks / CalloutTick;
+    numPending = 0;
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::~CalloutWheel
+// 	De-allocate the wheel.  Any callouts still on it never fire.
+//----------------------------------------------------------------------
+
+CalloutWheel::~CalloutWheel()
+{
+    for (int level = 0; level < CalloutLevels; level++)
+	for (int i = 0; i < CalloutSlots; i++)
+	    while (slots[level][i] != NULL)
+		Remove(slots[level][i]);
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::Insert
+// 	Put a callout in the slot for its jiffy: on the lowest level
+//	whose slots, starting from the current jiffy, reach that far.
+//	A callout that is already due goes in the current jiffy's slot,
+//	one that is too far ahead as far ahead as the wheel goes -- it is
+//	moved again when it gets there, and so never fires early.
+//----------------------------------------------------------------------
+
+void
+CalloutWheel::Insert(Callout *callout)
+{
+    int delay = (int)(callout->expires - current);
+    unsigned when = callout->expires;
+    Callout **slot;
+    int level;
+
+    if (delay < 0) {
+	delay = 0;
+	when = current;
+    } else if (delay > MaxDelay) {
+	delay = MaxDelay;
+	when = current + MaxDelay;
+    }
+    for (level = 0; level < CalloutLevels - 1; level++)
+	if (delay < (1 << (CalloutBits * (level + 1))))
+	    break;
+    slot = &slots[level][(when >> (CalloutBits * level)) & SlotMask];
+
+    callout->next = *slot;
+    if (*slot != NULL)
+	(*slot)->link = &callout->next;
+    callout->link = slot;
+    *slot = callout;
+    callout->wheel = this;
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::Add
+// 	Put a callout on the wheel.  While the wheel has callouts, the
+//	CPU must keep taking timer interrupts, even if it is idle.
+//	Called for the CPU being simulated.
+//----------------------------------------------------------------------
+
+void
+CalloutWheel::Add(Callout *callout)
+{
+    Insert(callout);
+    if (numPending++ == 0)
+	interrupts->WantTimer(TRUE);
+    ArmTimer();				// if tickless, it may be due first
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::Remove
+// 	Take a callout off the wheel.
+//----------------------------------------------------------------------
+
+void
+CalloutWheel::Remove(Callout *callout)
+{
+    ASSERT(callout->wheel == this);
+    *callout->link = callout->next;
+    if (callout->next != NULL)
+	callout->next->link = callout->link;
+    callout->next = NULL;
+    callout->link = NULL;
+    callout->wheel = NULL;
+    if (--numPending == 0)
+	interrupts->WantTimer(FALSE);
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::Cascade
+// 	The slots below "level" have wrapped around: move the callouts in
+//	the current slot of "level" down to the slots they now belong in.
+//----------------------------------------------------------------------
+
+void
+CalloutWheel::Cascade(int level)
+{
+    Callout **slot = &slots[level][(current >> (CalloutBits * level))
+						& SlotMask];
+    Callout *list = *slot, *callout;
+
+    *slot = NULL;
+    while (list != NULL) {
+	callout = list;
+	list = list->next;
+	Insert(callout);
+    }
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::NextDue
+// 	Return the time by which the next timer interrupt must come, for
+//	a tickless kernel: when the first callout on level 0 is due, or
+//	else, if that is earlier, when the first occupied slot of a 
+//	higher level must be cascaded.  (That slot's callouts may be due
+//	later, but we can only tell once they have been cascaded.)
+//
+//	Assumes some callout is pending.
+//----------------------------------------------------------------------
+
+int
+CalloutWheel::NextDue()
+{
+    unsigned first = current + MaxDelay, when, block;
+    int level, i;
+
+    ASSERT(numPending > 0);
+    for (i = 0; i < CalloutSlots; i++)
+	if (slots[0][(current + i) & SlotMask] != NULL) {
+	    first = current + i;
+	    break;
+	}
+    for (level = 1; level < CalloutLevels; level++) {
+	block = current >> (CalloutBits * level);
+	// the slot for the current block was cascaded as we entered it,
+	// so anything in it now is cascaded when it comes round again
+	for (i = 1; i <= CalloutSlots; i++)
+	    if (slots[level][(block + i) & SlotMask] != NULL) {
+		when = (block + i) << (CalloutBits * level);
+		if ((int)(when - current) < (int)(first - current))
+		    first = when;
+		break;
+	    }
+    }
+    return first * CalloutTick;
+}
+
+//----------------------------------------------------------------------
+// CalloutWheel::Tick
+// 	Called from the timer interrupt handler: fire the callouts due
+//	in every jiffy up to now.  A callout set (again) by a function
+//	we call is due no earlier than the next jiffy, so it is not
+//	fired until then.
+//----------------------------------------------------------------------
+
+void
+CalloutWheel::Tick()
+{
+    unsigned now = clock->totalTicks / CalloutTick;
+    Callout *callout;
+    int index, level;
+
+    while ((int)(now - current) >= 0) {
+	index = current & SlotMask;
+	for (level = 1; level < CalloutLevels; level++) {
+	    if (((current >> (CalloutBits * (level - 1))) & SlotMask) != 0)
+		break;			// the level below has not wrapped
+	    Cascade(level);
+	}
+	current++;
+	while ((callout = slots[0][index]) != NULL) {
+	    Remove(callout);
+	    DEBUG('t', "Callout due in jiffy %u fired at %d\n",
+		callout->expires, clock->totalTicks);
+	    (*callout->func)(callout->arg);
+	}
+    }
+}
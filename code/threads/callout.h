@@ -0,0 +1,105 @@
+// callout.h
+//	Data structures for kernel timers ("callouts"): calling a function
+//	once a given amount of simulated time has passed.  Thread::SleepFor
+//	and Condition::Wait with a timeout are built on them.
+//
+//	Callouts are kept on a hierarchical timing wheel, as in Linux and
+//	BSD, driven by the timer interrupt.  Time is counted in "jiffies"
+//	of CalloutTick ticks.  The wheel has CalloutLevels levels of
+//	CalloutSlots slots each; level 0 holds the callouts due in the next
+//	CalloutSlots jiffies, one slot per jiffy, level 1 those due in the
+//	next CalloutSlots^2 jiffies, one slot per CalloutSlots jiffies, and
+//	so on.  Every time level 0 wraps around, the next slot of level 1
+//	is "cascaded", its callouts moved down to where they now belong.
+//	Setting and cancelling a callout take O(1) time, and each timer
+//	interrupt only looks at the slots for the jiffies that have passed.
+//
+//	Each CPU has its own wheel, run by its own timer.  A callout goes
+//	on the wheel of the CPU that sets it, but can be cancelled from
+//	any CPU.  Callouts fire at the first timer interrupt at or after
+//	they are due, so never early, but up to a jiffy (or, with -rs,
+//	a random time slice) late.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CALLOUT_H
+#define CALLOUT_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "interrupt.h"
+#include "stats.h"
+
+#define CalloutTick	TimerTicks	// ticks per jiffy
+#define CalloutBits	6
+#define CalloutSlots	(1 << CalloutBits)	// slots per level
+#define CalloutLevels	4		// so callouts can be set up to
+					// 2^24 jiffies ahead (further ones
+					// are set that far, and reset)
+
+class CalloutWheel;
+
+// The following class defines a callout: a call to (*func)(arg) at some
+// time in the future.  The function is called from the timer interrupt
+// handler, with interrupts disabled, so it must not sleep -- typically
+// it makes a thread ready to run.  A callout may be set again once it
+// has fired (or been cancelled).
+
+class Callout {
+  public:
+    Callout(VoidFunctionPtr calloutFunc, int calloutArg);
+					// initialize a callout, not yet set
+    ~Callout();				// de-allocate it, cancelling it
+					// if it is still pending
+
+    void Set(int ticks);		// Call func(arg) "ticks" from now,
+					// replacing any earlier setting
+    bool Cancel();			// Don't; TRUE if it was pending
+    bool IsPending() { return wheel != NULL; }
+
+  private:
+    VoidFunctionPtr func;		// what to call
+    int arg;				// the argument to pass to "func"
+    unsigned expires;			// the jiffy it is due in
+    Callout *next;			// the next callout in its slot
+    Callout **link;			// what points to it: the slot, or
+					// the previous callout's "next"
+    CalloutWheel *wheel;		// the wheel it is on, NULL if none
+
+    friend class CalloutWheel;
+};
+
+// The following class defines one CPU's timing wheel.
+
+class CalloutWheel {
+  public:
+    CalloutWheel();			// initialize an empty wheel, for
+					// the CPU being simulated
+    ~CalloutWheel();
+
+    void Add(Callout *callout);		// Put a callout in its slot
+    void Remove(Callout *callout);	// Take it off the wheel
+    void Tick();			// Fire the callouts that are due,
+					// called by the timer interrupt
+    int NextDue();			// When the timer must next 
+					// interrupt for us (if any pending)
+    int NumPending() { return numPending; }
+
+  private:
+    Callout *slots[CalloutLevels][CalloutSlots];	// the callouts
+					// in each slot, unsorted
+    unsigned current;			// the next jiffy to run
+    int numPending;			// callouts on the wheel
+    Interrupt *interrupts;		// the CPU's interrupts, kept busy
+    Statistics *clock;			// while callouts are pending, and
+					// its clock
+
+    void Insert(Callout *callout);	// Put a callout in its slot,
+					// without counting it
+    void Cascade(int level);		// Move the callouts in the next
+					// slot of "level" to lower levels
+};
+
+#endif // CALLOUT_H
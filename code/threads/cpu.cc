@@ -0,0 +1,576 @@
+// cpu.cc 
+//	Routines to simulate a multiprocessor: creating the CPUs, 
+//	switching between them, and keeping idle CPUs busy.
+//
+//	See cpu.h for how the simulation works.  These routines assume
+//	that interrupts are disabled, unless noted otherwise.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "cpu.h"
+#include "system.h"
+#include <sched.h>
+
+static void IdleLoop(int which);
+static void *HostCPU(void *arg);
+
+// With host threads (see cpu.h): the kernel lock, and the condition
+// CPUs wait on for the others to catch up, or for work to do.  It is
+// signalled whenever a CPU's time or idleness changes.
+static pthread_mutex_t kernelLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cpuChanged = PTHREAD_COND_INITIALIZER;
+
+//----------------------------------------------------------------------
+// CPUSwitchHandler
+// 	Interrupt handler for the periodic CPU switch interrupt: ask to
+//	let another CPU run, once the handler returns.  If this CPU is 
+//	idle, its idle thread is going to switch anyway.
+//
+//	"which" is the CPU
+//----------------------------------------------------------------------
+
+static void
+CPUSwitchHandler(int which)
+{
+    interrupt->Schedule(CPUSwitchHandler, which, SMPQuantum, CPUSwitchInt);
+    if (interrupt->getStatus() != IdleMode)
+	interrupt->SwitchOnReturn();
+}
+
+//----------------------------------------------------------------------
+// CPU::CPU
+// 	Initialize a CPU from the globals that describe the running CPU:
+//	the interrupts, ready list, timer and callouts, statistics and
+//	processor that Initialize (or StartCPUs) just made for it.  CPU 0 is running
+//	"main"; the other CPUs start out running their idle thread.
+//
+//	"which" is the number of the CPU
+//----------------------------------------------------------------------
+
+CPU::CPU(int which)
+{
+    char *name = new char[16];
+
+    id = which;
+    sprintf(name, "idle %d", which);
+    idleThread = new Thread(name);
+    idleThread->ForkIdle(IdleLoop, which);
+    interruptState = interrupt;
+    readyList = scheduler;
+    timerDevice = timer;
+    calloutWheel = callouts;
+    statistics = stats;
+#ifdef USER_PROGRAM
+    processor = machine;
+#endif
+    idle = (which != 0);
+    inUser = FALSE;
+    numSwitches = numSteals = numWaits = 0;
+
+    interrupt->Schedule(CPUSwitchHandler, which, SMPQuantum, CPUSwitchInt);
+    if (which != 0)
+	currentThread = idleThread;
+    Save();
+}
+
+//----------------------------------------------------------------------
+// CPU::~CPU
+// 	De-allocate a CPU.  Its devices belong to it.
+//----------------------------------------------------------------------
+
+CPU::~CPU()
+{
+    delete statistics;
+    delete timerDevice;
+    delete calloutWheel;
+    delete readyList;
+    delete interruptState;
+}
+
+//----------------------------------------------------------------------
+// CPU::Save
+// 	This CPU is no longer being simulated; save the globals that
+//	change while it is.
+//----------------------------------------------------------------------
+
+void
+CPU::Save()
+{
+    running = currentThread;
+    toBeDestroyed = threadToBeDestroyed;
+}
+
+//----------------------------------------------------------------------
+// CPU::Restore
+// 	Make this CPU the one being simulated, by loading the globals 
+//	from it.  Its running thread's user registers and page table are
+//	restored by the thread itself, once it is switched to.
+//----------------------------------------------------------------------
+
+void
+CPU::Restore()
+{
+    currentThread = running;
+    threadToBeDestroyed = toBeDestroyed;
+    interrupt = interruptState;
+    scheduler = readyList;
+    timer = timerDevice;
+    callouts = calloutWheel;
+    stats = statistics;
+#ifdef USER_PROGRAM
+    machine = processor;
+#endif
+}
+
+//----------------------------------------------------------------------
+// CPU::Time
+// 	Return when this CPU will next do something that the other CPUs
+//	might see: now, if it is busy, otherwise when its next device
+//	interrupt is due (NoInterruptPending if never).  Its clock is 
+//	read while its host thread may be advancing it.
+//----------------------------------------------------------------------
+
+int
+CPU::Time()
+{
+    if (!idle)
+	return *(volatile int *) &statistics->totalTicks;
+    if (interruptState->DevicePending())
+	return interruptState->NextDue();
+    return NoInterruptPending;
+}
+
+//----------------------------------------------------------------------
+// StartCPUs
+// 	Turn the single CPU set up by Initialize into "n" CPUs.  Each
+//	new CPU gets its own interrupts, ready list, timer and callouts,
+//	statistics and processor.
+//
+//	With host threads, we take the kernel lock for the CPU we are
+//	running on (CPU 0), and start a host thread for each other CPU.
+//	They get to run once we release it.
+//
+//	"n" is the number of CPUs
+//	"fairShare" is TRUE if the ready lists are FairSchedulers
+//	"randomYield", "timerHandler" are as for the first CPU's timer
+//	"hostThreads" is TRUE if each CPU gets its own host thread
+//----------------------------------------------------------------------
+
+void
+StartCPUs(int n, bool fairShare, bool randomYield, 
+		VoidFunctionPtr timerHandler, bool hostThreads)
+{
+    int i;
+
+    ASSERT(n > 1);
+    numCPUs = n;
+    cpus = new CPU*[n];
+    cpus[0] = new CPU(0);
+    for (i = 1; i < n; i++) {
+	stats = new Statistics();
+	interrupt = new Interrupt;
+	if (fairShare)
+	    scheduler = new FairScheduler();
+	else
+	    scheduler = new Scheduler();
+	callouts = new CalloutWheel();
+	timer = new Timer(timerHandler, 0, randomYield, tickless);
+#ifdef USER_PROGRAM
+	machine = new Machine(cpus[0]->processor);
+#endif
+	threadToBeDestroyed = NULL;
+	cpus[i] = new CPU(i);
+    }
+    currentCPU = cpus[0];
+    currentCPU->Restore();
+
+    if (hostThreads) {
+	parallelCPUs = TRUE;
+	pthread_mutex_lock(&kernelLock);
+	cpus[0]->host = pthread_self();
+	for (i = 1; i < n; i++)
+	    if (pthread_create(&cpus[i]->host, NULL, HostCPU, cpus[i]) != 0)
+		ASSERT(FALSE);
+    }
+}
+
+//----------------------------------------------------------------------
+// HostCPU
+// 	The body of the host thread simulating a CPU: once it gets the 
+//	kernel lock, switch to the CPU's idle thread.  Never returns.
+//
+//	"arg" is the CPU
+//----------------------------------------------------------------------
+
+static void *
+HostCPU(void *arg)
+{
+    CPU *cpu = (CPU *) arg;
+    Thread *host;
+
+    pthread_mutex_lock(&kernelLock);
+    host = new Thread("host");		// somewhere to save our own
+					// context; never resumed
+    currentCPU = cpu;
+    cpu->Restore();
+    DEBUG('t', "Host thread started for CPU %d\n", cpu->id);
+    SWITCH(host, currentThread);
+    ASSERT(FALSE);			// not reached
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// EnterKernel, LeaveKernel
+// 	With host threads, a CPU holds the kernel lock except while it
+//	runs user instructions.  These are called by the machine 
+//	emulation when it traps into the kernel, or goes back to user 
+//	mode.  Without host threads, they do nothing.
+//
+//	Once "inUser" is FALSE, we no longer look at our TLB or page
+//	table, so StopOtherCPUs can consider us stopped.
+//----------------------------------------------------------------------
+
+void
+EnterKernel()
+{
+    if (!parallelCPUs)
+	return;
+    currentCPU->inUser = FALSE;
+    __sync_synchronize();
+    pthread_mutex_lock(&kernelLock);
+}
+
+void
+LeaveKernel()
+{
+    if (!parallelCPUs)
+	return;
+    currentCPU->inUser = TRUE;
+    pthread_mutex_unlock(&kernelLock);
+}
+
+//----------------------------------------------------------------------
+// StopOtherCPUs
+// 	We are about to change a translation (or physical page) that
+//	another CPU's user program may be using.  Make every CPU that is
+//	running user instructions trap at its next instruction, and wait
+//	until they all have.  They can't go back to user mode until we
+//	release the kernel lock.  Called with the kernel lock held.
+//----------------------------------------------------------------------
+
+void
+StopOtherCPUs()
+{
+    int i;
+
+    if (!parallelCPUs)
+	return;
+    for (i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU && cpus[i]->inUser)
+	    cpus[i]->interruptState->Poke();
+    for (i = 0; i < numCPUs; i++)
+	while (cpus[i] != currentCPU && cpus[i]->inUser)
+	    sched_yield();
+}
+
+//----------------------------------------------------------------------
+// SwitchToCPU
+// 	Stop simulating this CPU, and simulate "next" instead, by
+//	switching to the thread it is running.  Returns when some CPU
+//	switches back to this one.  May be called with interrupts on.
+//
+//	"next" is the CPU to run
+//	"idle" is TRUE if this CPU has nothing to do
+//----------------------------------------------------------------------
+
+static void
+SwitchToCPU(CPU *next, bool idle)
+{
+    Thread *oldThread = currentThread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    DEBUG('t', "Switching from CPU %d to CPU %d\n", currentCPU->id, next->id);
+
+#ifdef USER_PROGRAM
+    // Each CPU has its own registers, and nothing else touches them,
+    // so they need only be saved if we are not switching lazily.
+    if (!Scheduler::lazySwitch && oldThread->space != NULL) {
+	oldThread->SaveUserState();
+	oldThread->space->SaveState();
+    }
+#endif
+    oldThread->CheckOverflow();
+
+    currentCPU->idle = idle;
+    currentCPU->Save();
+    currentCPU = next;
+    next->Restore();
+    next->numSwitches++;
+
+    SWITCH(oldThread, currentThread);	// now running on "next"
+
+    // back on this CPU
+#ifdef USER_PROGRAM
+    if (!Scheduler::lazySwitch && currentThread->space != NULL) {
+	currentThread->RestoreUserState();
+	currentThread->space->RestoreState();
+    }
+#endif
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// OthersTime
+// 	Return the earliest time (see CPU::Time) of the CPUs other than
+//	this one, or NoInterruptPending if none of them has anything to do.
+//----------------------------------------------------------------------
+
+static int
+OthersTime()
+{
+    int when = NoInterruptPending, t;
+
+    for (int i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU && (t = cpus[i]->Time()) < when)
+	    when = t;
+    return when;
+}
+
+//----------------------------------------------------------------------
+// TooFarAhead
+// 	Return TRUE if this CPU, doing something at time "when", would
+//	be more than SMPQuantum ahead of some other CPU (cf. cpu.h).
+//----------------------------------------------------------------------
+
+static bool
+TooFarAhead(int when)
+{
+    int others = OthersTime();
+
+    return others != NoInterruptPending && when > others + SMPQuantum;
+}
+
+//----------------------------------------------------------------------
+// SwitchToNextCPU
+// 	At the end of a CPU's quantum, switch to the CPU whose clock is
+//	furthest behind, if it is behind this one.  Skip idle CPUs, unless
+//	this CPU has work to give away, or they have I/O to finish.
+//
+//	With host threads, the other CPUs are running already; instead,
+//	let them know how far we have got, and wait while we are too far
+//	ahead of any of them.
+//
+//	Called with interrupts on.
+//----------------------------------------------------------------------
+
+void
+SwitchToNextCPU()
+{
+    CPU *next = NULL;
+    bool haveWork = (scheduler->NumReady() > 0);
+
+    if (parallelCPUs) {
+	pthread_cond_broadcast(&cpuChanged);
+	if (TooFarAhead(stats->totalTicks))
+	    currentCPU->numWaits++;
+	while (TooFarAhead(stats->totalTicks))
+	    pthread_cond_wait(&cpuChanged, &kernelLock);
+	return;
+    }
+
+    for (int i = 0; i < numCPUs; i++) {
+	CPU *cpu = cpus[i];
+
+	if (cpu == currentCPU || 
+		cpu->statistics->totalTicks >= stats->totalTicks)
+	    continue;
+	if (cpu->idle && !haveWork && !cpu->interruptState->DevicePending())
+	    continue;
+	if (next == NULL || 
+		cpu->statistics->totalTicks < next->statistics->totalTicks)
+	    next = cpu;
+    }
+    if (next != NULL)
+	SwitchToCPU(next, FALSE);
+}
+
+//----------------------------------------------------------------------
+// StealThread
+// 	Take a ready thread from the CPU with the most ready threads, 
+//	and put it on this CPU's ready list.
+//
+// Returns:
+//	TRUE if there was a thread to take.
+//----------------------------------------------------------------------
+
+static bool
+StealThread()
+{
+    CPU *victim = NULL;
+    Thread *thread;
+
+    for (int i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU && cpus[i]->readyList->NumReady() > 0 &&
+	   (victim == NULL || cpus[i]->readyList->NumReady() > 
+				victim->readyList->NumReady()))
+	    victim = cpus[i];
+    if (victim == NULL)
+	return FALSE;
+
+    thread = victim->readyList->FindNextToRun();
+    DEBUG('t', "CPU %d taking thread \"%s\" from CPU %d\n", currentCPU->id,
+	thread->getName(), victim->id);
+    scheduler->ReadyToRun(thread);
+    currentCPU->numSteals++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// IdleCPU
+// 	This CPU has nothing to run.  If other CPUs are busy, catch up
+//	with the one furthest behind (handling our own interrupts on
+//	the way), take work from the others, or else let it run.  
+//
+//	If every CPU is idle, wait for the next device interrupt, on
+//	whichever CPU it is due first.  If there are none, we are done.
+//----------------------------------------------------------------------
+
+static void
+IdleCPU()
+{
+    CPU *busy = NULL, *next = NULL;
+    int i;
+
+    for (i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU && !cpus[i]->idle && (busy == NULL || 
+	     cpus[i]->statistics->totalTicks < busy->statistics->totalTicks))
+	    busy = cpus[i];
+
+    if (busy != NULL) {
+	if (interrupt->IdleUntil(busy->statistics->totalTicks) || 
+		StealThread())
+	    return;			// maybe now there is something to run
+	SwitchToCPU(busy, TRUE);
+	return;
+    }
+
+    if (StealThread())
+	return;
+    for (i = 0; i < numCPUs; i++)
+	if (cpus[i]->interruptState->DevicePending() && (next == NULL ||
+		cpus[i]->interruptState->NextDue() < 
+				next->interruptState->NextDue()))
+	    next = cpus[i];
+    if (next == NULL) {
+	printf("No threads ready or runnable, and no pending interrupts.\n");
+	printf("Assuming the program completed.\n");
+	interrupt->Halt();
+    }
+    if (next == currentCPU)
+	(void) interrupt->IdleUntil(interrupt->NextDue());
+    else
+	SwitchToCPU(next, TRUE);
+}
+
+//----------------------------------------------------------------------
+// WaitForWork
+// 	With host threads, this CPU has nothing to run.  Take work from
+//	the other CPUs if they have any.  Otherwise, take our next device
+//	interrupt once the other CPUs have caught up with it, or else 
+//	wait for something to change.  If no CPU has anything left to
+//	do, we are done.
+//
+//	Once we have work, catch up with the busy CPUs, as IdleCPU does.
+//----------------------------------------------------------------------
+
+static void
+WaitForWork()
+{
+    int when;
+
+    currentCPU->idle = TRUE;
+    for (;;) {
+	if (scheduler->NumReady() > 0 || StealThread())
+	    break;
+	when = currentCPU->Time();
+	if (when == NoInterruptPending && OthersTime() == NoInterruptPending) {
+	    printf("No threads ready or runnable, and no pending interrupts.\n");
+	    printf("Assuming the program completed.\n");
+	    interrupt->Halt();
+	}
+	if (when != NoInterruptPending && !TooFarAhead(when)) {
+	    (void) interrupt->IdleUntil(when);
+	    continue;
+	}
+	pthread_cond_broadcast(&cpuChanged);
+	pthread_cond_wait(&cpuChanged, &kernelLock);
+    }
+    currentCPU->idle = FALSE;
+
+    when = NoInterruptPending;
+    for (int i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU && !cpus[i]->idle && 
+		cpus[i]->Time() < when)
+	    when = cpus[i]->Time();
+    while (when != NoInterruptPending && stats->totalTicks < when)
+	(void) interrupt->IdleUntil(when);
+    pthread_cond_broadcast(&cpuChanged);
+}
+
+//----------------------------------------------------------------------
+// IdleLoop
+// 	The body of each CPU's idle thread: run any ready thread, 
+//	otherwise idle.  Threads that block switch back here if there 
+//	is nothing else to run (see Thread::Sleep).
+//
+//	"which" is the CPU
+//----------------------------------------------------------------------
+
+static void
+IdleLoop(int which)
+{
+    Thread *nextThread;
+
+    (void) interrupt->SetLevel(IntOff);
+    for (;;) {
+	nextThread = scheduler->FindNextToRun();
+	if (nextThread != NULL) {
+	    currentThread->setStatus(BLOCKED);	// not on any ready list
+	    scheduler->Run(nextThread);		// returns when it sleeps
+	} else if (parallelCPUs)
+	    WaitForWork();
+	else
+	    IdleCPU();
+    }
+}
+
+//----------------------------------------------------------------------
+// PrintCPUStatistics
+// 	Print how each CPU spent its time, then combine their statistics
+//	for Statistics::Print (see Statistics::Add).  With host threads,
+//	stop the other CPUs first, so that their counts hold still.
+//----------------------------------------------------------------------
+
+void
+PrintCPUStatistics()
+{
+    StopOtherCPUs();
+    for (int i = 0; i < numCPUs; i++) {
+	CPU *cpu = cpus[i];
+
+	if (parallelCPUs)
+	    printf("CPU %d: ticks %d, idle %d, waited %d times, "
+		"took %d threads\n", cpu->id, cpu->statistics->totalTicks, 
+		cpu->statistics->idleTicks, cpu->numWaits, cpu->numSteals);
+	else
+	    printf("CPU %d: ticks %d, idle %d, switched to %d times, "
+		"took %d threads\n", cpu->id, cpu->statistics->totalTicks, 
+		cpu->statistics->idleTicks, cpu->numSwitches, cpu->numSteals);
+    }
+    for (int i = 0; i < numCPUs; i++)
+	if (cpus[i] != currentCPU)
+	    stats->Add(cpus[i]->statistics);
+}
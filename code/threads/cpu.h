@@ -0,0 +1,131 @@
+// cpu.h
+//	Data structures to simulate a shared-memory multiprocessor.
+//
+//	Nachos normally simulates a single CPU: the global variables
+//	"currentThread", "scheduler", "interrupt", "timer", "stats" and
+//	"machine" describe it.  With "-smp <n>", there are n simulated
+//	CPUs, each with its own running thread, ready list, interrupts
+//	(and timer), clock and statistics, and user-mode processor
+//	(registers and TLB; main memory is shared).  The globals always
+//	describe the CPU being simulated.
+//
+//	By default only one CPU is simulated at a time.  Every so often
+//	(when interrupts are re-enabled, like a time slice) we switch to
+//	the CPU whose clock is furthest behind, by switching to the thread
+//	it is running.  So, as on a uniprocessor, turning off interrupts
+//	is enough for mutual exclusion in the kernel.
+//
+//	With "-par", each CPU is simulated by its own host thread, and the
+//	globals are per host thread (PerCPU).  The Nachos kernel itself
+//	is not multiprocessor safe, so it runs under a single host mutex,
+//	the kernel lock: a CPU holds it except while it executes user
+//	instructions, or waits (see below).  Those are exactly the places
+//	where the serial simulation may switch CPUs, so kernel code,
+//	including Lock, Semaphore and Condition, still sees the same
+//	interleavings; what runs in parallel is user programs.
+//
+//	A CPU that changes a translation another CPU may be using first
+//	stops every CPU that is executing user instructions (StopOtherCPUs).
+//	They stop between two instructions, waiting for the kernel lock.
+//
+//	Simulated time is kept in step by conservative lookahead.  A CPU's
+//	"time" is its clock, or if it is idle, when its next device
+//	interrupt is due (never, if there is none).  At the end of every
+//	SMPQuantum, a CPU waits until its clock is no more than
+//	SMPQuantum ahead of the time of every other CPU; an idle CPU waits
+//	the same way before taking its next device interrupt.  The CPU
+//	with the earliest time never waits, so there is no deadlock, and
+//	no CPU can see the effects of another's work from more than two
+//	quanta in its future -- the same bound as the serial simulation,
+//	plus the one quantum the check is late by.
+//
+//	Either way, threads are made ready on the CPU that wakes them up.
+//	A CPU with nothing to run switches to its idle thread, which takes
+//	("steals") ready threads from the CPU with the most of them.
+//	Device interrupts are delivered to the CPU that started the I/O.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "thread.h"
+#include "scheduler.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "callout.h"
+#include "stats.h"
+#include <pthread.h>
+
+#ifdef USER_PROGRAM
+#include "machine.h"
+#endif
+
+// How long each CPU runs before we consider switching to another one
+// (or, with host threads, check that it isn't too far ahead).
+// Shorter is more accurate, longer is faster to simulate.
+#define SMPQuantum	(TimerTicks / 4)
+
+// Globals that describe one CPU: each host thread has its own copy.
+// (A Nachos thread that moves to another CPU is resumed by that CPU's
+// host thread, and so sees that CPU's globals.)
+#define PerCPU		__thread
+
+// The following class defines the state of one simulated CPU.
+// While the CPU is being simulated, "running" and "toBeDestroyed" are
+// out of date (see Save and Restore).
+
+class CPU {
+  public:
+    CPU(int which);			// Make a CPU out of the current
+					// globals, plus an idle thread
+    ~CPU();
+
+    void Save();			// Save the globals into this CPU,
+					// when it stops being simulated
+    void Restore();			// Load the globals from this CPU
+    int Time();				// When this CPU will next do
+					// something, for the lookahead
+
+    int id;				// 0 .. numCPUs - 1
+    Thread *idleThread;			// runs when nothing else can
+    Thread *running;			// the thread holding this CPU
+    Thread *toBeDestroyed;		// the thread that just finished here
+    Interrupt *interruptState;		// this CPU's interrupts
+    Scheduler *readyList;		// this CPU's ready threads
+    Timer *timerDevice;			// this CPU's time slice timer
+    CalloutWheel *calloutWheel;		// the kernel timers it runs
+    Statistics *statistics;		// this CPU's clock and counters
+#ifdef USER_PROGRAM
+    Machine *processor;			// this CPU's registers and TLB
+#endif
+    volatile bool idle;			// TRUE if the CPU has nothing to do
+    volatile bool inUser;		// TRUE while its host thread runs
+					// user instructions (-par only)
+    pthread_t host;			// the host thread simulating it
+
+    int numSwitches;			// times this CPU was switched to
+    int numSteals;			// threads it took from other CPUs
+    int numWaits;			// times it waited for the others
+					// to catch up (-par only)
+};
+
+extern void StartCPUs(int n, bool fairShare, bool randomYield,
+		VoidFunctionPtr timerHandler, bool hostThreads);
+					// Create the CPUs, called by
+					// Initialize
+extern void SwitchToNextCPU();		// Let the CPU furthest behind run,
+					// called by Interrupt::OneTick
+extern void PrintCPUStatistics();	// Per-CPU statistics, at halt
+
+extern void EnterKernel();		// Get the kernel lock, leaving
+					// user mode (-par only)
+extern void LeaveKernel();		// Release it, to run user code
+extern void StopOtherCPUs();		// Stop the CPUs running user code,
+					// until we release the kernel lock
+
+#endif // CPU_H
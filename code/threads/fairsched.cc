@@ -0,0 +1,277 @@
+// fairsched.cc 
+//	Routines for the completely fair scheduler: keeping the ready
+//	threads in a tree sorted by virtual runtime, and charging 
+//	the running thread for its time.
+//
+// 	As with the Scheduler, these routines assume that interrupts 
+//	are already disabled.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fairsched.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Before, Height, Fix, RotateLeft, RotateRight, Rebalance, 
+// InsertThread, RemoveFirst, First
+//	Internal routines to maintain an AVL tree of threads, sorted by
+//	(vruntime, fairSeq).  "fairHeight" is the height of the subtree
+//	rooted at a thread; the heights of the two subtrees of any thread 
+//	differ by at most one, so the tree has O(log n) height.
+//----------------------------------------------------------------------
+
+static bool
+Before(Thread *a, Thread *b)
+{
+    return (a->vruntime < b->vruntime) ||
+	(a->vruntime == b->vruntime && a->fairSeq < b->fairSeq);
+}
+
+static int
+Height(Thread *tree)
+{
+    return (tree == NULL) ? 0 : tree->fairHeight;
+}
+
+static void
+Fix(Thread *tree)
+{
+    int left = Height(tree->fairLeft), right = Height(tree->fairRight);
+
+    tree->fairHeight = 1 + ((left > right) ? left : right);
+}
+
+static Thread *
+RotateLeft(Thread *tree)
+{
+    Thread *newRoot = tree->fairRight;
+
+    tree->fairRight = newRoot->fairLeft;
+    newRoot->fairLeft = tree;
+    Fix(tree);
+    Fix(newRoot);
+    return newRoot;
+}
+
+static Thread *
+RotateRight(Thread *tree)
+{
+    Thread *newRoot = tree->fairLeft;
+
+    tree->fairLeft = newRoot->fairRight;
+    newRoot->fairRight = tree;
+    Fix(tree);
+    Fix(newRoot);
+    return newRoot;
+}
+
+static Thread *
+Rebalance(Thread *tree)
+{
+    int balance = Height(tree->fairLeft) - Height(tree->fairRight);
+
+    Fix(tree);
+    if (balance > 1) {				// left side too tall
+	if (Height(tree->fairLeft->fairLeft) < 
+				Height(tree->fairLeft->fairRight))
+	    tree->fairLeft = RotateLeft(tree->fairLeft);
+	return RotateRight(tree);
+    } else if (balance < -1) {			// right side too tall
+	if (Height(tree->fairRight->fairRight) < 
+				Height(tree->fairRight->fairLeft))
+	    tree->fairRight = RotateRight(tree->fairRight);
+	return RotateLeft(tree);
+    }
+    return tree;
+}
+
+static Thread *
+InsertThread(Thread *tree, Thread *thread)
+{
+    if (tree == NULL) {
+	thread->fairLeft = thread->fairRight = NULL;
+	thread->fairHeight = 1;
+	return thread;
+    }
+    if (Before(thread, tree))
+	tree->fairLeft = InsertThread(tree->fairLeft, thread);
+    else
+	tree->fairRight = InsertThread(tree->fairRight, thread);
+    return Rebalance(tree);
+}
+
+static Thread *
+RemoveFirst(Thread *tree)
+{
+    if (tree->fairLeft == NULL)
+	return tree->fairRight;
+    tree->fairLeft = RemoveFirst(tree->fairLeft);
+    return Rebalance(tree);
+}
+
+static Thread *
+First(Thread *tree)
+{
+    if (tree != NULL)
+	while (tree->fairLeft != NULL)
+	    tree = tree->fairLeft;
+    return tree;
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::FairScheduler
+// 	Initialize the tree of ready threads to empty.
+//----------------------------------------------------------------------
+
+FairScheduler::FairScheduler()
+{
+    root = first = NULL;
+    minVruntime = 0;
+    nextSeq = 0;
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::~FairScheduler
+// 	Nothing to de-allocate; the tree is made of the threads.
+//----------------------------------------------------------------------
+
+FairScheduler::~FairScheduler()
+{
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::Insert
+// 	Put a ready thread in the tree.  If it was running (it is 
+//	yielding), first bring its virtual runtime up to date.  If it
+//	is waking up, don't let it keep more than FairSleeperCredit of
+//	the virtual runtime it missed while asleep.
+//
+//	"thread" is the thread to be put on the ready list.
+//	"waking" is TRUE if it was blocked or just created.
+//----------------------------------------------------------------------
+
+void
+FairScheduler::Insert(Thread *thread, bool waking)
+{
+    if (!waking)
+	Account(thread);
+    else if (thread->vruntime < minVruntime - FairSleeperCredit)
+	thread->vruntime = minVruntime - FairSleeperCredit;
+    thread->fairSeq = nextSeq++;
+    root = InsertThread(root, thread);
+    first = First(root);
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::FindNextToRun
+// 	Return the ready thread with the least virtual runtime, or NULL
+//	if there are no ready threads.
+// Side effect:
+//	Thread is removed from the tree.
+//----------------------------------------------------------------------
+
+Thread *
+FairScheduler::FindNextToRun()
+{
+    Thread *thread = first;
+
+    if (thread == NULL)
+	return NULL;
+    root = RemoveFirst(root);
+    first = First(root);
+    numReady--;
+    thread->fairLeft = thread->fairRight = NULL;
+    if (thread->vruntime > minVruntime)
+	minVruntime = thread->vruntime;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::getFirst
+// 	Return the thread FindNextToRun would choose, without removing
+//	it from the tree.
+//----------------------------------------------------------------------
+
+Thread *
+FairScheduler::getFirst()
+{
+    return first;
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::Requeue
+// 	A ready thread's priority changed.  Its weight only affects how
+//	fast its virtual runtime grows from now on, not where it is in
+//	the tree, so there is nothing to do.
+//----------------------------------------------------------------------
+
+void
+FairScheduler::Requeue(Thread *thread)
+{
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::Charged
+// 	Advance a thread's virtual runtime for the CPU time it used:
+//	slower than real time for heavy threads, faster for light ones.
+//
+//	"thread" is the thread that ran
+//	"ticks" is how long it ran
+//----------------------------------------------------------------------
+
+void
+FairScheduler::Charged(Thread *thread, int ticks)
+{
+    thread->vruntime += ticks * NiceZeroWeight / 
+				PriorityWeight(thread->getPriority());
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::ShouldPreempt
+// 	At the end of a time slice, charge the running thread, and 
+//	preempt it if some ready thread has had less virtual runtime.
+//
+//	"current" is the running thread
+//----------------------------------------------------------------------
+
+bool
+FairScheduler::ShouldPreempt(Thread *current)
+{
+    Account(current);
+    return first != NULL && first->vruntime < current->vruntime;
+}
+
+//----------------------------------------------------------------------
+// FairScheduler::Print, FairScheduler::printTSInfo
+// 	Print the ready threads, in the order they would be run.
+//	For debugging.
+//----------------------------------------------------------------------
+
+static void
+PrintTree(Thread *tree, bool info)
+{
+    if (tree == NULL)
+	return;
+    PrintTree(tree->fairLeft, info);
+    if (info)
+	tree->printTSInfo();
+    else
+	tree->Print();
+    PrintTree(tree->fairRight, info);
+}
+
+void
+FairScheduler::Print()
+{
+    printf("Ready tree contents:\n");
+    PrintTree(root, FALSE);
+}
+
+void
+FairScheduler::printTSInfo()
+{
+    PrintTree(root, TRUE);
+}
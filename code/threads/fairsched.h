@@ -0,0 +1,64 @@
+// fairsched.h 
+//	Data structures for a "completely fair" scheduler, in the style
+//	of Linux's CFS.
+//
+//	Instead of running the thread with the best priority, we keep
+//	track of each thread's "virtual runtime": the CPU time it has
+//	used, scaled down by its weight (see Scheduler::PriorityWeight).
+//	The ready thread that has had the least virtual runtime runs
+//	next, so over time every thread gets CPU time in proportion to 
+//	its weight.  The ready threads are kept in a balanced (AVL) tree
+//	sorted by virtual runtime, linked through fields in the Thread.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FAIRSCHED_H
+#define FAIRSCHED_H
+
+#include "copyright.h"
+#include "scheduler.h"
+#include "stats.h"
+
+// A thread that wakes up after sleeping for a long time gets at most
+// this much virtual runtime less than the threads that kept running,
+// so that it runs soon, but cannot then monopolize the CPU.
+
+#define FairSleeperCredit	TimerTicks
+
+// The following class defines the fair scheduler.  It only replaces
+// the way the ready threads are kept and chosen; dispatching is done
+// by Scheduler::Run as before.
+
+class FairScheduler : public Scheduler {
+  public:
+    FairScheduler();			// Initialize the tree of ready threads
+    ~FairScheduler();
+
+    Thread* FindNextToRun();		// Remove and return the thread with
+					// the least virtual runtime
+    void Print();			// Print the ready threads, in order
+    void printTSInfo();
+    Thread* getFirst();			// The thread FindNextToRun would
+					// return
+    void Requeue(Thread* thread);	// Priority changed, nothing to do
+    bool ShouldPreempt(Thread* current);	// Has "current" run ahead
+					// of some ready thread?
+
+  protected:
+    void Insert(Thread* thread, bool waking);	// Put a thread in the tree
+    void Charged(Thread* thread, int ticks);	// Advance its virtual
+					// runtime
+
+  private:
+    Thread *root;			// tree of ready threads
+    Thread *first;			// its leftmost thread, or NULL
+    int minVruntime;			// the least virtual runtime of 
+					// any thread chosen to run; only 
+					// ever increases
+    int nextSeq;			// to keep threads with equal virtual
+					// runtime in FIFO order
+};
+
+#endif // FAIRSCHED_H
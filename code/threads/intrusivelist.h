@@ -0,0 +1,221 @@
+// intrusivelist.h
+//	Data structures for "intrusive" lists: doubly linked lists whose
+//	links are fields of the objects on them.  Unlike List, which
+//	allocates a ListElement for every item and stores it as a "void *",
+//	putting an object on an intrusive list never allocates memory,
+//	an object can be taken off from the middle in O(1) time, and the
+//	list knows the type of its objects, so callers need no casts.
+//
+//	The object's class has a ListLink for each list it can be on at
+//	the same time, and the list is told which link to use:
+//
+//	    class Thread {
+//		...
+//		ListLink<Thread> waitLink;
+//	    };
+//
+//	    IntrusiveList<Thread, &Thread::waitLink> waiters;
+//
+//	An object can only be on one list through a given link at a time.
+//	The lists do not own their objects: nothing is de-allocated when
+//	an object is removed, or a list is.
+//
+//	SortedIntrusiveList keeps its objects in increasing order of a
+//	key (kept in the link), like List's SortedInsert and SortedRemove.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef INTRUSIVELIST_H
+#define INTRUSIVELIST_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines the links embedded in an object, to put
+// it on one list.  Only meaningful while the object is on the list.
+
+template <class T>
+class ListLink {
+  public:
+    ListLink() { next = prev = NULL; key = 0; }
+
+    T *next;			// the next object on the list, NULL if last
+    T *prev;			// the previous object, NULL if first
+    int key;			// its priority, on a sorted list
+};
+
+// The following class defines a list of objects of type T, linked
+// through their field "Link".
+
+template <class T, ListLink<T> T::*Link>
+class IntrusiveList {
+  public:
+    IntrusiveList() { first = last = NULL; }	// initialize the list
+
+    void Prepend(T *item) { InsertAfter(NULL, item); }
+				// Put item at the beginning of the list
+    void Append(T *item) { InsertAfter(last, item); }
+				// Put item at the end of the list
+    T *Remove();		// Take the first item off the list, NULL
+				// if it is empty
+    void Remove(T *item);	// Take "item", which is on the list, off
+
+    bool IsEmpty() { return first == NULL; }
+    T *First() { return first; }
+    static T *Next(T *item) { return (item->*Link).next; }
+				// Walk the list: for (T *p = First();
+				// p != NULL; p = Next(p))
+    void Mapcar(void (*func)(T *item));	// Apply "func" to every item
+
+  protected:
+    T *first;			// head of the list, NULL if it is empty
+    T *last;			// last item on the list
+
+    void InsertAfter(T *prev, T *item);	// Link "item" in after "prev",
+				// or at the beginning if "prev" is NULL
+};
+
+// The following class defines a list of objects kept in increasing
+// order of a key.  Objects with equal keys stay in the order they
+// were inserted.  Prepend and Append must not be used on it.
+
+template <class T, ListLink<T> T::*Link>
+class SortedIntrusiveList : public IntrusiveList<T, Link> {
+  public:
+    void SortedInsert(T *item, int sortKey);	// Put item on the list,
+				// after the items with keys <= "sortKey"
+    T *SortedRemove(int *keyPtr);	// Take the first item off the
+				// list, and set *keyPtr to its key
+};
+
+//----------------------------------------------------------------------
+// IntrusiveList::InsertAfter
+// 	Link an item into the list after "prev" (which is on the list),
+//	or at the beginning if "prev" is NULL.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+IntrusiveList<T, Link>::InsertAfter(T *prev, T *item)
+{
+    ListLink<T> *link = &(item->*Link);
+
+    link->prev = prev;
+    link->next = (prev == NULL) ? first : (prev->*Link).next;
+    if (prev == NULL)
+	first = item;
+    else
+	(prev->*Link).next = item;
+    if (link->next == NULL)
+	last = item;
+    else
+	(link->next->*Link).prev = item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Remove
+// 	Take the first item off the front of the list.
+//
+// Returns:
+//	The item, or NULL if the list was empty.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+T *
+IntrusiveList<T, Link>::Remove()
+{
+    T *item = first;
+
+    if (item != NULL)
+	Remove(item);
+    return item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Remove
+// 	Unlink an item from anywhere on the list.  It must be on this
+//	list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+IntrusiveList<T, Link>::Remove(T *item)
+{
+    ListLink<T> *link = &(item->*Link);
+
+    ASSERT(link->prev != NULL || first == item);
+    if (link->prev == NULL)
+	first = link->next;
+    else
+	(link->prev->*Link).next = link->next;
+    if (link->next == NULL)
+	last = link->prev;
+    else
+	(link->next->*Link).prev = link->prev;
+    link->next = link->prev = NULL;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList::Mapcar
+// 	Apply a function to each item on the list, in order.  The
+//	function may take the item it is given off the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+IntrusiveList<T, Link>::Mapcar(void (*func)(T *item))
+{
+    T *item, *next;
+
+    for (item = first; item != NULL; item = next) {
+	next = (item->*Link).next;
+	(*func)(item);
+    }
+}
+
+//----------------------------------------------------------------------
+// SortedIntrusiveList::SortedInsert
+// 	Insert an item into the list, after every item with a smaller or
+//	equal key.  We search from the end, since items are most often
+//	inserted in order.
+//
+//	"item" is the object to put on the list
+//	"sortKey" is its priority
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+SortedIntrusiveList<T, Link>::SortedInsert(T *item, int sortKey)
+{
+    T *prev = this->last;
+
+    while (prev != NULL && (prev->*Link).key > sortKey)
+	prev = (prev->*Link).prev;
+    (item->*Link).key = sortKey;
+    this->InsertAfter(prev, item);
+}
+
+//----------------------------------------------------------------------
+// SortedIntrusiveList::SortedRemove
+// 	Take the first (lowest key) item off the list.
+//
+// Returns:
+//	The item, or NULL if the list was empty.
+//
+//	"keyPtr" is where to put its key, if it is not NULL
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+T *
+SortedIntrusiveList<T, Link>::SortedRemove(int *keyPtr)
+{
+    T *item = this->Remove();
+
+    if (item != NULL && keyPtr != NULL)
+	*keyPtr = (item->*Link).key;
+    return item;
+}
+
+#endif // INTRUSIVELIST_H
@@ -18,6 +18,8 @@
 #include "copyright.h"
 #include "list.h"
 
+SlabCache ListElement::cache("ListElement", sizeof(ListElement));
+
 //----------------------------------------------------------------------
 // ListElement::ListElement
 // 	Initialize a list element, so it can be added somewhere on a list.
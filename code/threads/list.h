@@ -15,6 +15,7 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "slab.h"
 
 // The following class defines a "list element" -- which is
 // used to keep track of one item on a list.  It is equivalent to a
@@ -28,10 +29,18 @@ class ListElement {
    public:
      ListElement(void *itemPtr, int sortKey);	// initialize a list element
 
+     void *operator new(size_t size) { return cache.Allocate(size); }
+     void operator delete(void *element) { cache.Free(element); }
+				// one is allocated for every item put
+				// on a list, so keep them in a cache
+
      ListElement *next;		// next element on list, 
 				// NULL if this is the last
      int key;		    	// priority, for a sorted list
      void *item; 	    	// pointer to item on the list
+
+   private:
+     static SlabCache cache;	// free list elements
 };
 
 // The following class defines a "list" -- a singly linked list of
@@ -8,8 +8,10 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+// Usage: nachos -d <debugflags> -rs <random seed #> -cfs -smp <#CPUs> -par
+//		-fifo -tickless -ps <format>
+//		-s -bt -tc -eager -tlb <entries> <ways> -tlbp <policy>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
@@ -18,10 +20,35 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -cfs schedules threads by fair share of the CPU (weighted by
+//	priority), instead of by priority
+//    -smp simulates a multiprocessor with the given number of CPUs
+//    -par simulates each of those CPUs on its own host thread, so that
+//	user programs run in parallel
+//    -fifo wakes threads waiting on a semaphore, lock or condition in
+//	the order they started waiting, instead of best priority first
+//    -tickless only has the timer interrupt when another thread is
+//	waiting for the CPU, or a kernel timer is due, instead of every
+//	time slice
+//    -ps prints, at halt, where each thread's time went: CPU time, time
+//	ready and blocked, context switches, and run-queue latencies;
+//	as a table, or with "csv", as comma-separated values
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -bt runs user programs a basic block at a time, translated into
+//	host code (on i386 hosts; elsewhere, or when tracing, from
+//	predecoded instructions), instead of interpreting each instruction
+//    -tc is like -bt, but dispatches each instruction through threaded
+//	code instead of a switch statement
+//    -eager saves and restores the user registers and address space
+//	on every context switch, instead of only when another user
+//	thread needs the CPU
+//    -tlb sets the number of TLB entries, and how many entries are in
+//	each set (the associativity); by default 4 entries, fully associative
+//    -tlbp sets the TLB replacement policy: fifo, lru (the default),
+//	random or clock
 //    -x runs a user program
 //    -c tests the console
 //
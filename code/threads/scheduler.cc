@@ -11,8 +11,8 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Threads are chosen by dynamic priority (see scheduler.h), FIFO
+//	among threads of the same priority level.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,30 +22,174 @@
 #include "scheduler.h"
 #include "system.h"
 
+bool Scheduler::lazySwitch = TRUE;
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the queues of ready but not running threads to empty.
 //----------------------------------------------------------------------
 
 Scheduler::Scheduler()
 { 
-    readyList = new List; 
+    for (int i = 0; i < NumMaskWords; i++)
+	readyMask[i] = 0;
+    runStart = runUserStart = 0;
+    numReady = 0;
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the ready queues.  The threads on them are not
+//	ours to delete.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
 } 
 
+//----------------------------------------------------------------------
+// Scheduler::PriorityLevel
+// 	Map a dynamic priority onto a ready queue level, preserving
+//	order.  Priorities below 16 get a level each; above that, each
+//	power of two is split into two levels by its next highest bit.
+//
+//	"dynamicPriority" is the priority, in [0, 100000000]
+//----------------------------------------------------------------------
+
+int
+Scheduler::PriorityLevel(int dynamicPriority)
+{
+    int log, level;
+
+    if (dynamicPriority < 16)
+	return (dynamicPriority < 0) ? 0 : dynamicPriority;
+    log = (BitsPerMaskWord - 1) - __builtin_clz(dynamicPriority);
+    level = 16 + 2 * (log - 4) + ((dynamicPriority >> (log - 1)) & 1);
+    return (level < NumReadyLevels) ? level : NumReadyLevels - 1;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PriorityWeight
+// 	Return the weight of a priority: how large a share of the CPU
+//	a thread of that priority deserves, relative to one of the
+//	default priority (which gets NiceZeroWeight).  The same table as
+//	Linux uses for nice values -8 through 7.
+//
+//	"priority" is the priority, in [0, 15]
+//----------------------------------------------------------------------
+
+int
+Scheduler::PriorityWeight(int priority)
+{
+    static int weights[16] = {
+	6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423, 335, 272, 215
+    };
+
+    ASSERT(priority >= 0 && priority < 16);
+    return weights[priority];
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Account
+// 	Charge the running thread for the CPU time it used since it was
+//	last charged.  Time is measured on the busy clock -- total ticks
+//	less idle ticks -- so that a thread is not charged for time the
+//	CPU spent idle after it went to sleep.  The user ticks among 
+//	them are those the user clock advanced by.
+//
+//	"thread" is the running (or just stopped) thread
+//----------------------------------------------------------------------
+
+void
+Scheduler::Account(Thread *thread)
+{
+    int now = stats->totalTicks - stats->idleTicks;
+    int ticks = now - runStart;
+    int userTicks = stats->userTicks - runUserStart;
+
+    runStart = now;
+    runUserStart = stats->userTicks;
+    if (ticks > 0) {
+	thread->account.userTicks += userTicks;
+	thread->account.systemTicks += ticks - userTicks;
+	thread->cpuTicks += ticks;
+	Charged(thread, ticks);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Enqueue
+// 	Put a thread at the end of the queue for its dynamic priority,
+//	and remember which queue that was, so that Dequeue can find it
+//	even if the priority changes in the meantime.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Enqueue(Thread *thread)
+{
+    int level = PriorityLevel(thread->getDynamicPriority());
+
+    thread->readyLevel = level;
+    readyQueue[level].Append(thread);
+    readyMask[level / BitsPerMaskWord] |= 1u << (level % BitsPerMaskWord);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Dequeue
+// 	Unlink a thread from whichever ready queue it is on.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Dequeue(Thread *thread)
+{
+    int level = thread->readyLevel;
+
+    ASSERT(level >= 0 && level < NumReadyLevels);
+    readyQueue[level].Remove(thread);
+    if (readyQueue[level].IsEmpty())
+	readyMask[level / BitsPerMaskWord] &= 
+				~(1u << (level % BitsPerMaskWord));
+    thread->readyLevel = -1;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FirstLevel
+// 	Return the lowest-numbered non-empty level, or -1 if no thread
+//	is ready.
+//----------------------------------------------------------------------
+
+int
+Scheduler::FirstLevel()
+{
+    for (int i = 0; i < NumMaskWords; i++)
+	if (readyMask[i] != 0)
+	    return i * BitsPerMaskWord + __builtin_ctz(readyMask[i]);
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Elapsed
+// 	Return the time since "since", for a thread's accounting.  A thread
+//	that moved to another CPU may find that CPU's clock behind the one
+//	it left, so count that as no time.
+//----------------------------------------------------------------------
+
+static int
+Elapsed(int since)
+{
+    return (stats->totalTicks > since) ? stats->totalTicks - since : 0;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
+//	If it is waking up, note the time, to measure how long it
+//	waits to be run; in any case, account for the time since it 
+//	last changed state (unless it is only moving to another CPU's
+//	ready list).  In tickless mode, the running thread may now
+//	need a time slice.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -53,10 +197,38 @@ Scheduler::~Scheduler()
 void
 Scheduler::ReadyToRun (Thread *thread)
 {
+    bool waking = (thread->getStatus() != RUNNING);
+
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
+    if (waking && thread->wakeTime < 0)	// (a ready thread moving to 
+	thread->wakeTime = stats->totalTicks;	// another CPU keeps its time)
+    if (thread->getStatus() != READY) {
+	if (thread->getStatus() == BLOCKED)
+	    thread->account.blockedTicks += Elapsed(thread->account.since);
+	thread->account.since = stats->totalTicks;
+    }
     thread->setStatus(READY);
-    readyList->SortedInsert((void *)thread, thread->getDynamicPriority());
+    thread->readyOn = this;
+    numReady++;
+    Insert(thread, waking);
+    if (this == scheduler)
+	ArmTimer();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Insert
+// 	Put a ready thread on the queue for its priority level.
+//	Threads of the same priority level run in FIFO order.
+//
+//	"thread" is the thread to be put on the ready list.
+//	"waking" is unused by this policy.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Insert (Thread *thread, bool waking)
+{
+    Enqueue(thread);
 }
 
 //----------------------------------------------------------------------
@@ -70,7 +242,47 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    Thread *thread = getFirst();
+
+    if (thread != NULL) {
+	Dequeue(thread);
+	numReady--;
+    }
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Requeue
+// 	Move a thread that is on the ready list to the queue for its 
+//	current dynamic priority, e.g. after its priority was changed.
+//	It goes to the end of that queue.
+//
+//	"thread" is the ready thread
+//----------------------------------------------------------------------
+
+void
+Scheduler::Requeue (Thread *thread)
+{
+    Dequeue(thread);
+    Enqueue(thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ShouldPreempt
+// 	Decide, at the end of a time slice, whether the running thread
+//	should yield: only if a ready thread has a better (lower)
+//	dynamic priority.
+//
+//	"current" is the running thread
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ShouldPreempt (Thread *current)
+{
+    Thread *pendingThread = getFirst();
+
+    return pendingThread != NULL && 
+	pendingThread->getDynamicPriority() < current->getDynamicPriority();
 }
 
 //----------------------------------------------------------------------
@@ -81,6 +293,15 @@ Scheduler::FindNextToRun ()
 //
 //      Note: we assume the state of the previously running thread has
 //	already been changed from running to blocked or ready (depending).
+//	That tells us whether it gave up the CPU voluntarily (by 
+//	blocking), for its accounting; the next thread's accounting
+//	gets the time it spent on the ready list.
+//
+//	A user thread's registers are left in the processor when it
+//	stops (unless -eager), and only saved when another user thread
+//	is about to run here: switching to a kernel thread and back 
+//	copies nothing.  Likewise, its address space is only restored
+//	if some other one was loaded since.
 // Side effect:
 //	The global variable currentThread becomes nextThread.
 //
@@ -93,14 +314,39 @@ Scheduler::Run (Thread *nextThread)
     Thread *oldThread = currentThread;
     
 #ifdef USER_PROGRAM			// ignore until running user programs 
-    if (currentThread->space != NULL) {	// if this thread is a user program,
-        currentThread->SaveUserState(); // save the user's CPU registers
-	currentThread->space->SaveState();
+    machine->ClearLink();		// an SC after the switch must fail
+    if (!lazySwitch) {
+	if (oldThread->space != NULL) {	// if this thread is a user program,
+	    oldThread->SaveUserState();	// save the user's CPU registers
+	    oldThread->space->SaveState();
+	}
+    } else {
+	if (oldThread->space != NULL) {	// leave its registers here, in
+	    oldThread->LeaveUserState();	// case it runs next on this CPU
+	    if (oldThread->space != nextThread->space)
+		oldThread->space->SaveState();
+	}
+	if (nextThread->space != NULL)	// unless the next thread runs only
+	    nextThread->MakeRoomForUserState();	// in the kernel
     }
 #endif
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
+    Account(oldThread);			    // charge it for its CPU time
+
+    if (nextThread->wakeTime >= 0) {	    // how long did it wait to run?
+	stats->RecordWakeup(stats->totalTicks - nextThread->wakeTime);
+	nextThread->wakeTime = -1;
+    }
+    if (oldThread->getStatus() == BLOCKED) {	// it chose to stop
+	oldThread->account.voluntarySwitches++;
+	oldThread->account.since = stats->totalTicks;
+    } else if (oldThread->getStatus() == READY)	// (ReadyToRun noted
+	oldThread->account.involuntarySwitches++;	// the time)
+    nextThread->account.readyTicks += Elapsed(nextThread->account.since);
+    nextThread->account.RecordLatency(Elapsed(nextThread->account.since));
+    nextThread->account.since = stats->totalTicks;
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
@@ -124,6 +370,9 @@ Scheduler::Run (Thread *nextThread)
     if (threadToBeDestroyed != NULL &&!deleting) {
         DEBUG('t', "Begin deleting thread %s...\n", threadToBeDestroyed->getName());
         deleting = TRUE;
+        stats->RecordShare(threadToBeDestroyed->cpuTicks * 
+                (double) NiceZeroWeight / 
+                PriorityWeight(threadToBeDestroyed->getPriority()));
         delete threadToBeDestroyed;
         threadToBeDestroyed = NULL;
         deleting = FALSE;
@@ -132,8 +381,10 @@ Scheduler::Run (Thread *nextThread)
     
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
-        currentThread->RestoreUserState();     // to restore, do it.
-	currentThread->space->RestoreState();
+	if (!lazySwitch || !currentThread->UserStateLoaded())
+	    currentThread->RestoreUserState();	// to restore, do it.
+	if (!lazySwitch || !currentThread->space->IsLoaded())
+	    currentThread->space->RestoreState();
     }
 #endif
 }
@@ -147,22 +398,23 @@ void
 Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    for (int i = 0; i < NumReadyLevels; i++)
+	for (Thread *t = readyQueue[i].First(); t != NULL; 
+				t = ReadyQueue::Next(t))
+	    t->Print();
 }
 
 void Scheduler::printTSInfo() {
-    ListElement *nextToPrint = readyList->getFirst();
-    while(nextToPrint != NULL) {
-        Thread *threadToPrint = (Thread*)nextToPrint->item;
-        threadToPrint->printTSInfo();
-        nextToPrint = nextToPrint->next;
-    }
+    for (int i = 0; i < NumReadyLevels; i++)
+        for (Thread *t = readyQueue[i].First(); t != NULL; 
+				t = ReadyQueue::Next(t))
+            t->printTSInfo();
 }
 
 Thread* Scheduler::getFirst() {
-    ListElement *first = readyList->getFirst();
-    if(first == NULL)
+    int level = FirstLevel();
+    if(level < 0)
         return NULL;
     else
-        return (Thread*)first->item;
-}
\ No newline at end of file
+        return readyQueue[level].First();
+}
@@ -10,29 +10,99 @@
 #define SCHEDULER_H
 
 #include "copyright.h"
-#include "list.h"
+#include "intrusivelist.h"
 #include "thread.h"
 
+// The ready threads are kept in one FIFO queue per priority level, 
+// with a bitmap recording which levels are non-empty, so that making a
+// thread ready, choosing the next thread, and moving a ready thread to
+// another level all take constant time.  Level 0 is run first.
+//
+// Dynamic priorities (smaller is better) are mapped onto the levels 
+// by Scheduler::PriorityLevel: exactly below 16, and with two levels 
+// per power of two above that, enough to cover the whole range
+// of Thread::UpdateDynamicPriority.
+
+#define NumReadyLevels	64
+#define BitsPerMaskWord	32
+#define NumMaskWords	(NumReadyLevels / BitsPerMaskWord)
+
+typedef IntrusiveList<Thread, &Thread::readyLink> ReadyQueue;
+
+// Threads get a share of the CPU in proportion to their weight, when
+// fair sharing is measured (and when it is enforced, by FairScheduler).
+// Priority 8, the default, has weight NiceZeroWeight; each step
+// of priority changes the weight by about 25%.
+
+#define NiceZeroWeight	1024
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
+//
+// Other scheduling policies (see fairsched.h) are subclasses, which 
+// replace the ready list by overriding the virtual routines.
 
 class Scheduler {
   public:
     Scheduler();			// Initialize list of ready threads 
-    ~Scheduler();			// De-allocate ready list
+    virtual ~Scheduler();		// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
-    Thread* FindNextToRun();		// Dequeue first thread on the ready 
+    virtual Thread* FindNextToRun();	// Dequeue first thread on the ready 
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
-    void Print();			// Print contents of ready list
-    void printTSInfo();
-    Thread* getFirst();
+    virtual void Print();		// Print contents of ready list
+    virtual void printTSInfo();
+    virtual Thread* getFirst();		// The thread FindNextToRun would
+					// return, left on the ready list
+    virtual void Requeue(Thread* thread);	// Move a ready thread to the 
+					// level of its (changed) priority
+    virtual bool ShouldPreempt(Thread* current);	// Called on each
+					// time slice: should "current" 
+					// yield to a ready thread?
+    int NumReady() { return numReady; }	// How many threads are ready
     
+    static int PriorityLevel(int dynamicPriority);
+					// Ready queue level for a priority
+    static int PriorityWeight(int priority);	// CPU share weight 
+					// of a (static) priority
+
+    static bool lazySwitch;		// Leave a user thread's registers
+					// and address space in the processor
+					// until another one needs it, 
+					// instead of switching them on every
+					// context switch
+
+  protected:
+    int numReady;			// threads on the ready list
+
+    virtual void Insert(Thread* thread, bool waking);	// Put a thread
+					// on the ready list; "waking" if it
+					// was blocked or just created, 
+					// rather than running
+    virtual void Charged(Thread* thread, int ticks) {}	// Called when 
+					// "thread" has used the CPU for
+					// "ticks" more ticks
+    void Account(Thread* thread);	// Charge the running thread for
+					// its CPU time since it was last
+					// charged
+
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    int runStart;			// busy time (not counting idle 
+					// ticks) when the running thread 
+					// was last charged
+    int runUserStart;			// user time, likewise
+
+    ReadyQueue readyQueue[NumReadyLevels];	// queues of threads that
+					// are ready to run, but not running,
+					// one per level
+    unsigned int readyMask[NumMaskWords];	// bit i set iff queue i
+					// is non-empty
+
+    void Enqueue(Thread* thread);	// Append to the queue of its level
+    void Dequeue(Thread* thread);	// Unlink from the queue of its level
+    int FirstLevel();			// Best non-empty level, or -1
 };
 
 #endif // SCHEDULER_H
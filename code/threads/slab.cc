@@ -0,0 +1,118 @@
+// slab.cc
+//	Routines to allocate kernel objects from per-type caches.
+//	See slab.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "slab.h"
+
+#define SlabAlign	8		// every object is aligned this much
+
+SlabCache *SlabCache::allCaches = NULL;
+
+//----------------------------------------------------------------------
+// SlabCache::SlabCache
+// 	Initialize an empty cache.  Caches are usually static members of
+//	the class whose objects they hold, so this runs before main.
+//
+//	"cacheName" is the name of the type, for Print
+//	"size" is sizeof the type
+//----------------------------------------------------------------------
+
+SlabCache::SlabCache(const char *cacheName, int size)
+{
+    name = cacheName;
+    objectSize = (max(size, (int) sizeof(void *)) + SlabAlign - 1)
+				& ~(SlabAlign - 1);
+    perSlab = max(SlabBytes / objectSize, 1);
+    freeList = NULL;
+    fresh = NULL;
+    numFresh = 0;
+    numSlabs = numAllocs = numReused = numLive = peakLive = 0;
+    next = allCaches;
+    allCaches = this;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Allocate
+// 	Return an object: the one freed most recently (it is the most
+//	likely to still be in the host's cache), or else the next one
+//	from the newest slab, getting a new slab from the heap if that
+//	one is used up.
+//
+//	"size" is what operator new was asked for; it must fit
+//----------------------------------------------------------------------
+
+void *
+SlabCache::Allocate(size_t size)
+{
+    void *object;
+
+    ASSERT((int) size <= objectSize);
+    if (freeList != NULL) {
+	object = freeList;
+	freeList = *(void **) object;
+	numReused++;
+    } else {
+	if (numFresh == 0) {
+	    fresh = new char[perSlab * objectSize];
+	    numFresh = perSlab;
+	    numSlabs++;
+	}
+	object = fresh;
+	fresh += objectSize;
+	numFresh--;
+    }
+    numAllocs++;
+    if (++numLive > peakLive)
+	peakLive = numLive;
+    return object;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Free
+// 	Put an object on the free list, to be handed out again.
+//
+//	"object" is an object from Allocate, or NULL (as delete allows)
+//----------------------------------------------------------------------
+
+void
+SlabCache::Free(void *object)
+{
+    if (object == NULL)
+	return;
+    ASSERT(numLive > 0);
+    *(void **) object = freeList;
+    freeList = object;
+    numLive--;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Print
+// 	Print how the cache has been used.  The hit rate is the share of
+//	allocations that reused a freed object.
+//----------------------------------------------------------------------
+
+void
+SlabCache::Print()
+{
+    printf("Slab %s: %d bytes, live %d, peak %d, allocations %d, "
+	"hit rate %.2f%%, slabs %d\n", name, objectSize, numLive, peakLive,
+	numAllocs, 100.0 * numReused / numAllocs, numSlabs);
+}
+
+//----------------------------------------------------------------------
+// SlabCache::PrintAll
+// 	Print the statistics of every cache that has handed out objects.
+//----------------------------------------------------------------------
+
+void
+SlabCache::PrintAll()
+{
+    for (SlabCache *cache = allCaches; cache != NULL; cache = cache->next)
+	if (cache->numAllocs > 0)
+	    cache->Print();
+}
@@ -0,0 +1,79 @@
+// slab.h
+//	Data structures for a slab allocator: a cache of objects of one
+//	type, for the kernel objects that are allocated and de-allocated
+//	over and over -- list elements, pending interrupts, file headers,
+//	directories and bitmaps.
+//
+//	A cache gets memory from the heap a "slab" (SlabBytes) at a time,
+//	and hands it out one object at a time.  Objects that are freed go
+//	on the cache's free list, and are handed out again first, so once
+//	the cache has grown to the most objects ever in use, allocating
+//	and freeing never go to the heap.  Slabs are never given back.
+//
+//	A class uses a cache through its own operator new and delete:
+//
+//	    class Foo {
+//	      public:
+//		void *operator new(size_t size) { return cache.Allocate(size); }
+//		void operator delete(void *p) { cache.Free(p); }
+//		...
+//	      private:
+//		static SlabCache cache;		// SlabCache Foo::cache("Foo",
+//	    };					//	sizeof(Foo)); in foo.cc
+//
+//	Only single objects come from the cache: "new Foo[n]" still uses
+//	the heap.  A class derived from Foo needs its own cache.
+//
+//	Like the rest of the kernel, the caches are not multiprocessor
+//	safe: with -par, they are only used under the kernel lock.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "copyright.h"
+#include "utility.h"
+#include <stddef.h>
+
+#define SlabBytes	4096		// memory got from the heap at once
+
+// The following class defines a cache of objects of one size.
+
+class SlabCache {
+  public:
+    SlabCache(const char *cacheName, int size);	// initialize an empty
+					// cache of objects of "size" bytes
+					// (no destructor: a cache lasts
+					// as long as Nachos)
+
+    void *Allocate(size_t size);	// Get an object, for operator new
+    void Free(void *object);		// Give it back, for operator delete
+
+    void Print();			// Print the cache's statistics
+    static void PrintAll();		// Print them for every cache that
+					// has been used, at halt
+
+  private:
+    const char *name;			// the type of the objects, for Print
+    int objectSize;			// bytes per object, rounded up so
+					// that every object is aligned
+    int perSlab;			// objects per slab
+    void *freeList;			// objects freed, to be handed out
+					// again; each points to the next
+    char *fresh;			// the next object of the newest slab
+    int numFresh;			// how many have never been handed out
+
+    int numSlabs;			// slabs got from the heap
+    int numAllocs;			// objects handed out
+    int numReused;			// ... from the free list
+    int numLive;			// objects in use
+    int peakLive;			// the most ever in use at once
+
+    SlabCache *next;			// the next cache, on "allCaches"
+    static SlabCache *allCaches;	// every cache, for PrintAll
+};
+
+#endif // SLAB_H
@@ -24,6 +24,82 @@
 #include "copyright.h"
 #include "synch.h"
 #include "system.h"
+#include "callout.h"
+
+//----------------------------------------------------------------------
+// WaitQueue::Append
+// 	Put a thread at the end of the queue.  Called with interrupts
+//	disabled, just before the thread goes to sleep.
+//----------------------------------------------------------------------
+
+WaitOrder WaitQueue::order = PriorityOrder;
+
+void
+WaitQueue::Append(Thread *thread)
+{
+    queue.Append(thread);
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Remove
+// 	Take the next thread to wake up off the queue: the first one
+//	with the best dynamic priority, or in FIFO order simply the 
+//	first one.  Called with interrupts disabled.
+//
+//	Returns NULL if no thread is waiting.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::Remove()
+{
+    Thread *best = queue.First();
+
+    if (best == NULL)
+	return NULL;
+    if (order == PriorityOrder)
+	for (Thread *t = queue.Next(best); t != NULL; t = queue.Next(t))
+	    if (t->getDynamicPriority() < best->getDynamicPriority())
+		best = t;
+    queue.Remove(best);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Remove
+// 	Take a particular thread off the queue, e.g. because it gave up
+//	waiting.  Called with interrupts disabled.
+//
+// Returns:
+//	TRUE if the thread was on the queue.
+//----------------------------------------------------------------------
+
+bool
+WaitQueue::Remove(Thread *thread)
+{
+    for (Thread *t = queue.First(); t != NULL; t = queue.Next(t))
+	if (t == thread) {
+	    queue.Remove(thread);
+	    return TRUE;
+	}
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::BestPriority
+// 	Return the best (lowest) dynamic priority of the waiting threads,
+//	or NotDonated if there are none.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::BestPriority()
+{
+    int best = NotDonated;
+
+    for (Thread *t = queue.First(); t != NULL; t = queue.Next(t))
+	if (t->getDynamicPriority() < best)
+	    best = t->getDynamicPriority();
+    return best;
+}
 
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
@@ -37,7 +113,7 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+    queue = new WaitQueue;
 }
 
 //----------------------------------------------------------------------
@@ -68,7 +144,7 @@ Semaphore::P()
     
     DEBUG('t', "Semaphore %s P begin\n", getName());
     while (value == 0) { 			// semaphore not available
-	queue->Append((void *)currentThread);	// so go to sleep
+	queue->Append(currentThread);		// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
@@ -93,7 +169,7 @@ Semaphore::V()
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     DEBUG('t', "Semaphore %s V begin\n", getName());
-    thread = (Thread *)queue->Remove();
+    thread = queue->Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
@@ -102,46 +178,128 @@ Semaphore::V()
     (void) interrupt->SetLevel(oldLevel);
 }
 
-// Dummy functions -- so we can compile our later assignments 
-// Note -- without a correct implementation of Condition::Wait(), 
-// the test case in the network assignment won't work!
+//----------------------------------------------------------------------
+// Lock::Lock
+// 	Initialize a lock, so that it can be used for synchronization.
+//	The lock starts out FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+bool Lock::priorityInheritance = TRUE;
+
 Lock::Lock(char* debugName) {
     name = debugName;
-    sema = new Semaphore("Inside semaphore", 1);
     thread = NULL;
+    queue = new WaitQueue;
+    nextHeld = NULL;
 }
+
+//----------------------------------------------------------------------
+// Lock::~Lock
+// 	De-allocate a lock, when no longer needed.  Assume no one holds
+//	it, or is waiting for it.
+//----------------------------------------------------------------------
+
 Lock::~Lock() {
-    delete sema;
+    delete queue;
 }
+
+//----------------------------------------------------------------------
+// Lock::Acquire
+// 	Wait until the lock is FREE, then take it.  While we wait, the
+//	holder runs with our dynamic priority, if that is better than
+//	its own (see Donate).
+//----------------------------------------------------------------------
+
 void Lock::Acquire() {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     DEBUG('t', "Lock %s Acquire begin\n", getName());
     ASSERT(!isHeldByCurrentThread()); // lock can't be acquired twice by the same thread
-    sema->P();
+    while (thread != NULL) {		// BUSY, so go to sleep
+        queue->Append(currentThread);
+        currentThread->waitingFor = this;
+        if (priorityInheritance)
+            Donate(currentThread->getDynamicPriority());
+        currentThread->Sleep();
+    }
     thread = currentThread;
+    nextHeld = thread->heldLocks;
+    thread->heldLocks = this;
     DEBUG('t', "Lock %s Acquire end\n", getName());
 
     (void) interrupt->SetLevel(oldLevel);
 }
+
+//----------------------------------------------------------------------
+// Lock::Release
+// 	Set the lock FREE, waking up a thread waiting for it.  We keep 
+//	only the priority lent to us for the locks we still hold.  The
+//	waiter takes over from us at the next time slice, if it is now
+//	the more urgent: we can't yield here, as Condition::Wait must
+//	release the lock and sleep atomically.
+//----------------------------------------------------------------------
+
 void Lock::Release() {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
-    DEBUG('t', "Lock %s Release begin\n", getName());
+    Thread *waiter;
+    Lock **held;
+    int best = NotDonated;
 
+    DEBUG('t', "Lock %s Release begin\n", getName());
     ASSERT(isHeldByCurrentThread()); // only the thread holding the lock can release it
-    sema->V();
+    for (held = &thread->heldLocks; *held != this; held = &(*held)->nextHeld)
+        ;
+    *held = nextHeld;
     thread = NULL;
+
+    waiter = queue->Remove();
+    if (waiter != NULL) {		// it tries again, once it runs
+        waiter->waitingFor = NULL;
+        scheduler->ReadyToRun(waiter);
+    }
+    if (priorityInheritance) {
+        for (Lock *lock = currentThread->heldLocks; lock != NULL; 
+                                        lock = lock->nextHeld)
+            if (lock->queue->BestPriority() < best)
+                best = lock->queue->BestPriority();
+        currentThread->setDonatedPriority(best);
+    }
     DEBUG('t', "Lock %s Release end\n", getName());
 
     (void) interrupt->SetLevel(oldLevel);
 }
+
 bool Lock::isHeldByCurrentThread() {
     return currentThread == thread;
 }
 
+//----------------------------------------------------------------------
+// Lock::Donate
+// 	A thread with dynamic priority "p" is waiting for this lock.  Lend
+//	it to the holder; if the holder is waiting for another lock, lend
+//	it to that lock's holder too, and so on down the chain.  Stop as
+//	soon as a holder already has "p" lent to it, which also ends any
+//	cycle (a deadlock).  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::Donate(int p)
+{
+    for (Lock *lock = this; lock != NULL && lock->thread != NULL;
+                                lock = lock->thread->waitingFor) {
+        if (lock->thread->getDynamicPriority() <= p)
+            break;			// already at least that urgent
+        DEBUG('t', "Thread %s lends priority %d to thread %s\n",
+            currentThread->getName(), p, lock->thread->getName());
+        lock->thread->setDonatedPriority(p);
+    }
+}
+
 Condition::Condition(char* debugName) {
     name = debugName;
-    queue = new List;
+    queue = new WaitQueue;
 }
 Condition::~Condition() {
     delete queue;
@@ -150,16 +308,65 @@ void Condition::Wait(Lock* conditionLock) {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     conditionLock->Release();
-    queue->Append((void *)currentThread);
+    queue->Append(currentThread);
     currentThread->Sleep();
     conditionLock->Acquire();
 
     (void) interrupt->SetLevel(oldLevel);
 }
+//----------------------------------------------------------------------
+// Condition::Wait
+// 	Like Wait, but give up once "timeout" ticks have passed without
+//	a Signal or Broadcast.  A callout takes us off the queue and 
+//	wakes us up; if we are signaled first, we cancel it.  Either
+//	way, we re-acquire the lock before returning.
+//
+// Returns:
+//	FALSE if we timed out.
+//
+//	"timeout" is how long to wait, in simulated time
+//----------------------------------------------------------------------
+
+struct TimedWait {			// the state shared with the callout
+    WaitQueue *queue;
+    Thread *thread;
+    bool timedOut;
+};
+
+static void
+WaitTimedOut(int arg)
+{
+    TimedWait *wait = (TimedWait *)arg;
+
+    if (wait->queue->Remove(wait->thread)) {	// not signaled yet
+	wait->timedOut = TRUE;
+	scheduler->ReadyToRun(wait->thread);
+    }
+}
+
+bool Condition::Wait(Lock* conditionLock, int timeout) {
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    TimedWait wait;
+    Callout alarm(WaitTimedOut, (int)&wait);
+
+    wait.queue = queue;
+    wait.thread = currentThread;
+    wait.timedOut = FALSE;
+    conditionLock->Release();
+    queue->Append(currentThread);
+    alarm.Set(timeout);
+    currentThread->Sleep();
+    (void) alarm.Cancel();
+    conditionLock->Acquire();
+
+    (void) interrupt->SetLevel(oldLevel);
+    return !wait.timedOut;
+}
+
 void Condition::Signal(Lock* conditionLock) {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
     
-    Thread *thread = (Thread *)queue->Remove();
+    Thread *thread = queue->Remove();
     if (thread != NULL)
 	    scheduler->ReadyToRun(thread);
     
@@ -170,7 +377,7 @@ void Condition::Broadcast(Lock* conditionLock) {
     
     Thread *thread = NULL;
     while(!queue->IsEmpty()) {
-        thread = (Thread *)queue->Remove();
+        thread = queue->Remove();
         if (thread != NULL)
             scheduler->ReadyToRun(thread);
     }
@@ -183,7 +390,7 @@ void Condition::BroadcastAndSetReturnValue(Lock* conditionLock, int returnValue)
     
     Thread *thread = NULL;
     while(!queue->IsEmpty()) {
-        thread = (Thread *)queue->Remove();
+        thread = queue->Remove();
         if (thread != NULL) {
 #ifdef USER_PROG
             thread->joinReturnValue = returnValue;
@@ -19,7 +19,38 @@
 
 #include "copyright.h"
 #include "thread.h"
-#include "list.h"
+#include "intrusivelist.h"
+
+// The following class defines the queue of threads waiting on a
+// semaphore, lock or condition variable.  By default the thread with
+// the best (lowest) dynamic priority, including any priority lent to
+// it, is woken first, and among equals the one that has waited the
+// longest.  Priorities change while threads wait, so the queue is
+// kept in arrival order and searched when a thread is woken.  Threads
+// are linked through Thread::waitLink, so waiting allocates nothing.
+//
+// With "-fifo", threads are woken strictly in arrival order instead,
+// as Nachos originally did.
+
+enum WaitOrder { FifoOrder, PriorityOrder };
+
+class WaitQueue {
+  public:
+    void Append(Thread *thread);	// Put a thread on the queue
+    Thread *Remove();			// Take the next thread to wake off
+					// the queue, NULL if it is empty
+    bool Remove(Thread *thread);	// Take "thread" off the queue; 
+					// FALSE if it wasn't on it
+    bool IsEmpty() { return queue.IsEmpty(); }
+    int BestPriority();			// The best dynamic priority of the
+					// waiters, NotDonated if none
+
+    static WaitOrder order;		// how every queue wakes threads
+
+  private:
+    IntrusiveList<Thread, &Thread::waitLink> queue;	// the waiting
+					// threads, oldest first
+};
 
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
@@ -48,7 +79,7 @@ class Semaphore {
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    WaitQueue *queue;  // threads waiting in P() for the value to be > 0
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -62,6 +93,13 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// Locks implement priority inheritance: a thread waiting in Acquire
+// lends its dynamic priority to the holder -- and, if the holder is 
+// itself waiting for a lock, to that lock's holder, and so on -- until
+// the holder releases the lock.  Otherwise a low priority holder 
+// could be kept off the CPU by medium priority threads, and with it 
+// the high priority waiter.
 
 class Lock {
   public:
@@ -77,11 +115,18 @@ class Lock {
 					// checking in Release, and in
 					// Condition variable ops below.
 
+    static bool priorityInheritance;	// TRUE (the default) to lend 
+					// priorities; FALSE shows the
+					// inversion (cf. ThreadTest10)
+
   private:
     char* name;				// for debugging
-    // plus some other stuff you'll need to define
-    Semaphore *sema;
-    Thread *thread;
+    Thread *thread;			// the holder, NULL if FREE
+    WaitQueue *queue;			// threads waiting in Acquire
+    Lock *nextHeld;			// the next lock "thread" holds
+
+    void Donate(int p);			// Lend priority "p" to the holder,
+					// and the holders it waits for
 };
 
 // The following class defines a "condition variable".  A condition
@@ -89,7 +134,8 @@ class Lock {
 // on the variable.  These are only operations on a condition variable: 
 //
 //	Wait() -- release the lock, relinquish the CPU until signaled, 
-//		then re-acquire the lock
+//		then re-acquire the lock.  Optionally, give up waiting
+//		after a timeout.
 //
 //	Signal() -- wake up a thread, if there are any waiting on 
 //		the condition
@@ -127,6 +173,9 @@ class Condition {
 					// condition variables; releasing the 
 					// lock and going to sleep are 
 					// *atomic* in Wait()
+    bool Wait(Lock *conditionLock, int timeout);	// Wait, for at
+					// most "timeout" ticks; FALSE if 
+					// it timed out
     void Signal(Lock *conditionLock);   // conditionLock must be held by
     void Broadcast(Lock *conditionLock);// the currentThread for all of 
           // these operations
@@ -134,8 +183,7 @@ class Condition {
 
   private:
     char* name;
-    // plus some other stuff you'll need to define
-    List *queue;
+    WaitQueue *queue;			// threads waiting to be signaled
 };
 
 // The following class defines a barrier. A barrier make current thread
@@ -1,9 +1,17 @@
 // synchlist.h 
 //	Data structures for synchronized access to a list.
 //
-//	Implemented by surrounding the List abstraction
+//	Implemented by surrounding the IntrusiveList abstraction
 //	with synchronization routines.
 //
+// 	Implemented in "monitor"-style -- surround each procedure with a
+// 	lock acquire and release pair, using condition signal and wait for
+// 	synchronization.
+//
+//	Like IntrusiveList, a SynchList holds objects of one type, linked
+//	through a ListLink field of theirs, so putting an object on it
+//	allocates nothing.  Being a template, it is all in this file.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -12,7 +20,7 @@
 #define SYNCHLIST_H
 
 #include "copyright.h"
-#include "list.h"
+#include "intrusivelist.h"
 #include "synch.h"
 
 // The following class defines a "synchronized list" -- a list for which:
@@ -21,22 +29,108 @@
 //	wait until the list has an element on it.
 //	2. One thread at a time can access list data structures
 
+template <class T, ListLink<T> T::*Link>
 class SynchList {
   public:
     SynchList();		// initialize a synchronized list
     ~SynchList();		// de-allocate a synchronized list
 
-    void Append(void *item);	// append item to the end of the list,
+    void Append(T *item);	// append item to the end of the list,
 				// and wake up any thread waiting in remove
-    void *Remove();		// remove the first item from the front of
+    T *Remove();		// remove the first item from the front of
 				// the list, waiting if the list is empty
 				// apply function to every item in the list
-    void Mapcar(VoidFunctionPtr func);
+    void Mapcar(void (*func)(T *item));
 
   private:
-    List *list;			// the unsynchronized list
+    IntrusiveList<T, Link> list;	// the unsynchronized list
     Lock *lock;			// enforce mutual exclusive access to the list
     Condition *listEmpty;	// wait in Remove if the list is empty
 };
 
+//----------------------------------------------------------------------
+// SynchList::SynchList
+//	Allocate and initialize the data structures needed for a 
+//	synchronized list, empty to start with.
+//	Elements can now be added to the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+SynchList<T, Link>::SynchList()
+{
+    lock = new Lock("list lock"); 
+    listEmpty = new Condition("list empty cond");
+}
+
+//----------------------------------------------------------------------
+// SynchList::~SynchList
+//	De-allocate the data structures created for synchronizing a list. 
+//	The items still on the list are not ours to de-allocate.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+SynchList<T, Link>::~SynchList()
+{ 
+    delete lock;
+    delete listEmpty;
+}
+
+//----------------------------------------------------------------------
+// SynchList::Append
+//      Append an "item" to the end of the list.  Wake up anyone
+//	waiting for an element to be appended.
+//
+//	"item" is the thing to put on the list.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+SynchList<T, Link>::Append(T *item)
+{
+    lock->Acquire();		// enforce mutual exclusive access to the list 
+    list.Append(item);
+    listEmpty->Signal(lock);	// wake up a waiter, if any
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchList::Remove
+//      Remove an "item" from the beginning of the list.  Wait if
+//	the list is empty.
+// Returns:
+//	The removed item. 
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+T *
+SynchList<T, Link>::Remove()
+{
+    T *item;
+
+    lock->Acquire();			// enforce mutual exclusion
+    while (list.IsEmpty())
+	listEmpty->Wait(lock);		// wait until list isn't empty
+    item = list.Remove();
+    ASSERT(item != NULL);
+    lock->Release();
+    return item;
+}
+
+//----------------------------------------------------------------------
+// SynchList::Mapcar
+//      Apply function to every item on the list.  Obey mutual exclusion
+//	constraints.
+//
+//	"func" is the procedure to be applied.
+//----------------------------------------------------------------------
+
+template <class T, ListLink<T> T::*Link>
+void
+SynchList<T, Link>::Mapcar(void (*func)(T *item))
+{ 
+    lock->Acquire(); 
+    list.Mapcar(func);
+    lock->Release(); 
+}
+
 #endif // SYNCHLIST_H
@@ -7,18 +7,26 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "synch.h"
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
 
-Thread *currentThread;			// the thread we are running now
-Thread *threadToBeDestroyed;  		// the thread that just finished
-Scheduler *scheduler;			// the ready list
-Interrupt *interrupt;			// interrupt status
-Statistics *stats;			// performance metrics
-Timer *timer;				// the hardware timer device,
+PerCPU Thread *currentThread;		// the thread we are running now
+PerCPU Thread *threadToBeDestroyed;  	// the thread that just finished
+PerCPU Scheduler *scheduler;		// the ready list
+PerCPU Interrupt *interrupt;		// interrupt status
+PerCPU Statistics *stats;		// performance metrics
+PerCPU Timer *timer;			// the hardware timer device,
                     // for invoking context switches
+PerCPU CalloutWheel *callouts;		// kernel timers, driven by "timer"
+bool tickless = FALSE;			// the timer only interrupts when
+					// the kernel needs it to
 bool deleting = FALSE; // Prevent deleting a thread twice
+PerCPU CPU *currentCPU = NULL;		// the CPU being simulated
+CPU **cpus = NULL;			// the simulated CPUs, if more than one
+int numCPUs = 1;
+bool parallelCPUs = FALSE;		// each CPU runs on its own host thread
 
 #ifdef FILESYS_NEEDED
 FileSystem  *fileSystem;
@@ -29,7 +37,12 @@ SynchDisk   *synchDisk;
 #endif
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
-Machine *machine;	// user program memory and registers
+PerCPU Machine *machine;	// user program memory and registers
+FutexTable *futexTable;
+#endif
+
+#ifdef USE_TLB
+TLBPolicy *tlbPolicy;
 #endif
 
 #ifdef NETWORK
@@ -55,6 +68,9 @@ extern void Cleanup();
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
+//	The timer also runs the kernel's own timers (see callout.h).
+//	In tickless mode, it then decides when it is next needed.
+//
 //	"dummy" is because every interrupt handler takes one argument,
 //		whether it needs it or not.
 //----------------------------------------------------------------------
@@ -62,13 +78,53 @@ static void
 TimerInterruptHandler(int dummy)
 {
     DEBUG('t', "Time interrupt! Name: %-8s, PR: %4d, TS: %4d, DP: %4d\n", currentThread->getName(),currentThread->getPriority(), currentThread->getTimeSliceNum(), currentThread->getDynamicPriority());
+    callouts->Tick();
     currentThread->IncreaseTimeSliceNum();
     currentThread->UpdateDynamicPriority();
-    if (interrupt->getStatus() != IdleMode) {
-        Thread* pendingThread = scheduler->getFirst();
-        if(pendingThread != NULL && pendingThread->getDynamicPriority() < currentThread->getDynamicPriority())
+    if (interrupt->getStatus() != IdleMode && 
+        (currentCPU == NULL || currentThread != currentCPU->idleThread)) {
+        if(scheduler->ShouldPreempt(currentThread))
             interrupt->YieldOnReturn();
     }
+    ArmTimer();
+}
+
+//----------------------------------------------------------------------
+// ArmTimer
+// 	In tickless mode, make sure the timer interrupts when the kernel
+//	next needs it: at the end of a time slice, if more than one 
+//	thread can run, or else when the next callout is due.  If
+//	neither, the timer stays quiet, and an idle CPU simply waits for
+//	its devices.  
+//
+//	The interrupt is only ever moved earlier; when it comes, the
+//	handler works out when the next one is needed.  Called with
+//	interrupts disabled, whenever a thread is made ready, a callout 
+//	is set, or the timer interrupts.
+//----------------------------------------------------------------------
+
+void
+ArmTimer()
+{
+    int runnable = scheduler->NumReady();
+    int when = -1;
+
+    if (!tickless)
+	return;
+    if (currentThread->getStatus() == RUNNING &&
+	    (currentCPU == NULL || currentThread != currentCPU->idleThread))
+	runnable++;
+    if (runnable > 1)
+	when = stats->totalTicks + timer->TimeOfNextInterrupt();
+    if (callouts->NumPending() > 0 && 
+	    (when < 0 || callouts->NextDue() < when))
+	when = callouts->NextDue();
+    if (when < 0)
+	return;
+    if (when <= stats->totalTicks)
+	when = stats->totalTicks + 1;
+    if (timer->ArmedAt() < 0 || when < timer->ArmedAt())
+	timer->Arm(when - stats->totalTicks);
 }
 
 void printThreadStatus() {
@@ -101,9 +157,18 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool fairShare = FALSE;	// use the completely fair scheduler
+    int smpCPUs = 1;		// number of simulated CPUs
+    bool hostThreads = FALSE;	// simulate them in parallel
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    RunEngine engine = InterpreterEngine;	// how to run user programs
+#endif
+#ifdef USE_TLB
+    int tlbEntries = DefaultTLBSize;	// shape of the TLB
+    int tlbWays = DefaultTLBWays;
+    char *tlbPolicyName = "lru";	// TLB replacement policy
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
@@ -128,10 +193,48 @@ Initialize(int argc, char **argv)
 						// number generator
 	    randomYield = TRUE;
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-cfs"))
+	    fairShare = TRUE;
+	else if (!strcmp(*argv, "-smp")) {
+	    ASSERT(argc > 1);
+	    smpCPUs = atoi(*(argv + 1));
+	    ASSERT(smpCPUs >= 1);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-par"))
+	    hostThreads = TRUE;
+	else if (!strcmp(*argv, "-fifo"))
+	    WaitQueue::order = FifoOrder;
+	else if (!strcmp(*argv, "-tickless"))
+	    tickless = TRUE;
+	else if (!strcmp(*argv, "-ps")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "csv"))
+		Thread::psFormat = PsCSV;
+	    else
+		Thread::psFormat = PsTable;
+	    argCount = 2;
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	else if (!strcmp(*argv, "-bt"))
+	    engine = BlockEngine;
+	else if (!strcmp(*argv, "-tc"))
+	    engine = ThreadedEngine;
+	else if (!strcmp(*argv, "-eager"))
+	    Scheduler::lazySwitch = FALSE;
+#endif
+#ifdef USE_TLB
+	if (!strcmp(*argv, "-tlb")) {
+	    ASSERT(argc > 2);
+	    tlbEntries = atoi(*(argv + 1));
+	    tlbWays = atoi(*(argv + 2));
+	    argCount = 3;
+	} else if (!strcmp(*argv, "-tlbp")) {
+	    ASSERT(argc > 1);
+	    tlbPolicyName = *(argv + 1);
+	    argCount = 2;
+	}
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
@@ -153,9 +256,13 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler();		// initialize the ready queue
+    if (fairShare)				// initialize the ready queue
+	scheduler = new FairScheduler();
+    else
+	scheduler = new Scheduler();
+    callouts = new CalloutWheel();		// kernel timers
     // if (randomYield)				// start the timer (if needed)
-	timer = new Timer(TimerInterruptHandler, 0, randomYield);
+	timer = new Timer(TimerInterruptHandler, 0, randomYield, tickless);
 
     threadToBeDestroyed = NULL;
 
@@ -169,9 +276,21 @@ Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
+#ifdef USE_TLB
+    machine = new Machine(debugUserProg, engine, tlbEntries, tlbWays);
+						// this must come first
+    tlbPolicy = NewTLBPolicy(tlbPolicyName, machine->tlbSets, machine->tlbWays);
+    ASSERT(tlbPolicy != NULL);			// unknown policy name
+#else
+    machine = new Machine(debugUserProg, engine);	// this must come first
+#endif
+    futexTable = new FutexTable();
 #endif
 
+    if (smpCPUs > 1)				// needs the machine
+	StartCPUs(smpCPUs, fairShare, randomYield, TimerInterruptHandler,
+		  hostThreads);
+
 #ifdef FILESYS
     synchDisk = new SynchDisk("DISK");
 #endif
@@ -198,9 +317,14 @@ Cleanup()
 #endif
     
 #ifdef USER_PROGRAM
+    delete futexTable;
     delete machine;
 #endif
 
+#ifdef USE_TLB
+    delete tlbPolicy;
+#endif
+
 #ifdef FILESYS_NEEDED
     delete fileSystem;
 #endif
@@ -210,6 +334,7 @@ Cleanup()
 #endif
     
     delete timer;
+    delete callouts;
     delete scheduler;
     delete interrupt;
     
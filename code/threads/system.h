@@ -12,9 +12,12 @@
 #include "utility.h"
 #include "thread.h"
 #include "scheduler.h"
+#include "fairsched.h"
+#include "cpu.h"
 #include "interrupt.h"
 #include "stats.h"
 #include "timer.h"
+#include "callout.h"
 
 // Initialization and cleanup routines
 extern void Initialize(int argc, char **argv); 	// Initialization,
@@ -23,17 +26,34 @@ extern void Cleanup();				// Cleanup, called when
 						// Nachos is done.
 extern void printThreadStatus();
 
-extern Thread *currentThread;			// the thread holding the CPU
-extern Thread *threadToBeDestroyed;  		// the thread that just finished
-extern Scheduler *scheduler;			// the ready list
-extern Interrupt *interrupt;			// interrupt status
-extern Statistics *stats;			// performance metrics
-extern Timer *timer;				// the hardware alarm clock
+extern PerCPU Thread *currentThread;		// the thread holding the CPU
+extern PerCPU Thread *threadToBeDestroyed;  	// the thread that just finished
+extern PerCPU Scheduler *scheduler;		// the ready list
+extern PerCPU Interrupt *interrupt;		// interrupt status
+extern PerCPU Statistics *stats;		// performance metrics
+extern PerCPU Timer *timer;			// the hardware alarm clock
+extern PerCPU CalloutWheel *callouts;		// kernel timers, run by it
+extern bool tickless;				// TRUE if the timer is only
+						// armed when needed
+extern void ArmTimer();				// Arm it, if so
 extern bool deleting;
+extern PerCPU CPU *currentCPU;			// the CPU being simulated, 
+						// NULL unless a multiprocessor
+extern CPU **cpus;				// all the CPUs
+extern int numCPUs;
+extern bool parallelCPUs;			// TRUE if each CPU has its
+						// own host thread
 
 #ifdef USER_PROGRAM
 #include "machine.h"
-extern Machine* machine;	// user program memory and registers
+extern PerCPU Machine* machine;	// user program memory and registers
+#include "futex.h"
+extern FutexTable *futexTable;		// user threads waiting on futexes
+#endif
+
+#ifdef USE_TLB
+#include "tlbpolicy.h"
+extern TLBPolicy *tlbPolicy;	// how TLB entries are replaced
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
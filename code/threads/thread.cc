@@ -9,6 +9,8 @@
 //	Sleep -- relinquish control over the CPU, but thread is now blocked.
 //		In other words, it will not run again, until explicitly 
 //		put back on the ready queue.
+//	SleepFor -- likewise, but put back on the ready queue by a
+//		callout after a given time
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -27,6 +29,15 @@
 //----------------------------------------------------------------------
 int Thread::nextThreadID(0);
 int Thread::totalNumber(0);
+int *Thread::stackPool(NULL);
+int Thread::stackPoolCount(0);
+Thread *Thread::allThreads(NULL);
+PsFormat Thread::psFormat(PsNone);
+
+static const char *statusNames[] = { "JUST_CREATED", "RUNNING", "READY", 
+					"BLOCKED" };
+static ThreadAccount *finishedAccounts = NULL;	// threads that finished,
+						// with -ps
 
 
 //----------------------------------------------------------------------
@@ -39,11 +50,6 @@ int Thread::totalNumber(0);
 
 Thread::Thread(char* threadName, int prior)
 {
-    if(totalNumber >= 128) {
-        printf("Trying to create too many threads.\n");
-        ASSERT(totalNumber < 128);
-    }
-
     name = threadName;
     stackTop = NULL;
     stack = NULL;
@@ -54,6 +60,22 @@ Thread::Thread(char* threadName, int prior)
     priority = prior;
     timeSliceNum = 0;
     dynamicPrior = priority;
+    readyLevel = -1;
+    readyOn = NULL;
+    waitingFor = NULL;
+    heldLocks = NULL;
+    donatedPrior = NotDonated;
+    cpuTicks = 0;
+    wakeTime = -1;
+    vruntime = fairSeq = 0;
+    fairLeft = fairRight = NULL;
+    fairHeight = 0;
+    account.since = (stats != NULL) ? stats->totalTicks : 0;
+    allPrev = NULL;
+    allNext = allThreads;
+    if (allThreads != NULL)
+	allThreads->allPrev = this;
+    allThreads = this;
     DEBUG('t', "Creating thread: NAME: %s, UID: %d, TID: %d\n", name, userID, threadID);
 
     totalNumber++;
@@ -61,6 +83,7 @@ Thread::Thread(char* threadName, int prior)
 
 #ifdef USER_PROGRAM
     space = NULL;
+    registersIn = NULL;
 #endif
 }
 
@@ -81,12 +104,33 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     totalNumber--;
+    if (allPrev != NULL)
+	allPrev->allNext = allNext;
+    else
+	allThreads = allNext;
+    if (allNext != NULL)
+	allNext->allPrev = allPrev;
+    if (psFormat != PsNone) {		// keep its accounting for halt
+	ThreadAccount *done = new ThreadAccount(account);
+	done->threadID = threadID;
+	done->userID = userID;
+	done->priority = priority;
+	done->name = name;
+	done->status = "FINISHED";
+	done->next = finishedAccounts;
+	finishedAccounts = done;
+    }
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-    DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+        PutStack(stack);
     
 #ifdef USER_PROGRAM
+    if (registersIn != NULL)		// don't leave a dangling pointer
+	registersIn->userThread = NULL;	// to us in the processor
+#ifdef USE_INVERTED_TABLE
+    machine->InvalidateTLB(threadID);	// our ID may be reused
+#endif //USE_INVERTED_TABLE
     if(space->refNum == 0) {
 #ifdef USE_INVERTED_TABLE
         // Clear physical page
@@ -116,17 +160,23 @@ Thread::~Thread()
 //		cause it to run the procedure
 //		3. Put the thread on the ready queue
 // 	
+//	Returns FALSE, with nothing done, if the host has no memory left
+//	for a stack; the caller still owns the thread, and can delete it.
+// 	
 //	"func" is the procedure to run concurrently.
 //	"arg" is a single argument to be passed to the procedure.
 //----------------------------------------------------------------------
 
-void 
+bool 
 Thread::Fork(VoidFunctionPtr func, int arg)
 {
     DEBUG('t', "Forking thread \"%s\" with func = 0x%x, arg = %d\n",
 	  name, (int) func, arg);
     
-    StackAllocate(func, arg);
+    if (!StackAllocate(func, arg)) {
+	DEBUG('t', "No stack for thread \"%s\"\n", name);
+	return FALSE;
+    }
 
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
     scheduler->ReadyToRun(this);	// ReadyToRun assumes that interrupts 
@@ -135,8 +185,67 @@ Thread::Fork(VoidFunctionPtr func, int arg)
     
     if(currentThread->getPriority() > this->priority)
         currentThread->Yield();
+    return TRUE;
 }    
 
+//----------------------------------------------------------------------
+// Thread::setPriority
+// 	Change the priority of a thread, and recompute its dynamic
+//	priority from it.  If the thread is waiting on the ready list,
+//	move it to its new place there.
+//
+//	"p" is the new priority, in [0, 15]
+//----------------------------------------------------------------------
+
+void
+Thread::setPriority(int p)
+{
+    ASSERT(p >= 0 && p < 16);
+    priority = p;
+    UpdateDynamicPriority();
+    if (status == READY) {
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+        readyOn->Requeue(this);
+        (void) interrupt->SetLevel(oldLevel);
+    }
+}
+
+//----------------------------------------------------------------------
+// Thread::setDonatedPriority
+// 	Change the dynamic priority lent to this thread by the threads
+//	waiting for the locks it holds (see Lock::Acquire).  As with
+//	setPriority, a ready thread moves to its new place.  Called with 
+//	interrupts disabled.
+//
+//	"p" is the priority lent, NotDonated if none
+//----------------------------------------------------------------------
+
+void
+Thread::setDonatedPriority(int p)
+{
+    donatedPrior = p;
+    if (status == READY)
+        readyOn->Requeue(this);
+}
+
+//----------------------------------------------------------------------
+// Thread::ForkIdle
+// 	Prepare the thread to run (*func)(arg) as the idle thread of
+//	a CPU (see cpu.h).  Unlike Fork, the thread is not put on the
+//	ready list: it runs when its CPU has nothing else to do.
+//----------------------------------------------------------------------
+
+void 
+Thread::ForkIdle(VoidFunctionPtr func, int arg)
+{
+    DEBUG('t', "Forking idle thread \"%s\" with func = 0x%x, arg = %d\n",
+	  name, (int) func, arg);
+    
+    bool allocated = StackAllocate(func, arg);
+
+    ASSERT(allocated);			// no CPU can run without one
+}
+
 //----------------------------------------------------------------------
 // Thread::CheckOverflow
 // 	Check a thread's stack to see if it has overrun the space
@@ -239,7 +348,8 @@ Thread::Yield ()
 //	we have no thread to run.  "Interrupt::Idle" is called
 //	to signify that we should idle the CPU until the next I/O interrupt
 //	occurs (the only thing that could cause a thread to become
-//	ready to run).
+//	ready to run).  On a multiprocessor, we switch to the CPU's 
+//	idle thread instead, which can also take work from other CPUs.
 //
 //	NOTE: we assume interrupts are already disabled, because it
 //	is called from the synchronization routines which must
@@ -258,12 +368,54 @@ Thread::Sleep ()
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
     status = BLOCKED;
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
+    while ((nextThread = scheduler->FindNextToRun()) == NULL) {
+	if (currentCPU != NULL) {	// multiprocessor: let the idle 
+	    nextThread = currentCPU->idleThread;	// thread wait
+	    break;
+	}
 	interrupt->Idle();	// no one to run, wait for an interrupt
+    }
         
     scheduler->Run(nextThread); // returns when we've been signalled
 }
 
+//----------------------------------------------------------------------
+// WakeThread
+// 	Callout function for SleepFor: make the sleeping thread ready.
+//
+//	"arg" is the thread
+//----------------------------------------------------------------------
+
+static void
+WakeThread(int arg)
+{
+    scheduler->ReadyToRun((Thread *)arg);
+}
+
+//----------------------------------------------------------------------
+// Thread::SleepFor
+// 	Relinquish the CPU until "ticks" of simulated time have passed,
+//	instead of Yielding in a loop, which keeps the CPU busy.  A 
+//	callout on the timing wheel puts us back on the ready queue; we
+//	run at the first timer interrupt after that (cf. callout.h).
+//
+//	"ticks" is how long to sleep
+//----------------------------------------------------------------------
+
+void
+Thread::SleepFor(int ticks)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Callout wakeUp(WakeThread, (int)this);
+
+    ASSERT(this == currentThread);
+    DEBUG('t', "Thread \"%s\" sleeping for %d ticks\n", getName(), ticks);
+    wakeUp.Set(ticks);
+    Sleep();
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // ThreadFinish, InterruptEnable, ThreadPrint
 //	Dummy functions because C++ does not allow a pointer to a member
@@ -276,6 +428,56 @@ static void ThreadFinish()    { currentThread->Finish(); }
 static void InterruptEnable() { interrupt->Enable(); }
 void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 
+//----------------------------------------------------------------------
+// Thread::GetStack
+//	Return a stack for a new thread: one left by a finished thread 
+//	if there is any, otherwise one of a new region of stacks, with
+//	guard pages between them to catch overflows.  Returns NULL if
+//	the host has no memory left.
+//----------------------------------------------------------------------
+
+int *
+Thread::GetStack()
+{
+    int *stack;
+    char *stacks[StackRegionSize];
+
+    if (stackPool == NULL) {
+	if (!AllocBoundedArrays(StackSize * sizeof(int), StackRegionSize, 
+								stacks))
+	    return NULL;
+	for (int i = StackRegionSize - 1; i >= 0; i--) {
+	    *(int **) stacks[i] = stackPool;
+	    stackPool = (int *) stacks[i];
+	    stackPoolCount++;
+	}
+    }
+    stack = stackPool;
+    stackPool = *(int **) stack;
+    stackPoolCount--;
+    return stack;
+}
+
+//----------------------------------------------------------------------
+// Thread::PutStack
+//	Keep the stack of a deleted thread for the next thread that is
+//	forked.  The guard pages stay in place.  If the pool is already
+//	big, the stack's memory goes back to the host; it is taken again
+//	when the stack is next used.
+//
+//	"stack" is the stack, as returned by GetStack
+//----------------------------------------------------------------------
+
+void
+Thread::PutStack(int *stack)
+{
+    if (stackPoolCount >= StackPoolSize)
+	DiscardArray((char *) stack, StackSize * sizeof(int));
+    *(int **) stack = stackPool;
+    stackPool = stack;
+    stackPoolCount++;
+}
+
 //----------------------------------------------------------------------
 // Thread::StackAllocate
 //	Allocate and initialize an execution stack.  The stack is
@@ -284,14 +486,18 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	Returns FALSE if there is no memory for a stack.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
 
-void
+bool
 Thread::StackAllocate (VoidFunctionPtr func, int arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    stack = GetStack();
+    if (stack == NULL)
+	return FALSE;
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
@@ -320,6 +526,7 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
     machineState[InitialPCState] = (int) func;
     machineState[InitialArgState] = arg;
     machineState[WhenDonePCState] = (int) ThreadFinish;
+    return TRUE;
 }
 
 #ifdef USER_PROGRAM
@@ -331,14 +538,22 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
 //
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
-//	while executing kernel code.  This routine saves the former.
+//	while executing kernel code.  This routine saves the former,
+//	from the processor holding it: the one we were left in by
+//	LeaveUserState, if any, or else the one we are running on.
 //----------------------------------------------------------------------
 
 void
 Thread::SaveUserState()
 {
+    Machine *holder = (registersIn != NULL) ? registersIn : machine;
+
     for (int i = 0; i < NumTotalRegs; i++)
-	userRegisters[i] = machine->ReadRegister(i);
+	userRegisters[i] = holder->ReadRegister(i);
+    if (holder->userThread == this)
+	holder->userThread = NULL;
+    registersIn = NULL;
+    stats->numUserStateCopies++;
 }
 
 //----------------------------------------------------------------------
@@ -348,12 +563,210 @@ Thread::SaveUserState()
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
 //	while executing kernel code.  This routine restores the former.
+//	Whoever's state was in the processor must have been saved.
 //----------------------------------------------------------------------
 
 void
 Thread::RestoreUserState()
 {
+    ASSERT(machine->userThread == NULL || machine->userThread == this);
     for (int i = 0; i < NumTotalRegs; i++)
 	machine->WriteRegister(i, userRegisters[i]);
+    machine->userThread = this;
+    registersIn = machine;
+    stats->numUserStateCopies++;
+}
+
+//----------------------------------------------------------------------
+// Thread::LeaveUserState
+//	We are being switched out: leave our user registers in the
+//	processor, rather than copying them out.  If the threads that run
+//	next are kernel threads (or the idle thread), they are still there
+//	when we run again.  Otherwise they are saved by
+//	MakeRoomForUserState, when a user thread needs the processor.
+//----------------------------------------------------------------------
+
+void
+Thread::LeaveUserState()
+{
+    ASSERT(machine->userThread == NULL || machine->userThread == this);
+    machine->userThread = this;
+    registersIn = machine;
+}
+
+//----------------------------------------------------------------------
+// Thread::MakeRoomForUserState
+//	We are about to run on this processor: save the user registers
+//	some other thread left in it, and fetch ours if we left them in 
+//	another processor (we were moved to this CPU since).  Then 
+//	either ours are here already, or the processor is free for 
+//	RestoreUserState -- or, for a thread that has not started, for 
+//	its first user registers.
+//
+//	Called before switching to the thread, while its registers
+//	cannot change.
+//----------------------------------------------------------------------
+
+void
+Thread::MakeRoomForUserState()
+{
+    Thread *holder = machine->userThread;
+
+    if (holder != NULL && holder != this)
+	holder->SaveUserState();
+    if (registersIn != NULL && registersIn != machine)
+	SaveUserState();
+}
+
+//----------------------------------------------------------------------
+// Thread::UserStateLoaded
+//	Return TRUE if our user registers are in the processor we are 
+//	running on, so there is nothing to restore.
+//----------------------------------------------------------------------
+
+bool
+Thread::UserStateLoaded()
+{
+    return registersIn == machine;
 }
 #endif
+
+//----------------------------------------------------------------------
+// ThreadAccount::ThreadAccount
+// 	Initialize a thread's accounting: it has done nothing yet.
+//----------------------------------------------------------------------
+
+ThreadAccount::ThreadAccount()
+{
+    userTicks = systemTicks = readyTicks = blockedTicks = 0;
+    voluntarySwitches = involuntarySwitches = 0;
+    for (int i = 0; i < LatencyBuckets; i++)
+	latency[i] = 0;
+    since = 0;
+    threadID = userID = priority = 0;
+    name = NULL;
+    status = NULL;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// ThreadAccount::RecordLatency
+// 	Count a wait on the ready list in the latency histogram.
+//
+//	"ticks" is how long the thread waited
+//----------------------------------------------------------------------
+
+void
+ThreadAccount::RecordLatency(int ticks)
+{
+    int bucket = 0;
+
+    while (ticks > 0 && bucket < LatencyBuckets - 1) {
+	ticks >>= 1;
+	bucket++;
+    }
+    latency[bucket]++;
+}
+
+//----------------------------------------------------------------------
+// ThreadAccount::PrintHeader, ThreadAccount::Print
+// 	Print the accounting of a thread, either as a row of a ps-like
+//	table, or as a line of comma-separated values, for scripts.  The
+//	table summarizes the latency histogram as the number of waits and
+//	an upper bound on the 99th percentile; the CSV has every bucket,
+//	labelled by its lower bound.
+//----------------------------------------------------------------------
+
+void
+ThreadAccount::PrintHeader(PsFormat format)
+{
+    if (format == PsTable) {
+	printf("%5s %5s %4s %-16s %-12s %8s %8s %8s %8s %6s %6s %6s %6s\n",
+	    "TID", "UID", "PRIO", "NAME", "STATUS", "USER", "SYSTEM", "READY",
+	    "BLOCKED", "VCSW", "IVCSW", "WAITS", "P99LAT");
+	return;
+    }
+    printf("tid,uid,priority,name,status,user,system,ready,blocked,"
+	"voluntary,involuntary");
+    for (int i = 0; i < LatencyBuckets; i++)
+	printf(",lat%d", (i == 0) ? 0 : 1 << (i - 1));
+    printf("\n");
+}
+
+void
+ThreadAccount::Print(PsFormat format)
+{
+    int waits = 0, p99, count, i;
+
+    if (format == PsCSV) {
+	printf("%d,%d,%d,\"%s\",%s,%d,%d,%d,%d,%d,%d", threadID, userID, 
+	    priority, name, status, userTicks, systemTicks, readyTicks, 
+	    blockedTicks, voluntarySwitches, involuntarySwitches);
+	for (i = 0; i < LatencyBuckets; i++)
+	    printf(",%d", latency[i]);
+	printf("\n");
+	return;
+    }
+
+    for (i = 0; i < LatencyBuckets; i++)
+	waits += latency[i];
+    for (i = 0, count = 0; i < LatencyBuckets - 1; i++)
+	if ((count += latency[i]) * 100 >= waits * 99)
+	    break;
+    if (i == 0)
+	p99 = 0;
+    else if (i < LatencyBuckets - 1)
+	p99 = (1 << i) - 1;
+    else
+	p99 = 1 << (i - 1);		// at least that; no upper bound
+    printf("%5d %5d %4d %-16.16s %-12s %8d %8d %8d %8d %6d %6d %6d %5d%s\n",
+	threadID, userID, priority, name, status, userTicks, systemTicks,
+	readyTicks, blockedTicks, voluntarySwitches, involuntarySwitches,
+	waits, p99, (i == LatencyBuckets - 1) ? "+" : " ");
+}
+
+//----------------------------------------------------------------------
+// Thread::PrintAccounts
+// 	Print the accounting of every thread that has existed, in order
+//	of thread ID, in the format chosen with -ps.  Finished threads
+//	were kept by ~Thread.
+//----------------------------------------------------------------------
+
+static int
+CompareAccounts(const void *a, const void *b)
+{
+    return (*(ThreadAccount **)a)->threadID - (*(ThreadAccount **)b)->threadID;
+}
+
+void
+Thread::PrintAccounts()
+{
+    ThreadAccount **accounts;
+    ThreadAccount *done;
+    Thread *t;
+    int n = 0;
+
+    for (t = allThreads; t != NULL; t = t->allNext)
+	n++;
+    for (done = finishedAccounts; done != NULL; done = done->next)
+	n++;
+    accounts = new ThreadAccount*[n];
+    n = 0;
+    for (t = allThreads; t != NULL; t = t->allNext) {
+	t->account.threadID = t->threadID;
+	t->account.userID = t->userID;
+	t->account.priority = t->priority;
+	t->account.name = t->name;
+	t->account.status = statusNames[t->status];
+	accounts[n++] = &t->account;
+    }
+    for (done = finishedAccounts; done != NULL; done = done->next)
+	accounts[n++] = done;
+    qsort(accounts, n, sizeof(ThreadAccount *), CompareAccounts);
+
+    printf("\n");
+    ThreadAccount::PrintHeader(psFormat);
+    for (int i = 0; i < n; i++)
+	accounts[i]->Print(psFormat);
+    delete [] accounts;
+}
@@ -39,6 +39,8 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "intrusivelist.h"
+#include "arena.h"
 
 #ifdef USER_PROGRAM
 #include "machine.h"
@@ -55,13 +57,70 @@
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize	(4 * 1024)	// in words
 
+// Stacks are got from the host this many at a time, sharing their
+// guard pages, since each mapping and each guard page counts against
+// the host's limit on how many pieces our address space is cut into.
+#define StackRegionSize	64
+
+// Stacks of finished threads are kept for reuse.  They are never
+// given back to the host, but the memory of those beyond this many
+// in the pool is.
+#define StackPoolSize	1024
+
+
+// The dynamic priority lent to a thread that holds no lock anyone is
+// waiting for (cf. Lock::Acquire)
+#define NotDonated	0x7fffffff
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
 
+class Lock;
+class Scheduler;
+
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);	 
 
+// How "-ps" prints the thread accounting at halt, if at all
+enum PsFormat { PsNone, PsTable, PsCSV };
+
+// Run-queue latencies are counted in LatencyBuckets buckets: bucket 0
+// for no wait, bucket i for [2^(i-1), 2^i) ticks, the last open-ended.
+#define LatencyBuckets	16
+
+// The following class defines the accounting kept for each thread by
+// the scheduler (see Scheduler::Run and Scheduler::ReadyToRun): where
+// its time went, how often it gave up the CPU, and how long it waited
+// on the ready list each time.  With -ps, it outlives the thread, to
+// be printed at halt.
+
+class ThreadAccount {
+  public:
+    ThreadAccount();			// initialize the counts to zero
+
+    void RecordLatency(int ticks);	// the thread waited "ticks" on
+					// the ready list before running
+    static void PrintHeader(PsFormat format);
+    void Print(PsFormat format);	// one line, ps-like or CSV
+
+    int userTicks;			// CPU time spent in user code
+    int systemTicks;			// CPU time spent in the kernel
+    int readyTicks;			// time spent READY
+    int blockedTicks;			// time spent BLOCKED
+    int voluntarySwitches;		// gave up the CPU by blocking 
+    int involuntarySwitches;		// ... while still runnable (time
+					// slices, Yield)
+    int latency[LatencyBuckets];	// histogram of run-queue waits
+    int since;				// when it last became RUNNING, 
+					// READY or BLOCKED
+
+    // filled in when printed, or when the thread finishes
+    int threadID, userID, priority;
+    char *name;
+    const char *status;
+    ThreadAccount *next;		// on the list of finished threads
+};
+
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
 //
@@ -89,16 +148,23 @@ class Thread {
 
     // basic thread operations
 
-    void Fork(VoidFunctionPtr func, int arg); 	// Make thread run (*func)(arg)
+    bool Fork(VoidFunctionPtr func, int arg); 	// Make thread run (*func)(arg);
+						// FALSE if there is no stack
+    void ForkIdle(VoidFunctionPtr func, int arg);	// Likewise, but as a
+						// CPU's idle thread, which is 
+						// never on the ready list
     void Yield();  				// Relinquish the CPU if any 
 						// other thread is runnable
     void Sleep();  				// Put the thread to sleep and 
 						// relinquish the processor
+    void SleepFor(int ticks);			// Sleep, until "ticks" of
+						// simulated time have passed
     void Finish();  				// The thread is done executing
     
     void CheckOverflow();   			// Check if thread has 
 						// overflowed its stack
     void setStatus(ThreadStatus st) { status = st; }
+    ThreadStatus getStatus() { return status; }
     char* getName() { return (name); }
     void Print() { printf("%s, ", name); }
 
@@ -106,12 +172,11 @@ class Thread {
       const char *statusToString[] { "JUST_CREATED", "RUNNING", "READY", "BLOCKED" };      
       printf("%4d %6d %4d %-16s %-8s\n", threadID, userID, priority, name, statusToString[status]);      
     }
-    void setPriority(int p) {
-      ASSERT(p >= 0 && p < 16);
-      priority = p;
-    }
+    void setPriority(int p);
     int getPriority() { return priority; }
-    int getDynamicPriority() { return dynamicPrior; }
+    int getDynamicPriority() 		// including any priority lent 
+      { return (donatedPrior < dynamicPrior) ? donatedPrior : dynamicPrior; }
+    void setDonatedPriority(int p);
     void IncreaseTimeSliceNum() { timeSliceNum++; }
     int getTimeSliceNum() { return timeSliceNum; }
     void UpdateDynamicPriority() {
@@ -120,6 +185,38 @@ class Thread {
         dynamicPrior = 100000000;
       }
     int getThreadID() { return threadID; }
+
+    // used by the Scheduler to keep the ready queues; only meaningful 
+    // while the thread is READY
+    ListLink<Thread> readyLink;		// neighbours in the ready queue
+    int readyLevel;			// which ready queue, -1 if none
+    Scheduler *readyOn;			// which ready list (i.e. CPU)
+
+    // used by WaitQueue, while the thread is BLOCKED on one
+    ListLink<Thread> waitLink;		// neighbours in the wait queue
+
+    // used by Lock, for priority inheritance
+    Lock *waitingFor;			// the lock it is blocked acquiring
+    Lock *heldLocks;			// the locks it holds, linked 
+					// through Lock::nextHeld
+
+    int cpuTicks;			// busy ticks spent running
+    int wakeTime;			// when last made ready from blocked,
+					// -1 once it has run since
+    ThreadAccount account;		// where its time went
+
+    Arena scratch;			// temporary buffers of the system
+					// call or file operation it is doing
+
+    static PsFormat psFormat;		// how to print the accounting
+    static void PrintAccounts();	// Print it for every thread, 
+					// live or finished (cf. -ps)
+
+    // used by the FairScheduler
+    int vruntime;			// CPU time, scaled by weight
+    int fairSeq;			// breaks ties in vruntime, FIFO
+    Thread *fairLeft, *fairRight;	// subtrees of the ready tree
+    int fairHeight;			// height of that subtree
     
   private:
     // some of the private data for this class is listed above
@@ -135,11 +232,21 @@ class Thread {
     int priority;    // priority of the thread, valued in [0, 15]
     int timeSliceNum;    // Number of used time slices
     int dynamicPrior;    // dynamic priority
+    int donatedPrior;    // best dynamic priority of the threads waiting
+			 // for our locks, NotDonated if none
     static int nextThreadID;
 
     static int totalNumber;
+    static Thread *allThreads;		// every live thread, linked 
+    Thread *allNext, *allPrev;		// through these, for -ps
+
+    static int *stackPool;		// stacks kept for reuse, linked
+					// through their first word
+    static int stackPoolCount;		// how many stacks are in the pool
+    static int *GetStack();		// a stack, from the pool if possible
+    static void PutStack(int *stack);	// return a stack to the pool
 
-    void StackAllocate(VoidFunctionPtr func, int arg);
+    bool StackAllocate(VoidFunctionPtr func, int arg);
     					// Allocate a stack for thread.
 					// Used internally by Fork()
 
@@ -149,10 +256,18 @@ class Thread {
 // while executing kernel code.
 
     int userRegisters[NumTotalRegs];	// user-level CPU register state
+    Machine *registersIn;		// the processor still holding our
+					// user registers, or NULL if they
+					// are in userRegisters
 
   public:
     void SaveUserState();		// save user-level register state
     void RestoreUserState();		// restore user-level register state
+    void LeaveUserState();		// stop running, but leave it in
+					// the processor until it is needed
+    void MakeRoomForUserState();	// get it out of other processors,
+					// and others' out of this one
+    bool UserStateLoaded();		// is it in this processor already?
 
     AddrSpace *space;			// User code this thread is running.
     int joinReturnValue;
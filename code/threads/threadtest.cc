@@ -12,6 +12,7 @@
 #include "copyright.h"
 #include "system.h"
 #include "synch.h"
+#include "synchlist.h"
 
 // testnum is set in main.cc
 int testnum = 1;
@@ -240,6 +241,281 @@ void ThreadTest8() {
     printf("*** thread main resume...\n");
 }
 
+//----------------------------------------------------------------------
+// Fork/Finish benchmark
+//	Measure how many threads can be forked, run and finished per
+//	host second, with batches of increasingly many threads alive at
+//	once.  Each thread does nothing but count itself.
+//
+//	Then fork "heldThreads" threads that all stay alive, each waiting
+//	on a semaphore, until the last has started: more stacks than the
+//	host would let us map one at a time, each with its own guard
+//	pages.
+//----------------------------------------------------------------------
+
+int benchFinished;
+int benchStarted;
+Semaphore *benchHold;
+
+void BenchThread(int dummy) {
+    benchFinished++;
+}
+
+void HeldThread(int dummy) {
+    benchStarted++;
+    benchHold->P();
+    benchFinished++;
+}
+
+void ThreadTest9() {
+    int batches[3] = { 10, 1000, 10000 };
+    int rounds = 100000;
+    int heldThreads = 40000;
+
+    for(int b = 0; b < 3; b++) {
+        double start = HostTime();
+        int forked = 0;
+
+        while(forked < rounds) {
+            benchFinished = 0;
+            for(int i = 0; i < batches[b]; i++) {
+                Thread *t = new Thread("bench thread");
+                t->Fork(BenchThread, 0);
+            }
+            while(benchFinished < batches[b])
+                currentThread->Yield();
+            forked += batches[b];
+        }
+        printf("*** %d threads at a time: %d forks in %.3f seconds, %.0f per second\n",
+            batches[b], forked, HostTime() - start,
+            forked / (HostTime() - start));
+    }
+
+    double start = HostTime();
+    int alive = 0;
+
+    benchHold = new Semaphore("bench hold", 0);
+    benchStarted = benchFinished = 0;
+    for(int i = 0; i < heldThreads; i++) {
+        Thread *t = new Thread("held thread");
+        if(t->Fork(HeldThread, 0))
+            alive++;
+        else
+            delete t;
+    }
+    while(benchStarted < alive)
+        currentThread->Yield();
+    printf("*** %d of %d threads alive at once after %.3f seconds\n",
+        benchStarted, heldThreads, HostTime() - start);
+    for(int i = 0; i < alive; i++)
+        benchHold->V();
+    while(benchFinished < alive)
+        currentThread->Yield();
+    printf("*** all %d finished after %.3f seconds\n", benchFinished,
+        HostTime() - start);
+    delete benchHold;
+}
+
+//----------------------------------------------------------------------
+// Priority inversion test functions
+//	"low" (priority 15) holds lock A and has work to do; "middle"
+//	(10) holds lock B and waits for A; "high" (0) waits for B.  Three
+//	threads of priority 5, which need no lock, are ready at the same
+//	time.  Without priority inheritance they run ahead of "low", and
+//	so ahead of "high"; with it, "high" lends its priority down the
+//	chain of holders, and waits only for the critical sections --
+//	less than any one of the medium threads runs.
+//----------------------------------------------------------------------
+
+#define CriticalTicks	300	// how long "low" holds lock A
+#define MediumTicks	1500	// how long each medium thread runs
+
+Lock *lockA, *lockB;
+Semaphore *invReady, *invGo, *invDone;
+int highLatency;
+
+// Burn "ticks" of simulated time, letting the timer interrupt us
+void Spin(int ticks) {
+    for(int i = 0; i < ticks; i += SystemTick) {
+        interrupt->SetLevel(IntOff);
+        interrupt->SetLevel(IntOn);
+    }
+}
+
+void InversionLow(int dummy) {
+    lockA->Acquire();
+    invReady->V();
+    invGo->P();
+    Spin(CriticalTicks);
+    lockA->Release();
+}
+
+void InversionMiddle(int dummy) {
+    lockB->Acquire();
+    invReady->V();
+    invGo->P();
+    lockA->Acquire();
+    lockA->Release();
+    lockB->Release();
+}
+
+void InversionHigh(int dummy) {
+    int start = stats->totalTicks;
+
+    lockB->Acquire();
+    highLatency = stats->totalTicks - start;
+    lockB->Release();
+    invDone->V();
+}
+
+void InversionMedium(int dummy) {
+    Spin(MediumTicks);
+    invDone->V();
+}
+
+void ThreadTest10() {
+    char* names[3] = { "medium 0", "medium 1", "medium 2" };
+    int oldPriority = currentThread->getPriority();
+    int latency[2];			// without and with inheritance
+
+    lockA = new Lock("lock A");
+    lockB = new Lock("lock B");
+    invReady = new Semaphore("inversion ready", 0);
+    invGo = new Semaphore("inversion go", 0);
+    invDone = new Semaphore("inversion done", 0);
+    currentThread->setPriority(0);	// so that we set up undisturbed
+
+    for(int run = 0; run < 2; run++) {
+        Lock::priorityInheritance = (run == 1);
+
+        (new Thread("low", 15))->Fork(InversionLow, 0);
+        invReady->P();
+        (new Thread("middle", 10))->Fork(InversionMiddle, 0);
+        invReady->P();
+        (new Thread("high", 0))->Fork(InversionHigh, 0);
+        for(int i = 0; i < 3; i++)
+            (new Thread(names[i], 5))->Fork(InversionMedium, 0);
+        invGo->V();
+        invGo->V();
+        for(int i = 0; i < 4; i++)	// "high" and the medium threads
+            invDone->P();
+
+        latency[run] = highLatency;
+        printf("*** priority inheritance %s: high waited %d ticks\n",
+            Lock::priorityInheritance ? "on" : "off", highLatency);
+    }
+    ASSERT(latency[1] < latency[0]);
+    ASSERT(latency[1] < MediumTicks);
+    Lock::priorityInheritance = TRUE;
+    currentThread->setPriority(oldPriority);
+}
+
+//----------------------------------------------------------------------
+// Timed sleep test functions
+//	Threads sleep for different times, and should wake up in order
+//	of their deadlines, never early.  Then one thread waits on a 
+//	condition until it times out, and another is signaled before 
+//	its timeout.
+//----------------------------------------------------------------------
+
+#define SignalTicks	1000	// when main signals the timed waiters
+
+Lock *sleepLock;
+Condition *sleepCondition;
+int lastDeadline;		// the latest jiffy a sleeper was due in
+
+void SleepingThread(int ticks) {
+    int start = stats->totalTicks;
+    int deadline = (start + ticks + CalloutTick - 1) / CalloutTick;
+
+    currentThread->SleepFor(ticks);
+    printf("*** thread asked to sleep %d ticks slept %d\n", ticks,
+        stats->totalTicks - start);
+    ASSERT(stats->totalTicks - start >= ticks);
+    ASSERT(deadline >= lastDeadline);	// callouts only fire by the jiffy
+    lastDeadline = deadline;
+}
+
+void TimedWaitThread(int timeout) {
+    int start = stats->totalTicks;
+    bool signaled;
+
+    sleepLock->Acquire();
+    signaled = sleepCondition->Wait(sleepLock, timeout);
+    printf("*** thread waiting at most %d ticks %s after %d\n", timeout,
+        signaled ? "signaled" : "timed out", stats->totalTicks - start);
+    ASSERT(signaled == (timeout > SignalTicks));
+    ASSERT(signaled || stats->totalTicks - start >= timeout);
+    sleepLock->Release();
+}
+
+void ThreadTest11() {
+    int ticks[5] = { 2500, 30, 700, 15000, 700 };
+
+    lastDeadline = 0;
+    for(int i = 0; i < 5; i++)
+        (new Thread("sleeper"))->Fork(SleepingThread, ticks[i]);
+    currentThread->SleepFor(20000);
+
+    sleepLock = new Lock("sleep lock");
+    sleepCondition = new Condition("sleep condition");
+    (new Thread("short wait"))->Fork(TimedWaitThread, 300);
+    (new Thread("long wait"))->Fork(TimedWaitThread, 100000);
+    currentThread->SleepFor(SignalTicks);
+    sleepLock->Acquire();
+    sleepCondition->Signal(sleepLock);	// only "long wait" is left
+    sleepLock->Release();
+}
+
+//----------------------------------------------------------------------
+// Intrusive list test functions
+//	A producer hands numbered items to the main thread through a
+//	SynchList, which must keep them in order.  Main files them on a
+//	SortedIntrusiveList under scrambled keys, through the same link,
+//	and checks that they come off in key order.
+//----------------------------------------------------------------------
+
+class ListTestItem {
+  public:
+    int value;
+    ListLink<ListTestItem> link;
+};
+
+SynchList<ListTestItem, &ListTestItem::link> *handoff;
+
+void ListProducer(int n) {
+    for(int i = 0; i < n; i++) {
+        ListTestItem *item = new ListTestItem;
+        item->value = i;
+        handoff->Append(item);
+        if(i % 3 == 0)
+            currentThread->Yield();	// so that main waits sometimes
+    }
+}
+
+void ThreadTest12() {
+    const int n = 20;			// keys (7 * i) % n are all different
+    SortedIntrusiveList<ListTestItem, &ListTestItem::link> sorted;
+    ListTestItem *item;
+    int key;
+
+    handoff = new SynchList<ListTestItem, &ListTestItem::link>;
+    (new Thread("producer"))->Fork(ListProducer, n);
+    for(int i = 0; i < n; i++) {
+        item = handoff->Remove();
+        ASSERT(item->value == i);
+        sorted.SortedInsert(item, (7 * i) % n);
+    }
+    for(int i = 0; i < n; i++) {
+        item = sorted.SortedRemove(&key);
+        ASSERT(key == i && (7 * item->value) % n == key);
+        delete item;
+    }
+    ASSERT(sorted.IsEmpty());
+    printf("*** %d items passed through the lists in order\n", n);
+    delete handoff;
+}
+
 //----------------------------------------------------------------------
 // ThreadTest
 // 	Invoke a test routine.
@@ -273,6 +549,18 @@ ThreadTest()
     case 8:
     ThreadTest8();
     break;
+    case 9:
+    ThreadTest9();
+    break;
+    case 10:
+    ThreadTest10();
+    break;
+    case 11:
+    ThreadTest11();
+    break;
+    case 12:
+    ThreadTest12();
+    break;
     default:
 	printf("No test specified.\n");
 	break;
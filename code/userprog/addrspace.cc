@@ -97,6 +97,7 @@ AddrSpace::AddrSpace(OpenFile *executable)
         pageTable[i].virtualPage = i;	// for now, virtual page # = phys page #
         pageTable[i].valid = FALSE;
     }
+    asid = machine->AllocateASID(pageTable);
 #endif  
     lock = (int)new Lock("addrspace lock");
     condition = (int)new Condition("addrspace condition");
@@ -118,7 +119,11 @@ AddrSpace::~AddrSpace()
             machine->memUseage->Clear(pageTable[i].physicalPage);
         }
     }
-    delete pageTable;
+    machine->FreeASID(asid);
+    for (Machine *m = machine->firstProcessor; m != NULL; m = m->nextProcessor)
+	if (m->pageTable == pageTable)	// so that IsLoaded can't mistake
+	    m->pageTable = NULL;	// a new page table there for ours
+    delete [] pageTable;
 #endif
     delete executable;
 }
@@ -160,24 +165,13 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	For now, nothing!  TLB entries are tagged with the address space
+//	they belong to, so they can stay in the TLB; they are written
+//	back to our page table when they are replaced.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
 {
-    // Make TLB invalid on a context switch
-    for(int i = 0; i < TLBSize; i++) {
-        if(machine->tlb[i].valid) {
-#ifdef USE_INVERTED_TABLE
-            TranslationEntry *next = machine->invertedPageTable[machine->tlb[i].physicalPage].next;
-            machine->invertedPageTable[machine->tlb[i].physicalPage] = machine->tlb[i];
-            machine->invertedPageTable[machine->tlb[i].physicalPage].next = next;
-#else
-            machine->pageTable[machine->tlb[i].virtualPage] = machine->tlb[i];
-#endif
-            machine->tlb[i].valid = false;
-        }
-    }
 }
 
 //----------------------------------------------------------------------
@@ -185,14 +179,43 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine where to find the page table, and
+//	which TLB entries are ours.  With an inverted page table, pages
+//	(and so TLB entries) belong to threads rather than address spaces.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
 #ifndef USE_INVERTED_TABLE
     machine->pageTable = pageTable;
-    machine->pageTableSize = numPages;
+    machine->currentASID = asid;
+#else
+    machine->currentASID = currentThread->getThreadID();
+#endif
+    machine->pageTableSize = numPages;	// how much of the address
+					// space is valid, in either case
+    machine->FlushSoftTLB();
+    stats->numSpaceLoads++;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsLoaded
+// 	Return TRUE if the processor is still set up to run this address
+//	space, as when switching between threads that share it, or back
+//	from a kernel thread.  The translation cache need not be flushed
+//	then: whatever takes translations away flushes it on every
+//	processor.
+//
+//	With an inverted page table, each thread has its own ASID, so 
+//	the address space must always be restored.
+//----------------------------------------------------------------------
+
+bool AddrSpace::IsLoaded()
+{
+#ifndef USE_INVERTED_TABLE
+    return machine->pageTable == pageTable && machine->currentASID == asid;
+#else
+    return FALSE;
 #endif
 }
 
@@ -31,12 +31,15 @@ class AddrSpace {
 
     void SaveState();			// Save/restore address space-specific
     void RestoreState();		// info on a context switch 
+    bool IsLoaded();			// Is it still loaded, so there is
+					// nothing to restore?
 
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
           // address space
+    int asid;				// Tags our entries in the TLB
   
   public:
     OpenFile *executable;
@@ -9,6 +9,8 @@
 #include "copyright.h"
 #include "bitmap.h"
 
+SlabCache BitMap::cache("BitMap", sizeof(BitMap));
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "nitems" bits, so that every bit is clear.
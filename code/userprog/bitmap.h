@@ -18,6 +18,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "openfile.h"
+#include "slab.h"
 
 // Definitions helpful for representing a bitmap as an array of integers
 #define BitsInByte 	8
@@ -36,6 +37,10 @@ class BitMap {
     BitMap(int nitems);		// Initialize a bitmap, with "nitems" bits
 				// initially, all bits are cleared.
     ~BitMap();			// De-allocate bitmap
+
+    void *operator new(size_t size) { return cache.Allocate(size); }
+    void operator delete(void *p) { cache.Free(p); }
+				// (the bits are still on the heap)
     
     void Mark(int which);   	// Set the "nth" bit
     void Clear(int which);  	// Clear the "nth" bit
@@ -59,6 +64,8 @@ class BitMap {
 					//  multiple of the number of bits in
 					//  a word)
     unsigned int *map;			// bit storage
+
+    static SlabCache cache;		// free bitmaps
 };
 
 #endif // BITMAP_H
@@ -48,6 +48,9 @@
 //	"which" is the kind of exception.  The list of possible exceptions 
 //	are in machine.h.
 //----------------------------------------------------------------------
+#define MaxUserStringLength 256  // longest string argument of a system call,
+                                 // including the null
+
 int FindVictimPhysPage() {
     return Random() % NumPhysPages;
 }
@@ -55,68 +58,38 @@ int getHashCode(int vpn) {
     return ((vpn * vpn) >> 4) % NumPhysPages;
 }
 
-void FIFOReplace(TranslationEntry *pageTableEntry) {
-    // Search for an empty block in TLB
-    TranslationEntry *entry;
-    int i;
-    for (entry = NULL, i = 0; i < TLBSize; i++)
-        if (!machine->tlb[i].valid) {
-            // FOUND an empty block
-            entry = &machine->tlb[i];
-            break;
-        }
-    
-    // If there is no empty block in TLB
-    if(entry == NULL) {
-        entry = machine->tlb + machine->nextVictim;
-        machine->nextVictim = (machine->nextVictim + 1) % TLBSize;
-        DEBUG('v', "Kick virtual page %d out of TLB, index: %d\n", entry->virtualPage, entry - machine->tlb);
-        machine->pageTable[entry->virtualPage] = *entry; // Write back to page table
-    }
-
-    // Write TLB
-    ASSERT(entry != NULL);
-    *entry = *pageTableEntry;
-    entry->valid = true;
-    DEBUG('v', "Write virtual page %d into TLB, index: %d\n", entry->virtualPage, entry - machine->tlb);
-}
-
-void LRUReplace(TranslationEntry *pageTableEntry) {
-    // Search for an empty block in TLB
-    TranslationEntry *entry;
-    int i, minTime = 0x7FFFFFFF, minIndex;
-    for (entry = NULL, i = 0; i < TLBSize; i++) {
-        if (!machine->tlb[i].valid) {
+#ifdef USE_TLB
+void TLBReplace(TranslationEntry *pageTableEntry) {
+    // Search for an empty block in the TLB set this page maps to
+    TranslationEntry *set = machine->TLBSet(pageTableEntry->virtualPage, machine->currentASID);
+    int setIndex = (set - machine->tlb) / machine->tlbWays;
+    TranslationEntry *entry = NULL;
+    for (int i = 0; i < machine->tlbWays; i++)
+        if (!set[i].valid) {
             // FOUND an empty block
-            entry = &machine->tlb[i];
+            entry = &set[i];
             break;
         }
-        if(machine->tlb[i].lastUseTime < minTime) {
-            minIndex = i;
-            minTime = machine->tlb[i].lastUseTime;
-        }
-    }
     
-    // If there is no empty block in TLB
+    // If there is no empty block in the set, let the policy choose
     if(entry == NULL) {
-        entry = machine->tlb + minIndex;
+        entry = &set[tlbPolicy->ChooseVictim(set, setIndex)];
+        tlbPolicy->numEvictions++;
         DEBUG('v', "Kick virtual page %d out of TLB, index: %d\n", entry->virtualPage, entry - machine->tlb);
-#ifdef USE_INVERTED_TABLE
-        TranslationEntry *next = machine->invertedPageTable[entry->physicalPage].next;
-        machine->invertedPageTable[entry->physicalPage] = *entry;
-        machine->invertedPageTable[entry->physicalPage].next = next;
-#else
-        machine->pageTable[entry->virtualPage] = *entry; // Write back to page table
-#endif
+        machine->InvalidateSoftTLB(entry->virtualPage);
+        machine->WriteBackTLBEntry(entry); // Write back to page table
     }
+    else
+        tlbPolicy->numFills++;
 
     // Write TLB
-    ASSERT(entry != NULL);
     *entry = *pageTableEntry;
     entry->valid = true;
+    entry->asid = machine->currentASID;
     entry->lastUseTime = stats->totalTicks; // Update last use time
     DEBUG('v', "Write virtual page %d into TLB, index: %d\n", entry->virtualPage, entry - machine->tlb);
 }
+#endif // USE_TLB
 
 int PageTableInvalidHandler(int badVAddr, unsigned int vpn) {
     // First, we need to find a empty physical page and initialize page table entry
@@ -132,15 +105,9 @@ int PageTableInvalidHandler(int badVAddr, unsigned int vpn) {
         DEBUG('v', "Kick physical page #%d out of main memory, thread ID = %d, Vpn = %d\n",
                 victim, machine->invertedPageTable[victim].threadID,
                 machine->invertedPageTable[victim].virtualPage);
-        // Search whether victim is in TLB, if so, set as invalid
-        if(machine->invertedPageTable[victim].threadID == currentThread->getThreadID()) {
-            for(int i = 0; i < TLBSize; i++) {
-                if(machine->tlb[i].valid && machine->tlb[i].physicalPage == victim) {
-                    machine->tlb[i].valid = FALSE;
-                    break;
-                }
-            }
-        }
+        // If victim is in a TLB (of any CPU), write it back (it may
+        // be dirty) and set as invalid
+        machine->InvalidatePhysPage(victim);
 
         // Check flags, write to swap area
         if(machine->invertedPageTable[victim].dirty) {
@@ -211,6 +178,7 @@ int PageTableInvalidHandler(int badVAddr, unsigned int vpn) {
                     // pages to be read-only
 #endif
     bzero(&(machine->mainMemory[ppn * PageSize]), PageSize);
+    machine->InvalidateDecodedPage(ppn); // frame gets new contents below
 
 #ifdef USE_INVERTED_TABLE
     // If this page is in swap area, just read from swap area
@@ -299,25 +267,22 @@ int PageTableInvalidHandler(int badVAddr, unsigned int vpn) {
     return ppn;
 }
 
+// Copy a string argument of a system call (e.g. a file name) out of user
+// space. Returns a string in the thread's arena, freed when the system
+// call returns, or NULL if the argument is bad
+char *ReadUserString(int virtAddr) {
+    char *buffer = currentThread->scratch.Allocate(MaxUserStringLength);
+    if(machine->CopyStringFromUser(virtAddr, buffer, MaxUserStringLength) < 0)
+        return NULL;
+    return buffer;
+}
+
 void CreateSyscallHandler() {
-    currentThread->SaveUserState();
-    // First, get the length of filename
-    int fileNameBase = machine->ReadRegister(4);
-    int value;
-    int length = 0;
-    do {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        length++;
-    } while(value != '\0');
-
-    // Copy filename
-    char *fileName = new char[length];
-    fileNameBase -= length; length--;
-    for(int i = 0; i < length; i++) {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        fileName[i] = char(value);
+    char *fileName = ReadUserString(machine->ReadRegister(4));
+    if(fileName == NULL) {
+        DEBUG('a', "Bad file name\n");
+        return;
     }
-    fileName[length] = '\0';
     DEBUG('a', "File name: %s\n", fileName);
 
     bool result = fileSystem->Create(fileName, 0);
@@ -326,29 +291,15 @@ void CreateSyscallHandler() {
         DEBUG('a', "Create file %s done\n", fileName);
     else
         DEBUG('a', "Can not create file %s\n", fileName);
-    delete fileName;
-    currentThread->RestoreUserState();
 }
 
 void OpenSyscallHandler() {
-    currentThread->SaveUserState();
-    // First, get the length of filename
-    int fileNameBase = machine->ReadRegister(4);
-    int value;
-    int length = 0;
-    do {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        length++;
-    } while(value != '\0');
-
-    // Copy filename
-    char *fileName = new char[length];
-    fileNameBase -= length; length--;
-    for(int i = 0; i < length; i++) {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        fileName[i] = char(value);
+    char *fileName = ReadUserString(machine->ReadRegister(4));
+    if(fileName == NULL) {
+        DEBUG('a', "Bad file name\n");
+        machine->WriteRegister(2, 0);
+        return;
     }
-    fileName[length] = '\0';
     DEBUG('a', "File name: %s\n", fileName);
 
     OpenFile *openFile = fileSystem->Open(fileName);
@@ -358,68 +309,62 @@ void OpenSyscallHandler() {
     else
         DEBUG('a', "Can not open file %s\n", fileName);
 
-    currentThread->RestoreUserState();
     machine->WriteRegister(2, (int)openFile);
 }
 
 void CloseSyscallHandler() {
-    currentThread->SaveUserState();
     OpenFile *openFile = (OpenFile *)machine->ReadRegister(4);
     DEBUG('a', "Close File\n");
     delete openFile;
-    currentThread->RestoreUserState();
     machine->WriteRegister(2, 0);
 }
 
 void WriteSyscallHandler() {
-    currentThread->SaveUserState();    
     int buffer = machine->ReadRegister(4);
     int size = machine->ReadRegister(5);
     OpenFile *openFile = (OpenFile *)machine->ReadRegister(6);
 
-    // Copy data from user space into kernel space
-    char *kernelBuffer = new char[size + 1];
-    int value, i;
-    for(i = 0; i < size; i++) {
-        bool success = machine->ReadMem(buffer++, 1, &value);
-        if(!success) {
-            buffer--; i--;
-            continue;
-        }
-        kernelBuffer[i] = char(value);
+    if(size < 0) {
+        machine->WriteRegister(2, -1);
+        return;
     }
-    kernelBuffer[i] = '\0';
 
-    // Write into file
-    int result = openFile->Write(kernelBuffer, size);
-    DEBUG('a', "Write %d bytes into file(%d bytes requested)\nContent: %s\n", result, size, kernelBuffer);
-    delete kernelBuffer;
-    currentThread->RestoreUserState();
+    // Copy data from user space into kernel space
+    char *kernelBuffer = currentThread->scratch.Allocate(size + 1);
+    int result = -1;
+    if(machine->CopyFromUser(buffer, kernelBuffer, size)) {
+        kernelBuffer[size] = '\0';
+
+        // Write into file
+        result = openFile->Write(kernelBuffer, size);
+        DEBUG('a', "Write %d bytes into file(%d bytes requested)\nContent: %s\n", result, size, kernelBuffer);
+    }
+    else
+        DEBUG('a', "Bad buffer address 0x%x\n", buffer);
     machine->WriteRegister(2, result);
 }
 
 void ReadSyscallHandler() {
-    currentThread->SaveUserState();
     int buffer = machine->ReadRegister(4);
     int size = machine->ReadRegister(5);
     OpenFile *openFile = (OpenFile *)machine->ReadRegister(6);
 
-    char *kernelBuffer = new char[size];
+    if(size < 0) {
+        machine->WriteRegister(2, -1);
+        return;
+    }
+    char *kernelBuffer = currentThread->scratch.Allocate(size);
 
     // Read from file into kernel space
     int result = openFile->Read(kernelBuffer, size);
 
     // Write into user space
-    for(int i = 0; i < result; i++) {
-        bool success = machine->WriteMem(buffer++, 1, (int)kernelBuffer[i]);
-        if(!success) {
-            buffer--; i--;
-        }
+    if(!machine->CopyToUser(buffer, kernelBuffer, result)) {
+        DEBUG('a', "Bad buffer address 0x%x\n", buffer);
+        result = -1;
     }
 
-    DEBUG('a', "Read %d bytes from file(%d bytes requested)\nContent: %s\n", size, result, kernelBuffer);
-    delete kernelBuffer;
-    currentThread->RestoreUserState();    
+    DEBUG('a', "Read %d bytes from file(%d bytes requested)\n", result, size);
     machine->WriteRegister(2, result);
 }
 
@@ -431,24 +376,12 @@ void ExecRoutine(int arg) {
 }
 
 void ExecSyscallHandler() {
-    currentThread->SaveUserState();
-    // First, get the length of filename
-    int fileNameBase = machine->ReadRegister(4);
-    int value;
-    int length = 0;
-    do {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        length++;
-    } while(value != '\0');
-
-    // Copy filename
-    char *fileName = new char[length];
-    fileNameBase -= length; length--;
-    for(int i = 0; i < length; i++) {
-        machine->ReadMem(fileNameBase++, 1, &value);
-        fileName[i] = char(value);
+    char *fileName = ReadUserString(machine->ReadRegister(4));
+    if(fileName == NULL) {
+        DEBUG('a', "Bad executable file name\n");
+        machine->WriteRegister(2, 0);
+        return;
     }
-    fileName[length] = '\0';
     DEBUG('a', "Executable file name: %s\n", fileName);
 
     OpenFile *executable = fileSystem->Open(fileName);
@@ -462,14 +395,23 @@ void ExecSyscallHandler() {
     }
 
     // Create an address space and a new thread
+    // (the thread keeps its name, so it cannot be in our arena)
     AddrSpace *addrSpace = new AddrSpace(executable);
-    Thread *forked = new Thread(fileName);
+    char *threadName = new char[strlen(fileName) + 1];
+    strcpy(threadName, fileName);
+    Thread *forked = new Thread(threadName);
     forked->space = addrSpace;
 
     // Run user program
-    forked->Fork(ExecRoutine, (int)machine);
+    if (!forked->Fork(ExecRoutine, (int)machine)) {
+        DEBUG('a', "No stack to run %s\n", fileName);
+        addrSpace->refNum--; // so it goes with the thread
+        delete forked;
+        delete [] threadName;
+        machine->WriteRegister(2, 0);
+        return;
+    }
     DEBUG('t', "Exec done\n");
-    currentThread->RestoreUserState();
     machine->WriteRegister(2, (int)addrSpace);
 }
 
@@ -483,35 +425,44 @@ void ForkRoutine(int arg) {
 }
 
 void ForkSyscallHandler() {
-    currentThread->SaveUserState(); // Save Registers
     int funcAddr = machine->ReadRegister(4);
 
     // Create a new thread in the same addrspace
     Thread *thread = new Thread("forked thread");
     thread->space = currentThread->space;
     thread->space->refNum++; // Increase RefNum
-    // thread->RestoreUserState();
-    thread->Fork(ForkRoutine, funcAddr);
-    currentThread->RestoreUserState(); // Save Registers
+    if (!thread->Fork(ForkRoutine, funcAddr)) {
+        DEBUG('a', "No stack for forked thread\n");
+        thread->space->refNum--;
+        delete thread;
+    }
 }
 
 void YieldSyscallHandler() {
-    currentThread->SaveUserState(); // Save Registers
     currentThread->Yield();
-    currentThread->RestoreUserState();
 }
 
 void JoinSyscallHandler() {
-    currentThread->SaveUserState();
     AddrSpace *addrSpace = (AddrSpace *)machine->ReadRegister(4);
     addrSpace->Wait();
     DEBUG('a', "Join finished\n");
     int exitCode = currentThread->joinReturnValue;
     DEBUG('a', "Get join exit code: %d", exitCode);
-    currentThread->RestoreUserState();
     machine->WriteRegister(2, exitCode);
 }
 
+void FutexWaitSyscallHandler() {
+    int addr = machine->ReadRegister(4);
+    int expected = machine->ReadRegister(5);
+    machine->WriteRegister(2, futexTable->Wait(addr, expected));
+}
+
+void FutexWakeSyscallHandler() {
+    int addr = machine->ReadRegister(4);
+    int count = machine->ReadRegister(5);
+    machine->WriteRegister(2, futexTable->Wake(addr, count));
+}
+
 void
 ExceptionHandler(ExceptionType which)
 {
@@ -569,6 +520,17 @@ ExceptionHandler(ExceptionType which)
             DEBUG('a', "Syscall: Join\n");
             JoinSyscallHandler();
         }
+        else if(type == SC_FutexWait) {
+            DEBUG('a', "Syscall: FutexWait\n");
+            FutexWaitSyscallHandler();
+        }
+        else if(type == SC_FutexWake) {
+            DEBUG('a', "Syscall: FutexWake\n");
+            FutexWakeSyscallHandler();
+        }
+
+        // Free the system call's temporary buffers
+        currentThread->scratch.Reset();
 
         // Increase PC
         machine->ReturnFromSyscall();        
@@ -615,8 +577,7 @@ ExceptionHandler(ExceptionType which)
 #endif // USE_INVERTED_TABLE
 
         // Handle TLB miss
-        // FIFOReplace(pageTableEntry);
-        LRUReplace(pageTableEntry);
+        TLBReplace(pageTableEntry);
 #else
         ASSERT(false);
 #endif
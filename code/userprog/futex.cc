@@ -0,0 +1,173 @@
+// futex.cc
+//	Routines to put user threads to sleep on a word of their memory,
+//	and wake them up.  See futex.h.
+//
+//	With interrupts disabled, nothing else in the kernel runs between
+//	reading the word and going to sleep (with -par, other CPUs may be
+//	running user code, but FutexWake needs the kernel, so it must
+//	wait).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "futex.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Futex::Futex
+// 	Initialize a futex, with nobody waiting yet.
+//
+//	"futexSpace", "futexAddr" -- which word of user memory it is
+//----------------------------------------------------------------------
+
+Futex::Futex(AddrSpace *futexSpace, int futexAddr)
+{
+    space = futexSpace;
+    addr = futexAddr;
+    waiters = new WaitQueue;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// Futex::~Futex
+// 	De-allocate a futex, once nobody is waiting on it.
+//----------------------------------------------------------------------
+
+Futex::~Futex()
+{
+    ASSERT(waiters->IsEmpty());
+    delete waiters;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable
+// 	Initialize an empty table of futexes.
+//----------------------------------------------------------------------
+
+FutexTable::FutexTable()
+{
+    for (int i = 0; i < FutexBuckets; i++)
+	buckets[i] = NULL;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::~FutexTable
+// 	De-allocate the table.  The threads still waiting (if we are
+//	halting) are not ours to delete.
+//----------------------------------------------------------------------
+
+FutexTable::~FutexTable()
+{
+    Futex *futex;
+
+    for (int i = 0; i < FutexBuckets; i++)
+	while ((futex = buckets[i]) != NULL) {
+	    buckets[i] = futex->next;
+	    while (futex->waiters->Remove() != NULL)
+		;
+	    delete futex;
+	}
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Find
+// 	Return the link to the futex for a word of user memory in its
+//	bucket: what points to it, or the NULL at the end of the bucket
+//	if no thread is waiting on the word.
+//
+//	"space", "addr" -- the word
+//----------------------------------------------------------------------
+
+Futex **
+FutexTable::Find(AddrSpace *space, int addr)
+{
+    unsigned hash = ((unsigned) space >> 4) ^ ((unsigned) addr >> 2);
+    Futex **link = &buckets[hash % FutexBuckets];
+
+    while (*link != NULL &&
+		((*link)->space != space || (*link)->addr != addr))
+	link = &(*link)->next;
+    return link;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+// 	If the word at "addr" in the running thread's address space
+//	still holds "expected", put the thread to sleep until another
+//	thread calls Wake on it.
+//
+// Returns:
+//	0 after sleeping; -1 if the word held something else, or "addr"
+//	is not a valid, aligned user address.
+//
+//	"addr" -- the word, as a user virtual address
+//	"expected" -- the value the thread saw there
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wait(int addr, int expected)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    AddrSpace *space = currentThread->space;
+    Futex **link;
+    int value;
+
+    if ((addr & 3) != 0 || !machine->CopyFromUser(addr, (char *) &value, 4)
+		|| (int) WordToHost(value) != expected) {
+	(void) interrupt->SetLevel(oldLevel);
+	return -1;
+    }
+    link = Find(space, addr);
+    if (*link == NULL)
+	*link = new Futex(space, addr);
+    DEBUG('a', "Thread \"%s\" waits on futex 0x%x\n",
+	currentThread->getName(), addr);
+    stats->numFutexWaits++;
+    (*link)->waiters->Append(currentThread);
+    currentThread->Sleep();
+
+    (void) interrupt->SetLevel(oldLevel);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+// 	Wake up threads waiting on the word at "addr" in the running
+//	thread's address space, best priority first.  The futex is
+//	forgotten once nobody waits on it.
+//
+// Returns:
+//	How many threads were woken up.
+//
+//	"addr" -- the word, as a user virtual address
+//	"count" -- the most threads to wake up
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wake(int addr, int count)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Futex **link = Find(currentThread->space, addr);
+    Futex *futex = *link;
+    Thread *thread;
+    int woken = 0;
+
+    stats->numFutexWakes++;
+    if (futex != NULL) {
+	while (woken < count &&
+		(thread = futex->waiters->Remove()) != NULL) {
+	    scheduler->ReadyToRun(thread);
+	    woken++;
+	}
+	if (futex->waiters->IsEmpty()) {
+	    *link = futex->next;
+	    delete futex;
+	}
+    }
+    DEBUG('a', "Woke %d threads waiting on futex 0x%x\n", woken, addr);
+
+    (void) interrupt->SetLevel(oldLevel);
+    return woken;
+}
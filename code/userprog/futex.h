@@ -0,0 +1,67 @@
+// futex.h
+//	Data structures for "futexes" (fast user-space mutexes): queues
+//	of user threads waiting for a word of their memory to change.
+//
+//	User-level locks and condition variables (test/usync.c) keep their
+//	state in a word of user memory, and change it atomically without
+//	entering the kernel.  Only a thread that has to wait makes the
+//	FutexWait system call, which puts it to sleep if the word still
+//	holds the value the thread saw, and a thread that changes the word
+//	and knows there may be waiters calls FutexWake.  Checking the word
+//	and going to sleep are atomic with respect to FutexWake, so a wake
+//	up between a thread's look at the word and its call is not lost:
+//	the word has changed, and FutexWait returns at once.
+//
+//	A futex is named by its address space and virtual address.  The
+//	kernel only keeps a wait queue for it while threads are waiting,
+//	in a hash table.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "copyright.h"
+#include "synch.h"
+
+class AddrSpace;
+
+#define FutexBuckets	64		// hash table size
+
+// The following class defines the threads waiting on one futex.
+
+class Futex {
+  public:
+    Futex(AddrSpace *futexSpace, int futexAddr);
+					// initialize a futex with no waiters
+    ~Futex();
+
+    AddrSpace *space;			// the address space, and address,
+    int addr;				// of the word
+    WaitQueue *waiters;			// the threads waiting for it
+    Futex *next;			// the next futex in its bucket
+};
+
+// The following class defines every futex with threads waiting on it.
+
+class FutexTable {
+  public:
+    FutexTable();			// initialize an empty table
+    ~FutexTable();
+
+    int Wait(int addr, int expected);	// Sleep if the word at "addr" in
+					// our address space is "expected";
+					// 0 once woken, -1 if it wasn't
+    int Wake(int addr, int count);	// Wake up to "count" threads
+					// waiting on "addr"; how many
+
+  private:
+    Futex *buckets[FutexBuckets];	// the futexes with waiters
+
+    Futex **Find(AddrSpace *space, int addr);	// Where the futex is,
+					// or would go, in its bucket
+};
+
+#endif // FUTEX_H
@@ -29,6 +29,8 @@
 #define SC_Close	8
 #define SC_Fork		9
 #define SC_Yield	10
+#define SC_FutexWait	11
+#define SC_FutexWake	12
 
 #ifndef IN_ASM
 
@@ -124,6 +126,30 @@ void Fork(void (*func)());
  */
 void Yield();		
 
+
+/* User-level synchronization: FutexWait, FutexWake and CompareAndSwap.
+ * Locks and condition variables (see test/usync.h) keep their state
+ * in a word of user memory, and only enter the kernel to wait, or to 
+ * wake up threads that are waiting.
+ */
+
+/* Atomically: if *addr is "old", set it to "replacement".  Return the
+ * value *addr had.  Runs entirely in user mode, with LL and SC, so it
+ * is atomic even with other CPUs running threads of the same program.
+ */
+int CompareAndSwap(int *addr, int old, int replacement);
+
+/* If *addr is still "expected", sleep until a FutexWake on "addr" by
+ * another thread of this address space.  Return 0 once woken up, -1 at
+ * once if *addr has changed (or "addr" is bad).
+ */
+int FutexWait(int *addr, int expected);
+
+/* Wake up to "count" threads waiting on "addr", and return how many 
+ * there were.
+ */
+int FutexWake(int *addr, int count);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */
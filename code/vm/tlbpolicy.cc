@@ -0,0 +1,171 @@
+// tlbpolicy.cc 
+//	Routines to choose which TLB entry to replace on a TLB miss.
+//	See tlbpolicy.h for the interface.
+//
+//	The policies only pick the victim.  Writing the victim back to 
+//	its page table and loading the new entry is done by the TLB miss
+//	handler in exception.cc.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "tlbpolicy.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// TLBPolicy::TLBPolicy
+// 	Initialize the state common to every replacement policy.
+//
+//	"policyName" -- the name of the policy, for printing
+//	"numSets", "numWays" -- the shape of the TLB
+//----------------------------------------------------------------------
+
+TLBPolicy::TLBPolicy(char *policyName, int numSets, int numWays)
+{
+    name = policyName;
+    sets = numSets;
+    ways = numWays;
+    numFills = numEvictions = 0;
+}
+
+//----------------------------------------------------------------------
+// TLBPolicy::Print
+// 	Print the shape of the TLB, the policy, and how it did, so that
+//	runs with different configurations can be compared.
+//----------------------------------------------------------------------
+
+void
+TLBPolicy::Print()
+{
+    int lookups = stats->numTLBHits + stats->numTLBMisses;
+
+    printf("TLB: %d entries, %d-way, %s replacement: hits %d, misses %d "
+	   "(%.2f%%), fills %d, evictions %d\n", sets * ways, ways, name,
+	   stats->numTLBHits, stats->numTLBMisses,
+	   (lookups > 0) ? 100.0 * stats->numTLBMisses / lookups : 0.0,
+	   numFills, numEvictions);
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::FIFOPolicy
+// 	Start every set's victim pointer at its first entry, which is 
+//	where the first entry of the set is loaded.
+//----------------------------------------------------------------------
+
+FIFOPolicy::FIFOPolicy(int numSets, int numWays)
+    : TLBPolicy("fifo", numSets, numWays)
+{
+    next = new int[sets];
+    for (int i = 0; i < sets; i++)
+	next[i] = 0;
+}
+
+FIFOPolicy::~FIFOPolicy()
+{
+    delete [] next;
+}
+
+//----------------------------------------------------------------------
+// FIFOPolicy::ChooseVictim
+// 	Replace the entries of a set in turn.
+//----------------------------------------------------------------------
+
+int
+FIFOPolicy::ChooseVictim(TranslationEntry *set, int setIndex)
+{
+    int victim = next[setIndex];
+
+    next[setIndex] = (victim + 1) % ways;
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// LRUPolicy::ChooseVictim
+// 	Replace the entry with the oldest last use time.  The time is
+//	updated on every TLB hit (see Machine::Translate).
+//----------------------------------------------------------------------
+
+int
+LRUPolicy::ChooseVictim(TranslationEntry *set, int setIndex)
+{
+    int victim = 0;
+
+    for (int i = 1; i < ways; i++)
+	if (set[i].lastUseTime < set[victim].lastUseTime)
+	    victim = i;
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// RandomPolicy::ChooseVictim
+// 	Replace an entry chosen at random.
+//----------------------------------------------------------------------
+
+int
+RandomPolicy::ChooseVictim(TranslationEntry *set, int setIndex)
+{
+    return Random() % ways;
+}
+
+//----------------------------------------------------------------------
+// ClockPolicy::ClockPolicy
+// 	Start every set's hand at its first entry.
+//----------------------------------------------------------------------
+
+ClockPolicy::ClockPolicy(int numSets, int numWays)
+    : TLBPolicy("clock", numSets, numWays)
+{
+    hand = new int[sets];
+    for (int i = 0; i < sets; i++)
+	hand[i] = 0;
+}
+
+ClockPolicy::~ClockPolicy()
+{
+    delete [] hand;
+}
+
+//----------------------------------------------------------------------
+// ClockPolicy::ChooseVictim
+// 	Advance the hand until it reaches an entry that hasn't been used
+//	since the hand last passed it, clearing the use bits on the way.
+//	Terminates within two sweeps of the set.
+//----------------------------------------------------------------------
+
+int
+ClockPolicy::ChooseVictim(TranslationEntry *set, int setIndex)
+{
+    int victim;
+
+    for (;;) {
+	victim = hand[setIndex];
+	hand[setIndex] = (victim + 1) % ways;
+	if (!set[victim].use)
+	    return victim;
+	set[victim].use = FALSE;	// second chance
+    }
+}
+
+//----------------------------------------------------------------------
+// NewTLBPolicy
+// 	Create a replacement policy by name.
+//
+//	"name" -- one of "fifo", "lru", "random" or "clock"
+//	"numSets", "numWays" -- the shape of the TLB
+//----------------------------------------------------------------------
+
+TLBPolicy *
+NewTLBPolicy(char *name, int numSets, int numWays)
+{
+    if (!strcmp(name, "fifo"))
+	return new FIFOPolicy(numSets, numWays);
+    else if (!strcmp(name, "lru"))
+	return new LRUPolicy(numSets, numWays);
+    else if (!strcmp(name, "random"))
+	return new RandomPolicy(numSets, numWays);
+    else if (!strcmp(name, "clock"))
+	return new ClockPolicy(numSets, numWays);
+    return NULL;
+}
@@ -0,0 +1,89 @@
+// tlbpolicy.h 
+//	Data structures for choosing which TLB entry to replace on a
+//	TLB miss.
+//
+//	The TLB is divided into sets (see Machine::TLBSet); a virtual
+//	page can only be cached in the entries ("ways") of one set.
+//	When that set is full, a replacement policy picks the victim.
+//	We provide FIFO, LRU, random and clock replacement, so that 
+//	different TLB sizes and policies can be compared on the same
+//	workload (see the -tlb and -tlbp flags in main.cc).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TLBPOLICY_H
+#define TLBPOLICY_H
+
+#include "copyright.h"
+#include "translate.h"
+
+// The following class defines the interface of a TLB replacement 
+// policy, along with the counters every policy keeps.
+
+class TLBPolicy {
+  public:
+    TLBPolicy(char *policyName, int numSets, int numWays);
+    virtual ~TLBPolicy() {}
+
+    virtual int ChooseVictim(TranslationEntry *set, int setIndex) = 0;
+				// Every entry of the set "setIndex" is 
+				// valid; return the index (within the 
+				// set) of the one to replace
+
+    char *getName() { return name; }
+    void Print();		// Print the TLB configuration and counters
+
+    int numFills;		// misses that found an empty entry
+    int numEvictions;		// misses that replaced an entry
+
+  protected:
+    char *name;			// e.g. "lru"
+    int sets;			// number of sets in the TLB
+    int ways;			// number of entries in each set
+};
+
+// Replace the entry that was loaded into the set first
+class FIFOPolicy : public TLBPolicy {
+  public:
+    FIFOPolicy(int numSets, int numWays);
+    ~FIFOPolicy();
+    int ChooseVictim(TranslationEntry *set, int setIndex);
+
+  private:
+    int *next;			// per set, the next entry to replace
+};
+
+// Replace the entry that was used least recently
+class LRUPolicy : public TLBPolicy {
+  public:
+    LRUPolicy(int numSets, int numWays) : TLBPolicy("lru", numSets, numWays) {}
+    int ChooseVictim(TranslationEntry *set, int setIndex);
+};
+
+// Replace any entry of the set
+class RandomPolicy : public TLBPolicy {
+  public:
+    RandomPolicy(int numSets, int numWays) 
+	: TLBPolicy("random", numSets, numWays) {}
+    int ChooseVictim(TranslationEntry *set, int setIndex);
+};
+
+// Sweep a hand over the set, giving entries whose use bit is set a
+// second chance
+class ClockPolicy : public TLBPolicy {
+  public:
+    ClockPolicy(int numSets, int numWays);
+    ~ClockPolicy();
+    int ChooseVictim(TranslationEntry *set, int setIndex);
+
+  private:
+    int *hand;			// per set, where the hand points
+};
+
+// Create the policy called "name" (fifo, lru, random or clock) for
+// a TLB of the given shape; NULL if there is no such policy
+extern TLBPolicy *NewTLBPolicy(char *name, int numSets, int numWays);
+
+#endif // TLBPOLICY_H